@@ -0,0 +1,55 @@
+#pragma once
+#include "server.hpp"
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <string>
+#include <nlohmann/json.hpp>
+
+class IngestPipeline;
+
+// Поток записей из тела запроса (NDJSON или JSON-массив, можно вперемешку):
+// каждый завершённый объект верхнего уровня сразу разбирается и уходит
+// в конвейер, не дожидаясь конца тела. В памяти — только текущая запись и
+// записи, которым не хватило места в очереди конвейера: feed не ждёт (его зовёт
+// реактор), пока они не уйдут, ready() — false и читать дальше не надо.
+class BatchIngest {
+public:
+    static constexpr size_t kMaxRecord = 1 << 20;
+
+    BatchIngest(SharedData* shared, IngestPipeline* pipeline);
+
+    void feed(const char* data, size_t size);
+    // Досылает отложенные записи без ожидания; true — отложенных не осталось
+    bool ready();
+    // Конец тела: отложенные досылаются с ожиданием, незавершённая запись считается отклонённой
+    void finish();
+
+    size_t accepted() const { return m_accepted; }
+    size_t rejected() const { return m_rejected; }
+    size_t filtered() const { return m_filtered; }
+    long long lastSeq() const { return m_last_seq; }
+    // Принятые записи по IMEI (без IMEI — "unknown"): по ним даётся совет устройствам
+    const std::map<std::string, int>& devices() const { return m_devices; }
+
+private:
+    void submitRecord();
+    bool drain(bool wait);
+
+    SharedData* m_shared;
+    IngestPipeline* m_pipeline;
+
+    std::string m_record;
+    int m_depth = 0;          // вложенность внутри текущей записи
+    bool m_in_string = false;
+    bool m_escape = false;
+    bool m_oversized = false;
+    bool m_garbage = false;   // мусор между записями (считается одной отклонённой)
+    std::deque<nlohmann::json> m_waiting; // разобраны, но очередь конвейера была полна
+
+    size_t m_accepted = 0;
+    size_t m_rejected = 0;
+    size_t m_filtered = 0;
+    long long m_last_seq = 0;
+    std::map<std::string, int> m_devices;
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+
+// Сжатие тел HTTP-ответов через zlib: gzip (RFC 1952) и deflate (zlib-поток, RFC 1950)
+
+enum class ContentEncoding {
+    Identity,
+    Gzip,
+    Deflate
+};
+
+const char* encoding_name(ContentEncoding encoding);
+
+// Лучшее из Accept-Encoding клиента: gzip, затем deflate; q=0 — запрет
+ContentEncoding choose_encoding(const std::string& accept_encoding);
+
+// Сжимается ли такой Content-Type (текст, JSON, двоичные точки, MVT — да, PNG — уже сжат)
+bool compressible_type(const std::string& content_type);
+
+bool compress_body(const char* data, size_t size, ContentEncoding encoding, int level, std::string& out);
+
+// Сжатые варианты одного неизменного тела (запись кэша ответов, файл):
+// каждый вариант сжимается один раз, при первом запросе с такой кодировкой
+class CompressedVariants {
+public:
+    // nullptr — сжатие не уменьшило тело; source вызывается только при первом сжатии
+    const std::string* get(ContentEncoding encoding, int level, const std::function<std::string()>& source) const;
+
+private:
+    struct Variant {
+        std::once_flag once;
+        bool useful = false;
+        std::string data;
+    };
+    mutable Variant m_variants[2];
+};
@@ -16,6 +16,13 @@ struct MapPoint {
     std::string type;
 };
 
+// Строка выборки streamPoints с её locations.id: по id индекс точек отличает
+// уже прочитанное из БД от дописанного после
+struct StoredPoint {
+    long long id;
+    MapPoint point;
+};
+
 struct CellData {
     int pci;
     int rsrp;
@@ -47,6 +54,33 @@ struct LocationData {
     long long timestamp;
 };
 
+// Условия выборки истории (/api/range). Время — мс, как measurements.timestamp
+struct RangeQuery {
+    std::string imei;                 // пусто — все устройства
+    long long from = 0;
+    long long to = 0;                 // 0 — без верхней границы (to не включается)
+    bool has_bbox = false;
+    double min_lat = 0, max_lat = 0;
+    double min_lon = 0, max_lon = 0;
+    std::vector<std::string> types;   // типы сот (LTE, GSM, WCDMA); пусто — любые
+    // Продолжение по ключу: строки строго после (after_timestamp, after_id)
+    bool has_after = false;
+    long long after_timestamp = 0;
+    long long after_id = 0;
+    long long limit = 1000;
+};
+
+// Одно измерение истории: координаты и самая сильная сота (из types, если заданы)
+struct RangePoint {
+    long long id;
+    long long timestamp;
+    std::string imei;
+    double lat;
+    double lon;
+    std::string type;
+    int signal_strength;
+};
+
 class DBClient {
 public:
     DBClient(const std::string& conn_string);
@@ -58,9 +92,16 @@ public:
     
     bool importJsonFile(const std::string& json_path);
     bool importJsonDirectory(const std::string& directory_path);
-    bool importJsonData(const json& data);
+    // stored — сюда дописываются строки, которые streamPoints вернёт для этих записей
+    bool importJsonData(const json& data, std::vector<StoredPoint>* stored = nullptr);
     
     std::vector<MapPoint> loadPoints(int limit = 10000);
+    // Построчно через COPY, без материализации результата; callback вернул false — запрос отменяется.
+    // false — ошибка БД. max_id — наибольший locations.id в выборке (0 — пусто)
+    bool streamPoints(long long limit, const std::function<bool(const MapPoint&)>& callback,
+                      long long* max_id = nullptr);
+    // История по времени, устройству и области в порядке (timestamp, id); как streamPoints
+    bool streamRange(const RangeQuery& query, const std::function<bool(const RangePoint&)>& callback);
     std::vector<MapPoint> loadPointsInArea(double min_lat, double max_lat, 
                                            double min_lon, double max_lon, int limit = 10000);
     std::vector<CellData> loadCells(int limit = 2000);
@@ -80,7 +121,8 @@ private:
     std::vector<json> parseCellInfo(const std::string& cell_info_str);
     
     long long insertMeasurement(long long timestamp, const std::string& imei);
-    void insertLocation(long long measurement_id, const json& loc);
+    // id строки; 0 — координат нет, ничего не вставлено
+    long long insertLocation(long long measurement_id, const json& loc);
     void insertCells(long long measurement_id, const std::vector<json>& cells);
     void insertTraffic(long long measurement_id, const json& traffic);
     
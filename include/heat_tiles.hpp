@@ -0,0 +1,46 @@
+#pragma once
+#include "point_index.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Шкала цвета по сигналу, как у маркеров на карте: между опорами — линейно
+struct HeatColorStop {
+    int dbm;
+    uint8_t r, g, b;
+};
+constexpr HeatColorStop kHeatColorStops[] = {
+    {-110, 255, 0, 0},
+    {-100, 255, 255, 0},
+    {-90, 100, 255, 0},
+    {-80, 0, 255, 0},
+};
+
+// Растровый слой теплокарты: тайл 256×256 в той же сетке, что /tile/{z}/{x}/{y}.png.
+// Каждая ячейка индекса (примерно пиксель тайла; с 11-го зума — каждая точка)
+// размазывается гауссовым пятном, вес — число точек. Цвет пикселя — средний сигнал под пятнами (шкала как у
+// маркеров карты), прозрачность — плотность. Поле собирается и с полей соседних
+// тайлов, так что пятна на стыках не обрезаются.
+class HeatTileRenderer {
+public:
+    static constexpr int kTileSize = 256;
+    static constexpr int kMaxZoom = 22;
+
+    struct Options {
+        double sigma_px = 6.0;     // радиус пятна, пиксели тайла
+        int png_level = 1;         // zlib: тайлы строятся на лету, важнее скорость
+    };
+
+    HeatTileRenderer() : HeatTileRenderer(Options{}) {}
+    explicit HeatTileRenderer(const Options& options);
+
+    // false — тайла с такими координатами нет
+    bool render(const PointIndex& index, int z, int x, int y, std::string& png) const;
+    // То же без кодирования: kTileSize² пикселей RGBA по строкам
+    bool renderRgba(const PointIndex& index, int z, int x, int y, std::vector<uint8_t>& rgba) const;
+
+private:
+    Options m_options;
+    int m_radius;
+    std::vector<float> m_kernel;   // 2r+1 отсчётов гаусса, центр — 1
+};
@@ -0,0 +1,119 @@
+#pragma once
+#include "point_index.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Теплокарта одним изображением (вместо внешнего generate_heatmap.py): PNG в
+// Web Mercator по области данных или заданной bbox и легенда JSON — границы
+// изображения (для L.imageOverlay и ГИС) и шкала цвета. Картинка собирается
+// из тайлов того же HeatTileRenderer, что и слой /heat, тайлы — в несколько потоков.
+
+struct HeatmapRequest {
+    bool has_bbox = false;          // иначе — все точки с полями под размытие
+    double min_lon = 0, min_lat = 0, max_lon = 0, max_lat = 0;
+    int max_size = 2048;            // длинная сторона, пиксели; зум — наибольший, при котором влезает
+};
+
+struct HeatmapImage {
+    std::string png;
+    std::string legend;             // JSON
+    int width = 0;
+    int height = 0;
+};
+
+// Потоки сборки тайлов: создаются один раз и служат всем заданиям (у каждого потока
+// свой буфер трассировки — новые потоки на задание копили бы их)
+class HeatmapRenderPool {
+public:
+    explicit HeatmapRenderPool(int threads);    // 0 — по числу ядер
+    ~HeatmapRenderPool();
+
+    // work во всех потоках пула и в вызывающем; возвращается, когда закончили все.
+    // Вызывать из одного потока за раз
+    void run(const std::function<void()>& work);
+    int size() const { return (int)m_threads.size() + 1; }
+
+private:
+    void loop();
+
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    const std::function<void()>* m_work = nullptr;
+    uint64_t m_round = 0;
+    int m_busy = 0;
+    bool m_stopping = false;
+    std::vector<std::thread> m_threads;
+};
+
+// Синхронная сборка на потоках pool (nullptr — в вызывающем). progress — готовые тайлы
+// из total; false — рисовать нечего (error — почему)
+bool render_heatmap(const PointIndex& index, const HeatmapRequest& request, HeatmapRenderPool* pool,
+                    HeatmapImage& out, std::string& error, std::atomic<int>* progress = nullptr,
+                    std::atomic<int>* total = nullptr);
+
+enum class HeatmapJobState { Queued, Running, Done, Failed };
+
+const char* heatmap_job_state_name(HeatmapJobState state);
+
+struct HeatmapJobStatus {
+    std::string id;
+    HeatmapJobState state = HeatmapJobState::Queued;
+    int tiles_done = 0;
+    int tiles_total = 0;
+    double seconds = 0;             // от начала сборки (вместе с индексом)
+    std::string error;
+    std::shared_ptr<const HeatmapImage> image; // у Done
+};
+
+// Очередь заданий: один фоновый поток берёт их по порядку (каждое и так занимает
+// все ядра пула сборки), готовые хранятся, пока их не вытеснят keep более новых.
+// Источник индекса вызывается в фоновом потоке
+class HeatmapJobs {
+public:
+    using IndexSource = std::function<PointIndexPtr()>;
+
+    explicit HeatmapJobs(IndexSource source, int threads = 0, size_t keep = 16);
+    ~HeatmapJobs();
+
+    // Номер задания для опроса
+    std::string submit(const HeatmapRequest& request);
+    // false — нет такого (или уже вытеснено)
+    bool status(const std::string& id, HeatmapJobStatus& out) const;
+
+    void stop();
+
+private:
+    struct Job {
+        HeatmapRequest request;
+        HeatmapJobStatus status;    // под m_mutex
+        std::atomic<int> tiles_done{0};
+        std::atomic<int> tiles_total{0};
+        std::chrono::steady_clock::time_point started;
+    };
+
+    void workerLoop();
+
+    IndexSource m_source;
+    HeatmapRenderPool m_pool;
+    size_t m_keep;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::map<std::string, std::shared_ptr<Job>> m_jobs;
+    std::deque<std::string> m_order;   // номера по времени постановки
+    std::deque<std::shared_ptr<Job>> m_queue;
+    uint64_t m_next_id = 1;
+    bool m_stopping = false;
+    std::thread m_worker;
+};
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Разбор HTTP/1.1 запросов по мере прихода байт: заголовки, тело по Content-Length
+// или chunked. Один разборщик на соединение; после Done — reset() для следующего запроса.
+
+struct HttpRequest {
+    std::string method;
+    std::string target;   // как в строке запроса: путь + ?query
+    std::string path;
+    std::string query;
+    std::string version;
+    std::vector<std::pair<std::string, std::string>> headers; // имена в нижнем регистре
+    std::string body;
+
+    // Пустая строка, если заголовка нет
+    std::string header(const std::string& name) const;
+    // Значение параметра query-строки с декодированием %XX и '+'
+    std::string param(const std::string& name) const;
+    // HTTP/1.1 — пока клиент не попросил Connection: close; HTTP/1.0 — только с keep-alive
+    bool keepAlive() const;
+};
+
+class HttpParser {
+public:
+    enum class State {
+        Headers,
+        Body,
+        Done,
+        Error
+    };
+
+    static constexpr size_t kMaxHeaderBytes = 64 * 1024;
+    static constexpr size_t kMaxBufferedBody = 16 * 1024 * 1024;
+
+    // Разбирает, сколько может, и возвращает число использованных байт. На границе
+    // заголовков останавливается (state() == Body), чтобы вызывающий успел выбрать
+    // обработчик тела. Лишние байты после Done — начало следующего запроса.
+    size_t feed(const char* data, size_t size);
+
+    State state() const { return m_state; }
+    bool done() const { return m_state == State::Done; }
+    bool failed() const { return m_state == State::Error; }
+    // Ни одного байта следующего запроса ещё не пришло
+    bool idle() const { return m_state == State::Headers && m_head.empty(); }
+    int errorStatus() const { return m_error_status; }
+
+    HttpRequest& request() { return m_request; }
+
+    // Тело по частям вместо накопления в request().body (и без предела kMaxBufferedBody)
+    void setBodyHandler(std::function<void(const char*, size_t)> handler) { m_body_handler = std::move(handler); }
+
+    void reset();
+
+private:
+    enum class ChunkState {
+        Size,
+        Data,
+        DataEnd,
+        Trailers
+    };
+
+    bool parseHead();
+    void fail(int status);
+    void emitBody(const char* data, size_t size);
+    size_t feedChunked(const char* data, size_t size);
+
+    State m_state = State::Headers;
+    int m_error_status = 0;
+    HttpRequest m_request;
+    std::string m_head;
+    std::string m_line;
+
+    bool m_chunked = false;
+    ChunkState m_chunk_state = ChunkState::Size;
+    uint64_t m_remaining = 0;
+    std::function<void(const char*, size_t)> m_body_handler;
+};
+
+const char* http_status_text(int status);
+
+// Дата в формате HTTP (IMF-fixdate, "Sun, 06 Nov 1994 08:49:37 GMT")
+std::string http_date(time_t t);
+bool parse_http_date(const std::string& text, time_t& t);
@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Нагрузка на HTTP-сервер, как от браузера с картой: несколько соединений
+// разбирают общий список путей. Меряет задержку запросов и число соединений.
+
+struct HttpBenchOptions {
+    std::string host = "127.0.0.1";
+    int port = 8081;
+    std::vector<std::string> paths; // пусто — пачка тайлов вокруг центра карты
+    int connections = 6;            // как у браузера на один хост
+    int rounds = 10;                // сколько раз пройти весь список
+    int pipeline = 1;               // запросов в полёте на соединение
+    bool keep_alive = true;
+};
+
+// Тайлы z/x/y вокруг точки: cols x rows, как видимая область Leaflet
+std::vector<std::string> tile_burst_paths(double lat, double lon, int zoom, int cols, int rows);
+
+int run_http_bench(const HttpBenchOptions& opts);
+
+// Сериализация /api/points без сервера и БД: JSON против двоичного формата
+// на count синтетических точках — время кодирования и размер (сырой и gzip)
+int run_points_bench(int count);
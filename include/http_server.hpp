@@ -0,0 +1,153 @@
+#pragma once
+#include "http.hpp"
+#include "static_files.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Тело ответа, которое пишется по мере готовности (Transfer-Encoding: chunked).
+// write() ждёт, пока реактор не разгрузит буфер: память ограничена, медленный
+// клиент тормозит производителя, а не раздувает очередь.
+class HttpChunkSink {
+public:
+    virtual ~HttpChunkSink() = default;
+    // false — клиент ушёл, дальше писать незачем
+    virtual bool write(const char* data, size_t size) = 0;
+    bool write(const std::string& data) { return write(data.data(), data.size()); }
+};
+
+struct HttpResponse {
+    int status = 200;
+    std::string content_type = "text/html";
+    std::string body;
+    std::vector<std::pair<std::string, std::string>> headers; // дополнительные
+    StaticFilePtr file; // тело — файл целиком (body не используется), уходит через sendfile
+    std::shared_ptr<const std::string> shared_body; // тело из кэша ответов вместо body, без лишней копии
+    std::shared_ptr<const CompressedVariants> variants; // сжатые варианты file/shared_body, живут вместе с ними
+    // Валидаторы: по ним сервер сам отвечает 304 на If-None-Match / If-Modified-Since
+    std::string etag;        // в кавычках, как в заголовке
+    time_t last_modified = 0;
+    // Тело по частям: вызывается в потоке пула после отправки заголовков (body и file не используются)
+    std::function<void(HttpChunkSink&)> stream;
+    // Подписка Server-Sent Events на канал: после body (например, "retry:") ответ не
+    // заканчивается, дальше в него пишет HttpServer::publish
+    std::string event_channel;
+    // Ответ на HEAD: заголовки (и Content-Length) как у GET, тела нет
+    bool head = false;
+
+    // Статусная строка, заголовки и тело одним буфером (при file — только заголовки)
+    std::string serialize(bool keep_alive) const;
+};
+
+// Кадр Server-Sent Events: "event:", "id:" (если не пусты) и data построчно
+std::string sse_event(const std::string& event, const std::string& data, const std::string& id = "");
+
+// 304 вместо тела, если у клиента та же версия (If-None-Match важнее If-Modified-Since).
+// Сервер вызывает её сам до сжатия ответа
+void apply_conditional(const HttpRequest& request, HttpResponse& response);
+// Совпадает ли If-None-Match с ETag ответа. Сравнение слабое (W/ не важен), суффикс
+// сжатого варианта ("-gzip") отбрасывается; matched — тег клиента для ответа 304
+bool etag_matches(const std::string& if_none_match, const std::string& etag, std::string& matched);
+
+// Тело запроса по частям (например, пакетная загрузка): создаётся на реакторе
+// сразу после заголовков, получает байты по мере прихода, затем отдаётся обработчику
+class HttpBodyStream {
+public:
+    virtual ~HttpBodyStream() = default;
+    virtual void feed(const char* data, size_t size) = 0;
+    // false — приёмник не успевает: реактор перестаёт читать сокет и переспрашивает,
+    // пока не станет true (ждать в feed нельзя — встанет весь реактор)
+    virtual bool ready() { return true; }
+};
+
+// Событийный HTTP-сервер: неблокирующие сокеты и epoll, по реактору на ядро
+// (свой слушающий сокет с SO_REUSEPORT — ядро само раскладывает соединения).
+// Реактор только читает и пишет; обработчики выполняются в пулах потоков, готовый
+// ответ возвращается реактору через eventfd. Пулов три, чтобы медленное не задерживало
+// быстрое: файлы и тайлы с диска (FilePredicate), обработчики с БД и тела потоковых
+// ответов — медленный клиент /api/export держит только поток из последнего пула.
+// Соединения постоянные (HTTP/1.1 keep-alive); конвейерные запросы одного
+// соединения обрабатываются по очереди, ответы уходят в порядке запросов.
+class HttpServer {
+public:
+    struct Options {
+        int port = 8081;
+        int reactors = 0;               // 0 — по числу ядер
+        int workers = 4;                // обработчики с БД и кэшем ответов
+        int file_workers = 2;           // файлы и тайлы с диска
+        int stream_workers = 4;         // тела потоковых ответов (chunked)
+        size_t max_connections = 10000; // на весь сервер; сверх — 503 и закрытие
+        size_t max_pending = 1024;      // запросов в очереди пула; сверх — 503
+        size_t max_pending_streams = 64; // потоковых ответов ждут свободный поток; сверх — 503
+        int idle_timeout_ms = 10000;    // недочитанный запрос дольше — закрываем
+        int keepalive_timeout_ms = 5000; // простой между запросами keep-alive
+        size_t max_requests_per_connection = 1000;
+        int compression_level = 6;      // zlib 1..9; 0 — не сжимать
+        size_t compress_min_bytes = 1024; // меньше — не стоит заголовков и CPU
+        size_t stream_chunk_bytes = 16 * 1024;  // размер chunk потокового ответа
+        size_t stream_buffer_bytes = 256 * 1024; // сколько потоковый ответ держит в очереди к сокету
+        size_t event_buffer_bytes = 64 * 1024;   // неотправленных событий на подписчика; сверх — "reset"
+        int event_heartbeat_ms = 15000;          // комментарий подписчику, если событий долго нет
+    };
+
+    // Вызывается в потоке пула
+    using Handler = std::function<void(const HttpRequest&, HttpResponse&, HttpBodyStream*)>;
+    // Вызывается на реакторе после заголовков; nullptr — тело копится в request.body
+    using BodyStreamFactory = std::function<std::unique_ptr<HttpBodyStream>(const HttpRequest&)>;
+    // Вызывается на реакторе после запроса: true — обработчик только отдаёт файл
+    // (без БД и потокового тела), такой запрос идёт в пул файлов
+    using FilePredicate = std::function<bool(const HttpRequest&)>;
+
+    HttpServer(const Options& options, Handler handler, BodyStreamFactory body_streams = nullptr,
+               FilePredicate is_file = nullptr);
+    ~HttpServer();
+
+    bool start();
+    void stop();
+
+    // Событие всем подписчикам канала (кадр — готовый sse_event). Не блокирует: кадр один
+    // на всех, реакторы дописывают его в очереди соединений сами
+    void publish(const std::string& channel, std::string event);
+    size_t subscribers() const { return m_subscribers.load(std::memory_order_relaxed); }
+
+    struct Reactor;
+
+private:
+    struct Job {
+        Reactor* reactor;
+        int fd;
+        uint64_t conn_id;
+        HttpRequest request;
+        std::unique_ptr<HttpBodyStream> body;
+        uint64_t start_ns;
+        bool keep_alive;
+    };
+
+    struct Pool;
+
+    friend struct Reactor;
+    bool dispatch(Job job);
+    void handleJob(Job& job);
+    void runStream(Job& job, HttpResponse& response);
+
+    Options m_options;
+    Handler m_handler;
+    BodyStreamFactory m_body_streams;
+    FilePredicate m_is_file;
+
+    std::vector<std::unique_ptr<Reactor>> m_reactors;
+    std::atomic<size_t> m_connections{0};
+    std::atomic<size_t> m_subscribers{0};
+
+    std::unique_ptr<Pool> m_pool;         // обработчики с БД
+    std::unique_ptr<Pool> m_file_pool;    // файлы и тайлы
+    std::unique_ptr<Pool> m_stream_pool;  // тела потоковых ответов
+};
@@ -0,0 +1,31 @@
+#pragma once
+#include "server.hpp"
+#include <string>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// Фильтры вкладки Filters, применяемые прямо при разборе входящей записи:
+// выключенные секции и соты не попадают в DOM, а значит не сохраняются в БД,
+// не пишутся в журнал и не рассылаются подписчикам.
+struct IngestFilter {
+    bool location = true;
+    bool telephony = true;
+    bool traffic = true;
+    bool lte = true;
+    bool gsm = true;
+    bool wcdma = true;
+
+    bool passesAll() const { return location && telephony && traffic && lte && gsm && wcdma; }
+};
+
+IngestFilter ingest_filter_snapshot(const SharedData& shared);
+
+// Разбор записи (или массива записей) с отсечением по фильтру.
+// false — от записи после фильтрации не осталось данных измерения.
+// Ошибки синтаксиса бросают json::parse_error, как json::parse.
+bool parse_filtered(const char* data, size_t size, const IngestFilter& filter, json& out);
+
+inline bool parse_filtered(const std::string& text, const IngestFilter& filter, json& out) {
+    return parse_filtered(text.data(), text.size(), filter, out);
+}
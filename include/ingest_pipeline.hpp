@@ -0,0 +1,81 @@
+#pragma once
+#include "server.hpp"
+#include "sampling.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+class DBClient;
+class MeasurementPublisher;
+
+// Очередь между приёмом и сохранением. Приём только разбирает запись и ставит её
+// в очередь, отдельный поток пачками пишет в БД и журнал и рассылает подписчикам.
+// Номер записи (shared->counter, seq рассылки) назначается при постановке в очередь.
+class IngestPipeline {
+public:
+    // Сохранённая пачка записей и номер последней; вызывается в потоке сохранения
+    // после рассылки, поэтому должен только поставить данные в очередь, а не ждать
+    using BatchListener = std::function<void(const std::vector<const json*>& records, long long last_seq)>;
+
+    IngestPipeline(SharedData* shared, DBClient* db, MeasurementPublisher* publisher,
+                   std::unique_ptr<SamplingPolicy> policy, size_t capacity = 4096);
+    ~IngestPipeline();
+
+    // Запись или массив записей; при полной очереди ждёт (обратное давление на приём).
+    // Возвращает номер последней принятой записи.
+    long long submit(json data);
+    // Одна запись без ожидания: false — очередь полна, record не тронута
+    bool trySubmit(json& record, long long& seq);
+
+    // Совет устройству для ответа; учитывает и частоту его записей.
+    // records = 0 — записи до сохранения не дошли (отброшены фильтром): только совет, без учёта частоты
+    SamplingAdvice advise(const std::string& imei, int records);
+
+    void setBatchListener(BatchListener listener);
+
+    long long accepted() const { return m_next_seq.load(); }
+    size_t depth() const;
+    size_t capacity() const { return m_capacity; }
+
+    // Дописать очередь до конца и остановить поток сохранения
+    void stop();
+
+private:
+    struct Pending {
+        json record;
+        long long seq;
+    };
+
+    void workerLoop();
+    void store(std::vector<Pending>& batch);
+    void journal(const std::vector<Pending>& batch);
+
+    SharedData* m_shared;
+    DBClient* m_db;
+    MeasurementPublisher* m_publisher;
+    size_t m_capacity;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_not_empty;
+    std::condition_variable m_not_full;
+    std::deque<Pending> m_queue;
+    bool m_stopping = false;
+    BatchListener m_listener;
+    std::atomic<long long> m_next_seq{0};
+
+    std::mutex m_policy_mutex;
+    std::unique_ptr<SamplingPolicy> m_policy;
+    DeviceRateTracker m_rates;
+    std::atomic<uint64_t> m_db_latency_ns{0};
+
+    std::thread m_worker;
+};
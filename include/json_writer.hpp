@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Потоковая запись JSON прямо в строку-буфер, без дерева nlohmann::json.
+// Вывод совпадает с json::dump() побайтно: без пробелов, целые через
+// std::to_chars, числа с плавающей точкой — форматтером nlohmann (55.0, 1e-05),
+// строки с теми же экранированиями. Ключи объекта пишутся в порядке вызовов: чтобы совпасть
+// с dump(), вызывающий пишет их по алфавиту.
+//
+//     JsonWriter w(out);
+//     w.beginObject();
+//     w.key("lat"); w.value(55.01);
+//     w.endObject();
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out) : m_out(out) {}
+
+    void beginObject() { open('{'); }
+    void endObject() { close('}'); }
+    void beginArray() { open('['); }
+    void endArray() { close(']'); }
+
+    // Ключ — строковый литерал без символов, требующих экранирования
+    template <size_t N>
+    void key(const char (&name)[N]) {
+        separator();
+        m_out += '"';
+        m_out.append(name, N - 1);
+        m_out += "\":";
+        m_after_key = true;
+    }
+    void key(std::string_view name);
+
+    void value(int v) { value((long long)v); }
+    void value(long v) { value((long long)v); }
+    void value(long long v);
+    void value(unsigned v) { value((unsigned long long)v); }
+    void value(unsigned long v) { value((unsigned long long)v); }
+    void value(unsigned long long v);
+    void value(double v);
+    void value(bool v);
+    void value(std::string_view v);
+    void value(const char* v) { value(std::string_view(v)); }
+    void value(const std::string& v) { value(std::string_view(v)); }
+    void null();
+
+    // Уже готовый JSON (например, запись из журнала)
+    void raw(std::string_view json);
+
+private:
+    void separator() {
+        if (m_after_key) {
+            m_after_key = false;
+        } else if (m_need_comma) {
+            m_out += ',';
+        }
+        m_need_comma = true;
+    }
+    void open(char c) {
+        separator();
+        m_out += c;
+        m_need_comma = false;
+    }
+    void close(char c) {
+        m_out += c;
+        m_need_comma = true;
+    }
+
+    std::string& m_out;
+    bool m_need_comma = false;
+    bool m_after_key = false;
+};
+
+// Число с плавающей точкой так же, как json::dump()
+void json_append_double(std::string& out, double v);
+// Строка в кавычках с экранированием как в json::dump()
+void json_append_string(std::string& out, std::string_view s);
@@ -0,0 +1,80 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+// Асинхронный логгер: поток-производитель кладёт запись в свою lock-free
+// очередь и сразу возвращается, печатает и сбрасывает вывод фоновый поток.
+
+enum class LogLevel {
+    Debug = 0,
+    Info,
+    Warn,
+    Error,
+    Off
+};
+
+// Уровни ниже порога вырезаются при компиляции (-DHEAPMAP_LOG_FLOOR=2 — только Warn и Error)
+#ifndef HEAPMAP_LOG_FLOOR
+#define HEAPMAP_LOG_FLOOR 0
+#endif
+
+extern std::atomic<int> g_log_level;
+
+inline bool log_enabled(LogLevel level) {
+    return (int)level >= g_log_level.load(std::memory_order_relaxed);
+}
+
+void log_set_level(LogLevel level);
+bool log_parse_level(const std::string& name, LogLevel& level);
+
+void log_write(LogLevel level, const char* component, std::string message);
+
+// Дописать всё из очередей и остановить фоновый поток (вызывается при выходе)
+void log_shutdown();
+
+// Ограничение частоты для одного места вызова: не больше per_second записей в секунду,
+// пропущенные учитываются и выводятся вместе со следующей записью
+class LogRateLimit {
+public:
+    bool allow(uint32_t per_second, uint64_t& suppressed);
+
+private:
+    std::atomic<int64_t> m_window{0};
+    std::atomic<uint32_t> m_count{0};
+    std::atomic<uint64_t> m_suppressed{0};
+};
+
+#define HEAPMAP_LOG(level, component, expr)                                   \
+    do {                                                                      \
+        if ((int)(level) >= HEAPMAP_LOG_FLOOR && log_enabled(level)) {        \
+            std::ostringstream log_stream_;                                   \
+            log_stream_ << expr;                                              \
+            log_write(level, component, log_stream_.str());                   \
+        }                                                                     \
+    } while (0)
+
+#define HEAPMAP_LOG_RL(level, component, per_second, expr)                    \
+    do {                                                                      \
+        if ((int)(level) >= HEAPMAP_LOG_FLOOR && log_enabled(level)) {        \
+            static LogRateLimit log_limit_;                                   \
+            uint64_t log_suppressed_ = 0;                                     \
+            if (log_limit_.allow(per_second, log_suppressed_)) {              \
+                std::ostringstream log_stream_;                               \
+                log_stream_ << expr;                                          \
+                if (log_suppressed_)                                          \
+                    log_stream_ << " (+" << log_suppressed_ << " suppressed)"; \
+                log_write(level, component, log_stream_.str());               \
+            }                                                                 \
+        }                                                                     \
+    } while (0)
+
+#define LOG_DEBUG(component, expr) HEAPMAP_LOG(LogLevel::Debug, component, expr)
+#define LOG_INFO(component, expr) HEAPMAP_LOG(LogLevel::Info, component, expr)
+#define LOG_WARN(component, expr) HEAPMAP_LOG(LogLevel::Warn, component, expr)
+#define LOG_ERROR(component, expr) HEAPMAP_LOG(LogLevel::Error, component, expr)
+
+#define LOG_INFO_RL(component, per_second, expr) HEAPMAP_LOG_RL(LogLevel::Info, component, per_second, expr)
+#define LOG_WARN_RL(component, per_second, expr) HEAPMAP_LOG_RL(LogLevel::Warn, component, per_second, expr)
+#define LOG_ERROR_RL(component, per_second, expr) HEAPMAP_LOG_RL(LogLevel::Error, component, per_second, expr)
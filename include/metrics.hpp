@@ -0,0 +1,143 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Гистограмма задержек в духе HDR: группы по степеням двойки,
+// внутри группы 16 линейных ячеек (погрешность ~6%). Запись — только relaxed-атомики.
+class LatencyHistogram {
+public:
+    static constexpr int kSubBits = 4;
+    static constexpr int kSubCount = 1 << kSubBits;
+    static constexpr int kGroups = 64 - kSubBits + 1;
+    static constexpr int kBuckets = kGroups * kSubCount;
+
+    void record(uint64_t ns);
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+    uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+
+    // q в [0, 1], результат в наносекундах (верхняя граница ячейки)
+    uint64_t percentile(double q) const;
+    // Число записей со значением <= ns (с точностью до ячейки)
+    uint64_t count_le(uint64_t ns) const;
+
+    static int bucket_index(uint64_t ns);
+    static uint64_t bucket_upper(int index);
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> m_buckets{};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_max{0};
+};
+
+enum class IngestStage {
+    Dispatch,   // от возврата recv до разбора: копия сообщения, выбор команды (само ожидание recv не входит)
+    Parse,
+    DbInsert,
+    Journal,
+    Publish,
+    Reply,
+    Count
+};
+
+const char* stage_name(IngestStage stage);
+
+// Фильтры приёма (вкладка Filters): секции записи и технологии сот
+enum class IngestFilterKind {
+    Location,
+    Telephony,
+    Traffic,
+    Lte,
+    Gsm,
+    Wcdma,
+    Count
+};
+
+const char* filter_kind_name(IngestFilterKind kind);
+
+struct IngestMetrics {
+    LatencyHistogram stages[(int)IngestStage::Count];
+
+    std::atomic<uint64_t> messages{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<int64_t> queue_depth{0}; // принято, но ещё не сохранено
+    std::atomic<uint64_t> published{0};
+    std::atomic<uint64_t> published_bytes{0};
+    // Отброшено фильтром: секций (по записи) и сот (по штуке); записей, от которых не осталось данных
+    std::atomic<uint64_t> filtered[(int)IngestFilterKind::Count] = {};
+    std::atomic<uint64_t> filtered_records{0};
+    // Последний совет устройствам (политика выборки) и число активных устройств
+    std::atomic<int> advised_interval_ms{0};
+    std::atomic<int> advised_batch{0};
+    std::atomic<int> active_devices{0};
+    // Приём без ZMQ (TCP-кадры, UDP-датаграммы) и учёт потерь по seq
+    std::atomic<uint64_t> raw_tcp_frames{0};
+    std::atomic<uint64_t> raw_udp_datagrams{0};
+    std::atomic<uint64_t> raw_lost{0};
+    std::atomic<uint64_t> raw_out_of_order{0};
+
+    LatencyHistogram& stage(IngestStage s) { return stages[(int)s]; }
+};
+
+IngestMetrics& ingest_metrics();
+
+// HTTP-сервер (порт 8081)
+struct HttpMetrics {
+    LatencyHistogram latency;             // от полного запроса до готового ответа
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> errors{0};      // ответы 4xx/5xx
+    std::atomic<int64_t> connections{0};
+    std::atomic<int64_t> pending{0};      // запросы в очереди пула
+    std::atomic<int64_t> pending_streams{0}; // потоковые ответы, ждущие свободного потока
+    std::atomic<uint64_t> rejected{0};    // сверх предела соединений или очереди (503)
+    std::atomic<uint64_t> timeouts{0};    // закрыты по таймауту недочитанного запроса
+    std::atomic<uint64_t> file_cache_hits{0};
+    std::atomic<uint64_t> file_cache_misses{0};
+    std::atomic<int64_t> file_mapped_bytes{0};
+    std::atomic<uint64_t> file_bytes{0};  // тела файлов, отправленные без копирования в буфер ответа
+    std::atomic<uint64_t> response_cache_hits{0};
+    std::atomic<uint64_t> response_cache_misses{0};    // построено заново (запрос к БД)
+    std::atomic<uint64_t> response_cache_coalesced{0}; // дождались чужого построения
+    std::atomic<uint64_t> compressions{0};             // вызовы zlib (кэшированные варианты — один раз)
+    std::atomic<uint64_t> compressed_responses{0};
+    std::atomic<uint64_t> compression_saved_bytes{0};
+    std::atomic<uint64_t> not_modified{0};             // ответы 304 по ETag/дате
+    std::atomic<uint64_t> streamed_responses{0};       // Transfer-Encoding: chunked
+    std::atomic<uint64_t> streamed_bytes{0};
+    std::atomic<int64_t> sse_subscribers{0};           // открытые подписки Server-Sent Events
+    std::atomic<uint64_t> sse_events{0};               // событий поставлено в очереди подписчиков
+    std::atomic<uint64_t> sse_coalesced{0};            // очередь медленного подписчика заменена на "reset"
+};
+
+HttpMetrics& http_metrics();
+
+inline uint64_t metrics_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Гистограмма этапа + спан трассировки (если она включена)
+void record_stage(IngestStage stage, uint64_t start_ns);
+
+// Замер этапа на время жизни объекта
+class StageTimer {
+public:
+    explicit StageTimer(IngestStage stage) : m_stage(stage), m_start(metrics_now_ns()) {}
+    ~StageTimer() { record_stage(m_stage, m_start); }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    IngestStage m_stage;
+    uint64_t m_start;
+};
+
+// Текстовый формат Prometheus для /api/metrics
+std::string render_prometheus_metrics();
@@ -0,0 +1,29 @@
+#pragma once
+#include "point_index.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Векторные тайлы Mapbox Vector Tile 2.1 (protobuf), закодированные вручную.
+// Один слой "measurements" с точками; у точки атрибуты count (точек в кластере,
+// 1 — отдельное измерение) и signal (средний сигнал, дБм, целое).
+// Координаты — целые внутри тайла, 0..kMvtExtent, ось y вниз.
+
+constexpr uint32_t kMvtExtent = 4096;
+constexpr int kMvtMaxZoom = 22;
+constexpr const char* kMvtContentType = "application/vnd.mapbox-vector-tile";
+
+struct MvtPoint {
+    int32_t x;
+    int32_t y;
+    uint32_t count;
+    int32_t signal;
+};
+
+// Тайл из одного слоя точек; значения атрибутов в таблице слоя не повторяются
+std::string encode_mvt_points(const std::string& layer, const std::vector<MvtPoint>& points);
+
+// Тайл z/x/y по индексу: кластеры по ячейкам 16 px (до 256 на тайл), с зума 15 —
+// отдельные точки, если их в тайле не больше PointIndex::kMaxItems.
+// false — тайла с такими координатами нет
+bool encode_mvt_tile(const PointIndex& index, int z, int x, int y, std::string& out);
@@ -0,0 +1,8 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Кодирование RGBA 8 бит в PNG через zlib. Строки фильтруются по Sub — для
+// плавных градиентов теплокарты это почти вдвое короче, чем без фильтра,
+// а стоит одного вычитания на байт. level — уровень zlib (1 — быстрее всего).
+bool encode_png_rgba(const uint8_t* rgba, int width, int height, int level, std::string& out);
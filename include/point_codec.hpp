@@ -0,0 +1,38 @@
+#pragma once
+#include "db_client.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Сериализация точек карты для /api/points.
+//
+// Двоичный формат application/vnd.heapmap.points (little-endian), столбцами,
+// чтобы браузер разбирал его типизированными массивами без копирования:
+//
+//   0   char[4]  "HMP1"
+//   4   uint32   count
+//   8   int64    base_timestamp   (время первой точки)
+//   16  uint32   coord_scale      (10^7: lat/lon хранятся как round(deg * scale))
+//   20  uint32   reserved
+//   24  int32    lat[count]
+//       int32    lon[count]
+//       int32    dt[count]        (разница с предыдущей точкой, у первой 0; в единицах timestamp)
+//       int8     signal[count]    (дБм, обрезано до -128..127)
+//
+// new Int32Array(buf, 24, n), new Int32Array(buf, 24 + 4 * n, n), ...
+
+inline constexpr const char* kPointsBinaryType = "application/vnd.heapmap.points";
+inline constexpr uint32_t kPointsCoordScale = 10000000;
+inline constexpr size_t kPointsHeaderSize = 24;
+
+// [{"lat":..,"lon":..,"signal":..,"timestamp":..},...]
+std::string encode_points_json(const std::vector<MapPoint>& points);
+
+// false — разница времени соседних точек не влезла в int32 (тогда отдаём JSON)
+bool encode_points_binary(const std::vector<MapPoint>& points, std::string& out);
+
+// Обратное преобразование (проверка формата, бенчмарк)
+bool decode_points_binary(const std::string& data, std::vector<MapPoint>& points);
+
+// Клиент просит двоичный вид: ?format=bin или Accept с kPointsBinaryType
+bool wants_binary_points(const std::string& format_param, const std::string& accept);
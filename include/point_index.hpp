@@ -0,0 +1,113 @@
+#pragma once
+#include "db_client.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Пространственный индекс точек для кластеризации на сервере. Координаты
+// переводятся в Web Mercator (как у тайлов), и для каждого зума 0..kMaxClusterZoom
+// заранее посчитана сетка из ячеек по kCellPixels экранных пикселей: число точек,
+// суммы координат и сигнала. Ячейки лежат по строкам сетки, так что запрос по
+// видимой области — двоичный поиск начала каждой строки и проход до её конца.
+
+// Web Mercator в единицах 2^-32 ширины мира (как тайлы: x — на восток, y — на юг)
+uint32_t mercator_x(double lon);
+uint32_t mercator_y(double lat);
+// Обратно: долгота и широта по координате Mercator (дробной — для краёв пикселей)
+double mercator_lon(double wx);
+double mercator_lat(double wy);
+
+struct ClusterQuery {
+    double min_lat = -90, min_lon = -180;
+    double max_lat = 90, max_lon = 180;
+    int zoom = 0;
+};
+
+// Какие ячейки отдавать: область, привязанная к сетке. Одинаковые планы дают
+// одинаковый ответ, поэтому key() годится как ключ кэша
+struct ClusterPlan {
+    int level = 0;                        // зум сетки
+    uint32_t x0 = 0, y0 = 0, x1 = 0, y1 = 0; // ячейки, включительно
+    bool raw = false;                     // отдельные точки вместо ячеек
+
+    std::string key() const;
+};
+
+struct PointCluster {
+    double lat;      // центр масс точек ячейки
+    double lon;
+    uint32_t count;
+    double signal;   // средний сигнал, дБм
+};
+
+class PointIndex {
+public:
+    static constexpr int kCellPixels = 64;
+    // Выше — отдельные точки, если их в области не больше kMaxItems
+    static constexpr int kMaxClusterZoom = 16;
+    // Больше элементов в ответе не бывает: сетка огрубляется, пока область не уложится
+    static constexpr size_t kMaxItems = 4096;
+
+    explicit PointIndex(uint64_t generation) : m_generation(generation) {}
+    // Точки base, чтобы дополнить их через add() и снова finish(): пересортировываются
+    // только новые, с уже упорядоченными они сливаются
+    PointIndex(const PointIndex& base, uint64_t generation);
+
+    void add(double lat, double lon, int signal);
+    // Сортировка и подсчёт ячеек всех уровней; до вызова индекс пуст
+    void finish();
+
+    uint64_t generation() const { return m_generation; }
+    size_t size() const { return m_points.size(); }
+    // Прямоугольник, покрывающий все точки (Mercator, включительно); false — индекс пуст
+    bool extent(uint32_t& wx0, uint32_t& wy0, uint32_t& wx1, uint32_t& wy1) const;
+
+    ClusterPlan plan(const ClusterQuery& query) const;
+    // Все ячейки уровня level, задевающие прямоугольник (координаты Mercator, включительно)
+    static ClusterPlan cover(int level, uint32_t wx0, uint32_t wy0, uint32_t wx1, uint32_t wy1);
+    void collect(const ClusterPlan& plan, std::vector<PointCluster>& out) const;
+    // Сколько точек в ячейках плана
+    size_t countPoints(const ClusterPlan& plan) const;
+
+private:
+    struct Point {
+        double lat;
+        double lon;
+        uint32_t x;      // Web Mercator в единицах 2^-32 ширины мира
+        uint32_t y;
+        int32_t signal;
+    };
+    struct Cell {
+        uint64_t key;    // (y << 32) | x ячейки своего уровня
+        uint32_t first;  // начало точек ячейки (только на kMaxClusterZoom)
+        uint32_t count;
+        double sum_lat;
+        double sum_lon;
+        double sum_signal;
+    };
+
+    template <typename F>
+    void forEachCell(const ClusterPlan& plan, F&& f) const;
+
+    uint64_t m_generation;
+    std::vector<Point> m_points;
+    size_t m_sorted = 0;             // начало m_points, уже упорядоченное по ячейкам
+    std::vector<Cell> m_levels[kMaxClusterZoom + 1];
+};
+
+using PointIndexPtr = std::shared_ptr<const PointIndex>;
+
+// Индекс по всем точкам БД. Из БД читается целиком только в первый раз и после
+// point_index_invalidate(); дальше — копия прежнего с дописанными строками, не чаще
+// раза в 5 с. Пока строится новый, остальные потоки получают прежний.
+// nullptr — индекса ещё нет и построить его не удалось
+PointIndexPtr point_index(DBClient& db);
+// Строки, сохранённые конвейером: попадут в индекс без повторного чтения БД
+void point_index_append(std::vector<StoredPoint> rows);
+// Данные изменились в обход конвейера (импорт): следующий индекс — снова из БД
+void point_index_invalidate();
+
+// {"level":..,"raw":..,"items":[{"count","lat","lon","signal"},...]}
+std::string encode_clusters_json(const ClusterPlan& plan, const std::vector<PointCluster>& clusters);
@@ -0,0 +1,28 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <zmq.hpp>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// Рассылка принятых измерений подписчикам (GUI, аналитика, запись) через ZMQ PUB.
+// Каждая секция записи уходит отдельным сообщением из двух частей:
+//   [тема "<секция>/<imei>"] [msgpack {"seq", "timestamp", "imei", <секция>}]
+// Секции: location, telephony (вместе с cellInfo), traffic; прочее — raw.
+// Подписка по типу — префикс "location/", по устройству — "<секция>/<imei>".
+class MeasurementPublisher {
+public:
+    MeasurementPublisher(zmq::context_t& context, const std::string& endpoint, int hwm = 1000);
+
+    bool isBound() const { return m_bound; }
+
+    // Не блокирует: медленный подписчик упирается в HWM и теряет сообщения сам
+    void publish(const json& record, long long seq);
+
+private:
+    void send(const std::string& topic, const json& body);
+
+    std::unique_ptr<zmq::socket_t> m_socket;
+    bool m_bound = false;
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include "server.hpp"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class IngestPipeline;
+
+// Приём для устройств без ZMQ, без ответа (fire-and-forget), на одном порту:
+//   TCP: поток кадров [u32 длина JSON][u32 seq][JSON], числа в сетевом порядке байт
+//   UDP: одна запись в датаграмме [u32 seq][JSON]
+// seq растёт на 1 у каждого источника (соединение TCP или адрес UDP) — по разрывам
+// считаются потери. Записи идут в тот же конвейер, что и ZMQ.
+class RawIngestListener {
+public:
+    static constexpr uint32_t kMaxFrame = 1 << 20;
+
+    RawIngestListener(SharedData* shared, IngestPipeline* pipeline, int port);
+    ~RawIngestListener();
+
+    bool start();
+    void stop();
+
+private:
+    struct Connection {
+        std::string buffer;
+        uint32_t expected_seq = 0;
+        bool has_seq = false;
+    };
+
+    void loop();
+    void acceptConnections();
+    // false — соединение нужно закрыть
+    bool readConnection(int fd, Connection& conn);
+    void readDatagrams();
+    void handleRecord(const char* data, size_t size, uint32_t seq, uint32_t& expected, bool& has_seq);
+
+    SharedData* m_shared;
+    IngestPipeline* m_pipeline;
+    int m_port;
+
+    int m_epoll_fd = -1;
+    int m_tcp_fd = -1;
+    int m_udp_fd = -1;
+    std::unordered_map<int, Connection> m_connections;
+    std::unordered_map<uint64_t, Connection> m_udp_sources; // по адресу:порту, buffer не используется
+    std::vector<char> m_udp_storage;
+
+    std::atomic<bool> m_stop{false};
+    std::thread m_thread;
+};
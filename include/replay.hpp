@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+struct ReplayOptions {
+    std::string path = "data/all_data.json";
+    std::string endpoint = "tcp://127.0.0.1:8080";
+    double speed = 1.0;            // 0 — без пауз, максимально быстро
+    int streams = 1;               // параллельные "устройства"
+    int loops = 1;
+    bool rebase_timestamps = true; // штампуем время отправки, как живое устройство
+    bool adaptive = false;         // темп и размер пачек — по совету сервера в ответе
+};
+
+// JSON-массив (all_data.json) или сегмент журнала: по одной записи в строке
+std::vector<json> load_replay_records(const std::string& path);
+
+int run_replay(const ReplayOptions& opts);
@@ -0,0 +1,79 @@
+#pragma once
+#include "compression.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Поколение данных: растёт после каждой записи в БД (конвейер приёма, импорт).
+// Кэшированные ответы API помечены поколением, на котором построены.
+uint64_t data_generation();
+void bump_data_generation();
+
+// Кэш готовых ответов API по ключу "маршрут?параметры". Ответ текущего поколения
+// отдаётся из памяти; одинаковые запросы, пришедшие, пока ответ строится,
+// ждут одного построения (single-flight) вместо своего запроса к БД.
+// Сверх предела вытесняются давно не запрошенные записи, по одной (LRU).
+class ResponseCache {
+public:
+    struct Entry {
+        std::string body;
+        std::string content_type;
+        uint64_t generation = 0;   // build может выставить сам, если строит из более старых данных
+        uint64_t built_ms = 0;
+        time_t built_at = 0;       // для Last-Modified
+        CompressedVariants compressed;
+    };
+    using EntryPtr = std::shared_ptr<const Entry>;
+    using Builder = std::function<void(Entry&)>;
+
+    struct Options {
+        size_t max_entries = 256;
+        size_t max_bytes = 64 << 20;   // тела записей
+        // Ответ прошлого поколения ещё годен столько мс: при непрерывном приёме
+        // поколение меняется на каждой пачке, и без этого кэш бы не попадал
+        int max_stale_ms = 1000;
+    };
+
+    ResponseCache() = default;
+    explicit ResponseCache(const Options& options) : m_options(options) {}
+
+    // Исключение из build уходит вызвавшему; ждавшие пробуют построить сами
+    EntryPtr get(const std::string& key, const Builder& build);
+
+    void clear();
+
+private:
+    struct Flight {
+        bool done = false;
+        EntryPtr result;
+    };
+    struct Slot {
+        EntryPtr entry;
+        std::shared_ptr<Flight> flight;
+        std::list<std::string>::iterator lru; // у записей с entry
+    };
+
+    bool fresh(const Entry& e, uint64_t generation, uint64_t now) const;
+    void store(const std::string& key, Slot& slot, EntryPtr entry);
+    void drop(Slot& slot);
+    void evict();
+
+    Options m_options;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::unordered_map<std::string, Slot> m_slots;
+    std::list<std::string> m_lru;   // ключи с entry, недавно запрошенные — в начале
+    size_t m_bytes = 0;
+};
+
+// Ответы API
+ResponseCache& response_cache();
+// Тайлы /heat и /mvt: их тысячи, поэтому отдельно — чтобы не вытесняли ответы API
+ResponseCache& tile_cache();
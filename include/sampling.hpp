@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// Обратная связь устройствам: в ответе на запись сервер советует интервал
+// снятия измерений и сколько записей собирать в одно сообщение.
+
+// Что видит политика в момент ответа
+struct SamplingSignals {
+    size_t queue_depth = 0;       // записи, принятые, но ещё не сохранённые
+    size_t queue_capacity = 1;
+    uint64_t db_latency_ns = 0;   // сглаженное время сохранения одной записи
+    double device_rate = 0;       // записей в секунду от этого устройства
+    double total_rate = 0;        // записей в секунду от всех устройств
+    int active_devices = 1;
+};
+
+struct SamplingAdvice {
+    int interval_ms = 1000;
+    int batch = 1;
+};
+
+class SamplingPolicy {
+public:
+    virtual ~SamplingPolicy() = default;
+    virtual const char* name() const = 0;
+    // Вызывается на каждый ответ устройству, из одного потока за раз
+    virtual SamplingAdvice advise(const SamplingSignals& signals) = 0;
+};
+
+// Всегда один и тот же совет — прежнее поведение, база для сравнения
+class FixedSamplingPolicy : public SamplingPolicy {
+public:
+    explicit FixedSamplingPolicy(SamplingAdvice advice = {}) : m_advice(advice) {}
+    const char* name() const override { return "fixed"; }
+    SamplingAdvice advise(const SamplingSignals&) override { return m_advice; }
+
+private:
+    SamplingAdvice m_advice;
+};
+
+// Делит пропускную способность БД (при целевой загрузке) поровну между активными
+// устройствами и добавляет штраф за наполнение очереди. Интервал сглаживается:
+// назад под нагрузкой — быстро, обратно к базовому — медленно, без рывков.
+class AdaptiveSamplingPolicy : public SamplingPolicy {
+public:
+    struct Config {
+        int base_interval_ms = 1000;
+        int min_interval_ms = 200;
+        int max_interval_ms = 30000;
+        int max_batch = 50;
+        double target_utilization = 0.7;
+        double queue_high = 0.25;    // доля очереди, с которой начинается штраф
+        double backoff_alpha = 0.5;
+        double recover_alpha = 0.1;
+    };
+
+    AdaptiveSamplingPolicy() : AdaptiveSamplingPolicy(Config{}) {}
+    explicit AdaptiveSamplingPolicy(const Config& config);
+
+    const char* name() const override { return "adaptive"; }
+    SamplingAdvice advise(const SamplingSignals& signals) override;
+
+private:
+    Config m_config;
+    double m_interval_ms;
+};
+
+// "fixed" или "adaptive"; nullptr для неизвестного имени
+std::unique_ptr<SamplingPolicy> make_sampling_policy(const std::string& name);
+
+// Частота записей по устройствам (по IMEI), сглаженная по интервалам между приходами
+class DeviceRateTracker {
+public:
+    // Возвращает частоту этого устройства после учёта записи
+    double observe(const std::string& imei, uint64_t now_ns, int records = 1);
+    // Текущая частота устройства без учёта новой записи; 0 — устройство неизвестно
+    double rate(const std::string& imei) const;
+
+    double totalRate(uint64_t now_ns);
+    int activeDevices(uint64_t now_ns);
+
+private:
+    struct Device {
+        uint64_t last_ns = 0;
+        double rate = 0;
+    };
+
+    void expire(uint64_t now_ns);
+
+    std::unordered_map<std::string, Device> m_devices;
+    double m_total_rate = 0;
+    uint64_t m_last_expire_ns = 0;
+};
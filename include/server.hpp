@@ -1,6 +1,8 @@
 #pragma once
+#include <atomic>
 #include <deque>
 #include <mutex>
+#include <string>
 #include <nlohmann/json.hpp>
 
 using json = nlohmann::json;
@@ -11,15 +13,31 @@ struct SharedData {
     int counter = 0;
     int max_history = 1000;
     
-    // Filters
-    bool filter_location = true;
-    bool filter_telephony = true;
-    bool filter_traffic = true;
-    bool filter_lte = true;
-    bool filter_gsm = true;
-    bool filter_wcdma = true;
+    // Filters: пишут GUI и команды ZMQ, читают потоки приёма — без data_mutex
+    std::atomic<bool> filter_location{true};
+    std::atomic<bool> filter_telephony{true};
+    std::atomic<bool> filter_traffic{true};
+    std::atomic<bool> filter_lte{true};
+    std::atomic<bool> filter_gsm{true};
+    std::atomic<bool> filter_wcdma{true};
+    
+    // GUI в отдельном процессе: адрес сервера (пусто — локальный IP)
+    std::string server_host;
+    // --gui-only: счётчики приёма остались в процессе сервера
+    bool remote_gui = false;
+    
+    // Политика совета устройствам в ответе на запись: "adaptive" или "fixed"
+    std::string sampling_policy = "adaptive";
+    
+    // Уровень zlib для gzip/deflate ответов HTTP; 0 — без сжатия
+    int http_compression_level = 6;
 };
 
 void run_server(SharedData* shared);
 void run_gui(SharedData* shared);
-std::string get_local_ip();
\ No newline at end of file
+void run_remote_feed(SharedData* shared);
+std::string get_local_ip();
+
+// Мягкая остановка по SIGINT/SIGTERM или закрытию окна: безопасно вызывать из обработчика сигнала
+void request_shutdown();
+bool shutdown_requested();
\ No newline at end of file
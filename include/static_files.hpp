@@ -0,0 +1,79 @@
+#pragma once
+#include "compression.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Файл для отдачи по HTTP: открытый дескриптор (тело уходит через sendfile)
+// и, для небольших файлов, отображение в память. Живёт, пока на него ссылается
+// хоть один ответ, даже если кэш уже заменил его новой версией.
+struct StaticFile {
+    int fd = -1;
+    size_t size = 0;
+    time_t mtime = 0;
+    const char* data = nullptr; // mmap; nullptr — только sendfile
+    std::string content_type;
+    CompressedVariants compressed;
+
+    StaticFile() = default;
+    StaticFile(const StaticFile&) = delete;
+    StaticFile& operator=(const StaticFile&) = delete;
+    ~StaticFile();
+
+    // Сильный ETag по хэшу содержимого; считается один раз, при первом запросе
+    const std::string& etag() const;
+
+private:
+    mutable std::once_flag m_etag_once;
+    mutable std::string m_etag;
+};
+
+using StaticFilePtr = std::shared_ptr<const StaticFile>;
+
+// Кэш открытых файлов по пути. Каждое обращение — один stat(): сменились
+// mtime, размер или inode — файл открывается заново, старая версия доживает
+// в ответах, которые её ещё отправляют.
+class StaticFileCache {
+public:
+    struct Options {
+        size_t max_files = 4096;                 // открытых дескрипторов в кэше
+        size_t mmap_max_file = 256 * 1024;       // файлы крупнее — только sendfile
+        size_t mmap_budget = 64 * 1024 * 1024;   // всего отображено в память
+    };
+
+    StaticFileCache() = default;
+    explicit StaticFileCache(const Options& options) : m_options(options) {}
+
+    // nullptr — файла нет или это не обычный файл
+    StaticFilePtr get(const std::string& path);
+
+    size_t mappedBytes() const;
+
+private:
+    struct Entry {
+        StaticFilePtr file;
+        uint64_t dev = 0;
+        uint64_t ino = 0;
+        int64_t mtime_ns = 0;
+        uint64_t last_used = 0;
+    };
+
+    StaticFilePtr load(const std::string& path);
+    void drop(std::unordered_map<std::string, Entry>::iterator it);
+    void evict();
+
+    Options m_options;
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, Entry> m_entries;
+    size_t m_mapped = 0;
+    uint64_t m_clock = 0;
+};
+
+StaticFileCache& static_files();
+
+// Content-Type по расширению
+const char* mime_type(const std::string& path);
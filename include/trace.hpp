@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Трассировка спанов в формате Chrome trace-event (chrome://tracing, Perfetto).
+// Каждый поток пишет в свой кольцевой буфер без блокировок; при выключенной
+// трассировке спан стоит одной relaxed-загрузки флага.
+
+extern std::atomic<bool> g_trace_enabled;
+
+inline bool trace_enabled() {
+    return g_trace_enabled.load(std::memory_order_relaxed);
+}
+
+inline uint64_t trace_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void trace_set_enabled(bool enabled);
+void trace_set_thread_name(const char* name);
+
+// name и category должны быть строковыми литералами (хранится указатель)
+void trace_complete(const char* name, const char* category, uint64_t start_ns, uint64_t dur_ns);
+
+std::string trace_dump_json();
+bool trace_dump_to_file(const std::string& path);
+
+// SIGUSR1 — сбросить трассу в trace_<pid>_<n>.json в текущем каталоге
+void trace_install_signal_handler();
+
+class TraceSpan {
+public:
+    TraceSpan(const char* name, const char* category)
+        : m_name(name), m_category(category), m_start(trace_enabled() ? trace_now_ns() : 0) {}
+    ~TraceSpan() {
+        if (m_start) trace_complete(m_name, m_category, m_start, trace_now_ns() - m_start);
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* m_name;
+    const char* m_category;
+    uint64_t m_start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef HEAPMAP_NO_TRACE
+#define TRACE_SPAN(name, category) ((void)0)
+#else
+#define TRACE_SPAN(name, category) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name, category)
+#endif
@@ -0,0 +1,117 @@
+#include "batch_ingest.hpp"
+#include "ingest_pipeline.hpp"
+#include "ingest_filter.hpp"
+#include "metrics.hpp"
+#include "logger.hpp"
+
+BatchIngest::BatchIngest(SharedData* shared, IngestPipeline* pipeline)
+    : m_shared(shared), m_pipeline(pipeline) {}
+
+void BatchIngest::feed(const char* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        char c = data[i];
+
+        if (m_depth == 0) {
+            // Между записями: пробелы, переводы строк, скобки и запятые массива
+            if (c == '{') {
+                if (m_garbage) {
+                    m_rejected++;
+                    m_garbage = false;
+                }
+                m_depth = 1;
+                m_record.assign(1, c);
+                m_oversized = false;
+            } else if (c != ' ' && c != '\t' && c != '\r' && c != '\n' && c != ',' && c != '[' && c != ']') {
+                m_garbage = true;
+            }
+            continue;
+        }
+
+        if (!m_oversized) {
+            if (m_record.size() < kMaxRecord) {
+                m_record += c;
+            } else {
+                m_oversized = true;
+                m_record.clear();
+            }
+        }
+
+        if (m_in_string) {
+            if (m_escape) m_escape = false;
+            else if (c == '\\') m_escape = true;
+            else if (c == '"') m_in_string = false;
+            continue;
+        }
+
+        if (c == '"') {
+            m_in_string = true;
+        } else if (c == '{' || c == '[') {
+            m_depth++;
+        } else if (c == '}' || c == ']') {
+            if (--m_depth == 0) submitRecord();
+        }
+    }
+}
+
+bool BatchIngest::ready() {
+    return drain(false);
+}
+
+bool BatchIngest::drain(bool wait) {
+    while (!m_waiting.empty()) {
+        if (wait) {
+            m_last_seq = m_pipeline->submit(std::move(m_waiting.front()));
+        } else if (!m_pipeline->trySubmit(m_waiting.front(), m_last_seq)) {
+            return false;
+        }
+        m_waiting.pop_front();
+        m_accepted++;
+    }
+    return true;
+}
+
+void BatchIngest::finish() {
+    drain(true);
+    if (m_depth > 0 || m_garbage) m_rejected++;
+    m_depth = 0;
+    m_garbage = false;
+    m_in_string = m_escape = false;
+    m_record.clear();
+}
+
+void BatchIngest::submitRecord() {
+    IngestMetrics& metrics = ingest_metrics();
+
+    if (m_oversized) {
+        m_rejected++;
+        metrics.errors++;
+        m_oversized = false;
+        return;
+    }
+
+    metrics.messages++;
+    metrics.bytes += m_record.size();
+
+    try {
+        json record;
+        bool has_data;
+        {
+            StageTimer timer(IngestStage::Parse);
+            has_data = parse_filtered(m_record, ingest_filter_snapshot(*m_shared), record);
+        }
+        if (has_data) {
+            std::string imei = record.value("imei", "");
+            m_devices[imei.empty() ? "unknown" : imei]++;
+            // Порядок записей сохраняется: пока есть отложенные, новая встаёт за ними
+            m_waiting.push_back(std::move(record));
+            drain(false);
+        } else {
+            m_filtered++;
+        }
+    } catch (const std::exception& e) {
+        LOG_WARN_RL("http", 10, "Batch ingest record rejected: " << e.what());
+        metrics.errors++;
+        m_rejected++;
+    }
+    m_record.clear();
+}
@@ -0,0 +1,93 @@
+#include "compression.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <zlib.h>
+
+const char* encoding_name(ContentEncoding encoding) {
+    switch (encoding) {
+        case ContentEncoding::Gzip: return "gzip";
+        case ContentEncoding::Deflate: return "deflate";
+        default: return "identity";
+    }
+}
+
+// Явно названное кодирование важнее "*": "gzip;q=0, *" — gzip отвергнут
+ContentEncoding choose_encoding(const std::string& accept_encoding) {
+    double gzip = -1, deflate = -1, any = -1;   // q; -1 — не названо
+
+    size_t pos = 0;
+    while (pos < accept_encoding.size()) {
+        size_t comma = accept_encoding.find(',', pos);
+        if (comma == std::string::npos) comma = accept_encoding.size();
+        std::string item = accept_encoding.substr(pos, comma - pos);
+        pos = comma + 1;
+
+        std::string name;
+        double q = 1.0;
+        size_t semi = item.find(';');
+        for (size_t i = 0; i < std::min(semi, item.size()); i++) {
+            if (!isspace((unsigned char)item[i])) name += (char)tolower((unsigned char)item[i]);
+        }
+        if (semi != std::string::npos) {
+            size_t qpos = item.find("q=", semi);
+            if (qpos != std::string::npos) q = atof(item.c_str() + qpos + 2);
+        }
+        q = std::max(q, 0.0);
+
+        if (name == "gzip" || name == "x-gzip") gzip = std::max(gzip, q);
+        else if (name == "deflate") deflate = std::max(deflate, q);
+        else if (name == "*") any = std::max(any, q);
+    }
+
+    auto accepted = [any](double q) { return q >= 0 ? q > 0 : any > 0; };
+    if (accepted(gzip)) return ContentEncoding::Gzip;
+    if (accepted(deflate)) return ContentEncoding::Deflate;
+    return ContentEncoding::Identity;
+}
+
+bool compressible_type(const std::string& content_type) {
+    return content_type.compare(0, 5, "text/") == 0 ||
+           content_type.find("json") != std::string::npos ||
+           content_type.find("javascript") != std::string::npos ||
+           content_type.find("xml") != std::string::npos ||
+           content_type.find("vnd.heapmap") != std::string::npos ||
+           content_type.find("vector-tile") != std::string::npos;
+}
+
+bool compress_body(const char* data, size_t size, ContentEncoding encoding, int level, std::string& out) {
+    if (encoding == ContentEncoding::Identity) return false;
+
+    z_stream zs{};
+    int window = encoding == ContentEncoding::Gzip ? 15 + 16 : 15;
+    if (deflateInit2(&zs, std::clamp(level, 1, 9), Z_DEFLATED, window, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+
+    out.resize(deflateBound(&zs, size));
+    zs.next_in = (Bytef*)data;
+    zs.avail_in = (uInt)size;
+    zs.next_out = (Bytef*)&out[0];
+    zs.avail_out = (uInt)out.size();
+
+    int rc = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+
+    http_metrics().compressions++;
+    return rc == Z_STREAM_END;
+}
+
+const std::string* CompressedVariants::get(ContentEncoding encoding, int level,
+                                           const std::function<std::string()>& source) const {
+    if (encoding == ContentEncoding::Identity) return nullptr;
+    Variant& v = m_variants[encoding == ContentEncoding::Gzip ? 0 : 1];
+
+    std::call_once(v.once, [&] {
+        std::string raw = source();
+        v.useful = compress_body(raw.data(), raw.size(), encoding, level, v.data) && v.data.size() < raw.size();
+        if (!v.useful) std::string().swap(v.data);
+    });
+    return v.useful ? &v.data : nullptr;
+}
@@ -1,5 +1,6 @@
 #include "db_client.hpp"
-#include <iostream>
+#include "trace.hpp"
+#include "logger.hpp"
 #include <fstream>
 #include <filesystem>
 #include <regex>
@@ -11,10 +12,10 @@ DBClient::DBClient(const std::string& conn_string) {
     try {
         m_conn = std::make_unique<pqxx::connection>(conn_string);
         if (m_conn->is_open()) {
-            std::cout << "Connected to PostgreSQL: " << m_conn->dbname() << std::endl;
+            LOG_INFO("db", "Connected to PostgreSQL: " << m_conn->dbname());
         }
     } catch (const std::exception& e) {
-        std::cerr << "DB connection error: " << e.what() << std::endl;
+        LOG_ERROR("db", "DB connection error: " << e.what());
     }
 }
 
@@ -86,15 +87,18 @@ bool DBClient::initializeSchema() {
         txn.exec("CREATE INDEX IF NOT EXISTS idx_cells_signal ON cells(dbm, rsrp);");
         txn.exec("CREATE INDEX IF NOT EXISTS idx_cells_pci ON cells(pci);");
         txn.exec("CREATE INDEX IF NOT EXISTS idx_measurements_timestamp ON measurements(timestamp);");
+        // Продолжение выборки по ключу (timestamp, id), в том числе для одного устройства
+        txn.exec("CREATE INDEX IF NOT EXISTS idx_measurements_timestamp_id ON measurements(timestamp, id);");
+        txn.exec("CREATE INDEX IF NOT EXISTS idx_measurements_imei_timestamp ON measurements(imei, timestamp, id);");
         txn.exec("CREATE INDEX IF NOT EXISTS idx_locations_measurement ON locations(measurement_id);");
         txn.exec("CREATE INDEX IF NOT EXISTS idx_cells_measurement ON cells(measurement_id);");
         
         txn.commit();
-        std::cout << "Database schema initialized" << std::endl;
+        LOG_INFO("db", "Database schema initialized");
         return true;
         
     } catch (const std::exception& e) {
-        std::cerr << "Schema initialization error: " << e.what() << std::endl;
+        LOG_ERROR("db", "Schema initialization error: " << e.what());
         return false;
     }
 }
@@ -192,6 +196,7 @@ std::vector<json> DBClient::parseCellInfo(const std::string& cell_info_str) {
 }
 
 long long DBClient::insertMeasurement(long long timestamp, const std::string& imei) {
+    TRACE_SPAN("db.insertMeasurement", "db");
     pqxx::work txn(*m_conn);
     pqxx::result res = txn.exec_params(
         "INSERT INTO measurements (timestamp, imei) VALUES ($1, $2) RETURNING id",
@@ -202,13 +207,14 @@ long long DBClient::insertMeasurement(long long timestamp, const std::string& im
     return id;
 }
 
-void DBClient::insertLocation(long long measurement_id, const json& loc) {
-    if (!loc.contains("latitude") || loc["latitude"].is_null()) return;
+long long DBClient::insertLocation(long long measurement_id, const json& loc) {
+    TRACE_SPAN("db.insertLocation", "db");
+    if (!loc.contains("latitude") || loc["latitude"].is_null()) return 0;
     
     pqxx::work txn(*m_conn);
-    txn.exec_params(
+    pqxx::result res = txn.exec_params(
         "INSERT INTO locations (measurement_id, latitude, longitude, altitude, accuracy, speed) "
-        "VALUES ($1, $2, $3, $4, $5, $6)",
+        "VALUES ($1, $2, $3, $4, $5, $6) RETURNING id",
         measurement_id,
         loc.value("latitude", 0.0),
         loc.value("longitude", 0.0),
@@ -216,10 +222,13 @@ void DBClient::insertLocation(long long measurement_id, const json& loc) {
         loc.value("accuracy", 0.0f),
         loc.value("speed", 0.0f)
     );
+    long long id = res[0][0].as<long long>();
     txn.commit();
+    return id;
 }
 
 void DBClient::insertCells(long long measurement_id, const std::vector<json>& cells) {
+    TRACE_SPAN("db.insertCells", "db");
     if (cells.empty()) return;
     
     pqxx::work txn(*m_conn);
@@ -243,6 +252,7 @@ void DBClient::insertCells(long long measurement_id, const std::vector<json>& ce
 }
 
 void DBClient::insertTraffic(long long measurement_id, const json& traffic) {
+    TRACE_SPAN("db.insertTraffic", "db");
     if (traffic.empty()) return;
     
     pqxx::work txn(*m_conn);
@@ -258,14 +268,15 @@ void DBClient::insertTraffic(long long measurement_id, const json& traffic) {
     txn.commit();
 }
 
-bool DBClient::importJsonData(const json& data) {
+bool DBClient::importJsonData(const json& data, std::vector<StoredPoint>* stored) {
+    TRACE_SPAN("db.importJsonData", "db");
     if (!isConnected()) return false;
     
     try {
         // Если data - массив, импортируем каждый элемент
         if (data.is_array()) {
             for (const auto& item : data) {
-                importJsonData(item);
+                importJsonData(item, stored);
             }
             return true;
         }
@@ -277,18 +288,22 @@ bool DBClient::importJsonData(const json& data) {
         long long measurement_id = insertMeasurement(timestamp, imei);
         
         // Location
+        const json* location = nullptr;
+        json alt_loc;
+        long long location_id = 0;
         if (data.contains("location") && data["location"].is_object()) {
-            insertLocation(measurement_id, data["location"]);
+            location = &data["location"];
+            location_id = insertLocation(measurement_id, *location);
         } else {
             // Альтернативный формат (поля прямо в корне)
-            json alt_loc;
             if (data.contains("latitude")) alt_loc["latitude"] = data["latitude"];
             if (data.contains("longitude")) alt_loc["longitude"] = data["longitude"];
             if (data.contains("altitude")) alt_loc["altitude"] = data["altitude"];
             if (data.contains("accuracy")) alt_loc["accuracy"] = data["accuracy"];
             if (data.contains("speed")) alt_loc["speed"] = data["speed"];
             if (!alt_loc.empty()) {
-                insertLocation(measurement_id, alt_loc);
+                location = &alt_loc;
+                location_id = insertLocation(measurement_id, alt_loc);
             }
         }
         
@@ -323,6 +338,21 @@ bool DBClient::importJsonData(const json& data) {
         
         insertCells(measurement_id, all_cells);
         
+        // Те же строки, что даст streamPoints: точка на соту (сигнал — как сохранён), без сот — одна
+        if (stored && location_id) {
+            StoredPoint row{location_id, MapPoint{}};
+            row.point.lat = location->value("latitude", 0.0);
+            row.point.lon = location->value("longitude", 0.0);
+            row.point.timestamp = timestamp;
+            row.point.signal_strength = -120;
+            row.point.type = "GPS";
+            if (all_cells.empty()) stored->push_back(row);
+            for (const auto& cell : all_cells) {
+                row.point.signal_strength = cell.value("rsrp", -120);
+                stored->push_back(row);
+            }
+        }
+        
         // Traffic
         if (data.contains("traffic") && data["traffic"].is_object()) {
             insertTraffic(measurement_id, data["traffic"]);
@@ -331,20 +361,21 @@ bool DBClient::importJsonData(const json& data) {
         return true;
         
     } catch (const std::exception& e) {
-        std::cerr << "Error importing JSON data: " << e.what() << std::endl;
+        LOG_ERROR("db", "Error importing JSON data: " << e.what());
         return false;
     }
 }
 
 bool DBClient::importJsonFile(const std::string& json_path) {
+    TRACE_SPAN("db.importJsonFile", "db");
     if (!isConnected()) return false;
     
-    std::cout << "Importing: " << json_path << std::endl;
+    LOG_INFO("db", "Importing: " << json_path);
     
     try {
         std::ifstream file(json_path);
         if (!file.is_open()) {
-            std::cerr << "Cannot open file: " << json_path << std::endl;
+            LOG_ERROR("db", "Cannot open file: " << json_path);
             return false;
         }
         
@@ -354,12 +385,12 @@ bool DBClient::importJsonFile(const std::string& json_path) {
         
         bool result = importJsonData(data);
         if (result) {
-            std::cout << "Successfully imported: " << json_path << std::endl;
+            LOG_INFO("db", "Successfully imported: " << json_path);
         }
         return result;
         
     } catch (const std::exception& e) {
-        std::cerr << "Error reading JSON file " << json_path << ": " << e.what() << std::endl;
+        LOG_ERROR("db", "Error reading JSON file " << json_path << ": " << e.what());
         return false;
     }
 }
@@ -374,7 +405,7 @@ std::vector<std::string> DBClient::findJsonFiles(const std::string& directory) {
             }
         }
     } catch (const std::exception& e) {
-        std::cerr << "Error scanning directory: " << e.what() << std::endl;
+        LOG_ERROR("db", "Error scanning directory: " << e.what());
     }
     
     return json_files;
@@ -386,11 +417,11 @@ bool DBClient::importJsonDirectory(const std::string& directory_path) {
     auto json_files = findJsonFiles(directory_path);
     
     if (json_files.empty()) {
-        std::cout << "No JSON files found in: " << directory_path << std::endl;
+        LOG_INFO("db", "No JSON files found in: " << directory_path);
         return false;
     }
     
-    std::cout << "Found " << json_files.size() << " JSON files" << std::endl;
+    LOG_INFO("db", "Found " << json_files.size() << " JSON files");
     
     int success_count = 0;
     for (const auto& file : json_files) {
@@ -399,12 +430,13 @@ bool DBClient::importJsonDirectory(const std::string& directory_path) {
         }
     }
     
-    std::cout << "Imported " << success_count << "/" << json_files.size() << " files" << std::endl;
+    LOG_INFO("db", "Imported " << success_count << "/" << json_files.size() << " files");
     return success_count > 0;
 }
 
 // Загрузка данных для GUI
 std::vector<MapPoint> DBClient::loadPoints(int limit) {
+    TRACE_SPAN("db.loadPoints", "db");
     std::vector<MapPoint> points;
     if (!isConnected()) return points;
     
@@ -429,15 +461,147 @@ std::vector<MapPoint> DBClient::loadPoints(int limit) {
             points.push_back(p);
         }
         txn.commit();
-        std::cout << "Loaded " << points.size() << " points from database" << std::endl;
+        LOG_DEBUG("db", "Loaded " << points.size() << " points from database");
     } catch (const std::exception& e) {
-        std::cerr << "DB error (loadPoints): " << e.what() << std::endl;
+        LOG_ERROR("db", "DB error (loadPoints): " << e.what());
     }
     return points;
 }
 
+bool DBClient::streamPoints(long long limit, const std::function<bool(const MapPoint&)>& callback,
+                            long long* max_id) {
+    TRACE_SPAN("db.streamPoints", "db");
+    if (!isConnected()) return false;
+    if (max_id) *max_id = 0;
+
+    std::string query =
+        "SELECT l.latitude, l.longitude, COALESCE(m.timestamp, 0), COALESCE(c.rsrp, c.dbm, -120), l.id "
+        "FROM locations l "
+        "JOIN measurements m ON l.measurement_id = m.id "
+        "LEFT JOIN cells c ON m.id = c.measurement_id "
+        "WHERE l.latitude IS NOT NULL AND l.longitude IS NOT NULL "
+        "ORDER BY l.id DESC";
+    if (limit > 0) query += " LIMIT " + std::to_string(limit);
+
+    bool stopped = false;
+    try {
+        pqxx::work txn(*m_conn);
+        auto stream = pqxx::stream_from::query(txn, query);
+
+        MapPoint p;
+        p.type = "GPS";
+        long long rows = 0;
+        for (auto [lat, lon, timestamp, signal, id] : stream.iter<double, double, long long, int, long long>()) {
+            // Строки по убыванию id: первая — самая новая
+            if (max_id && !rows) *max_id = id;
+            p.lat = lat;
+            p.lon = lon;
+            p.timestamp = timestamp;
+            p.signal_strength = signal;
+            rows++;
+            if (!callback(p)) {
+                stopped = true;
+                break;
+            }
+        }
+
+        if (stopped) {
+            // Остаток COPY дочитывать незачем: отменяем запрос, транзакция откатится
+            m_conn->cancel_query();
+            LOG_DEBUG("db", "Point stream stopped by consumer after " << rows << " rows");
+            return true;
+        }
+        stream.complete();
+        txn.commit();
+        LOG_DEBUG("db", "Streamed " << rows << " points from database");
+        return true;
+    } catch (const std::exception& e) {
+        if (stopped) return true;
+        LOG_ERROR("db", "DB error (streamPoints): " << e.what());
+        return false;
+    }
+}
+
+bool DBClient::streamRange(const RangeQuery& q, const std::function<bool(const RangePoint&)>& callback) {
+    TRACE_SPAN("db.streamRange", "db");
+    if (!isConnected()) return false;
+
+    bool stopped = false;
+    try {
+        pqxx::work txn(*m_conn);
+
+        // Сота — самая сильная из подходящих по типу; без фильтра по типу измерение без сот тоже попадает
+        std::string cell_filter;
+        if (!q.types.empty()) {
+            cell_filter = " AND type IN (";
+            for (size_t i = 0; i < q.types.size(); i++) {
+                if (i) cell_filter += ", ";
+                cell_filter += txn.quote(q.types[i]);
+            }
+            cell_filter += ")";
+        }
+
+        std::string query =
+            "SELECT m.id, m.timestamp, COALESCE(m.imei, ''), l.latitude, l.longitude, "
+            "COALESCE(c.type, ''), COALESCE(c.signal, -120) "
+            "FROM measurements m "
+            "JOIN locations l ON l.measurement_id = m.id " +
+            std::string(q.types.empty() ? "LEFT JOIN" : "JOIN") +
+            " LATERAL (SELECT type, COALESCE(rsrp, dbm) AS signal FROM cells "
+            "WHERE measurement_id = m.id" + cell_filter +
+            " ORDER BY signal DESC NULLS LAST LIMIT 1) c ON true "
+            "WHERE m.timestamp >= " + txn.quote(q.from) +
+            " AND l.latitude IS NOT NULL AND l.longitude IS NOT NULL";
+        if (q.to > 0) query += " AND m.timestamp < " + txn.quote(q.to);
+        if (!q.imei.empty()) query += " AND m.imei = " + txn.quote(q.imei);
+        if (q.has_bbox) {
+            query += " AND l.latitude BETWEEN " + txn.quote(q.min_lat) + " AND " + txn.quote(q.max_lat) +
+                     " AND l.longitude BETWEEN " + txn.quote(q.min_lon) + " AND " + txn.quote(q.max_lon);
+        }
+        if (q.has_after) {
+            query += " AND (m.timestamp, m.id) > (" + txn.quote(q.after_timestamp) + ", " + txn.quote(q.after_id) + ")";
+        }
+        query += " ORDER BY m.timestamp, m.id LIMIT " + std::to_string(q.limit);
+
+        auto stream = pqxx::stream_from::query(txn, query);
+
+        RangePoint p;
+        long long rows = 0;
+        for (auto [id, timestamp, imei, lat, lon, type, signal] :
+             stream.iter<long long, long long, std::string_view, double, double, std::string_view, int>()) {
+            p.id = id;
+            p.timestamp = timestamp;
+            p.imei.assign(imei);
+            p.lat = lat;
+            p.lon = lon;
+            p.type.assign(type);
+            p.signal_strength = signal;
+            rows++;
+            if (!callback(p)) {
+                stopped = true;
+                break;
+            }
+        }
+
+        if (stopped) {
+            m_conn->cancel_query();
+            LOG_DEBUG("db", "Range stream stopped by consumer after " << rows << " rows");
+            return true;
+        }
+        stream.complete();
+        txn.commit();
+        LOG_DEBUG("db", "Streamed " << rows << " range rows");
+        return true;
+    } catch (const std::exception& e) {
+        if (stopped) return true;
+        LOG_ERROR("db", "DB error (streamRange): " << e.what());
+        return false;
+    }
+}
+
 std::vector<MapPoint> DBClient::loadPointsInArea(double min_lat, double max_lat, 
                                                   double min_lon, double max_lon, int limit) {
+    TRACE_SPAN("db.loadPointsInArea", "db");
     std::vector<MapPoint> points;
     if (!isConnected()) return points;
     
@@ -465,12 +629,13 @@ std::vector<MapPoint> DBClient::loadPointsInArea(double min_lat, double max_lat,
         }
         txn.commit();
     } catch (const std::exception& e) {
-        std::cerr << "DB error (loadPointsInArea): " << e.what() << std::endl;
+        LOG_ERROR("db", "DB error (loadPointsInArea): " << e.what());
     }
     return points;
 }
 
 std::vector<CellData> DBClient::loadCells(int limit) {
+    TRACE_SPAN("db.loadCells", "db");
     std::vector<CellData> cells;
     if (!isConnected()) return cells;
     
@@ -501,12 +666,13 @@ std::vector<CellData> DBClient::loadCells(int limit) {
         }
         txn.commit();
     } catch (const std::exception& e) {
-        std::cerr << "DB error (loadCells): " << e.what() << std::endl;
+        LOG_ERROR("db", "DB error (loadCells): " << e.what());
     }
     return cells;
 }
 
 std::vector<TrafficData> DBClient::loadTraffic(int limit) {
+    TRACE_SPAN("db.loadTraffic", "db");
     std::vector<TrafficData> traffic;
     if (!isConnected()) return traffic;
     
@@ -530,12 +696,13 @@ std::vector<TrafficData> DBClient::loadTraffic(int limit) {
         }
         txn.commit();
     } catch (const std::exception& e) {
-        std::cerr << "DB error (loadTraffic): " << e.what() << std::endl;
+        LOG_ERROR("db", "DB error (loadTraffic): " << e.what());
     }
     return traffic;
 }
 
 std::vector<LocationData> DBClient::loadLocations(int limit) {
+    TRACE_SPAN("db.loadLocations", "db");
     std::vector<LocationData> locations;
     if (!isConnected()) return locations;
     
@@ -562,12 +729,13 @@ std::vector<LocationData> DBClient::loadLocations(int limit) {
         }
         txn.commit();
     } catch (const std::exception& e) {
-        std::cerr << "DB error (loadLocations): " << e.what() << std::endl;
+        LOG_ERROR("db", "DB error (loadLocations): " << e.what());
     }
     return locations;
 }
 
 int DBClient::getMeasurementCount() {
+    TRACE_SPAN("db.getMeasurementCount", "db");
     if (!isConnected()) return 0;
     try {
         pqxx::work txn(*m_conn);
@@ -581,6 +749,7 @@ int DBClient::getMeasurementCount() {
 }
 
 int DBClient::getCellCount() {
+    TRACE_SPAN("db.getCellCount", "db");
     if (!isConnected()) return 0;
     try {
         pqxx::work txn(*m_conn);
@@ -594,6 +763,7 @@ int DBClient::getCellCount() {
 }
 
 int DBClient::getLocationCount() {
+    TRACE_SPAN("db.getLocationCount", "db");
     if (!isConnected()) return 0;
     try {
         pqxx::work txn(*m_conn);
@@ -607,6 +777,7 @@ int DBClient::getLocationCount() {
 }
 
 int DBClient::getTrafficCount() {
+    TRACE_SPAN("db.getTrafficCount", "db");
     if (!isConnected()) return 0;
     try {
         pqxx::work txn(*m_conn);
@@ -625,10 +796,10 @@ bool DBClient::clearAllData() {
         pqxx::work txn(*m_conn);
         txn.exec("TRUNCATE TABLE traffic, cells, locations, measurements RESTART IDENTITY CASCADE");
         txn.commit();
-        std::cout << "All data cleared" << std::endl;
+        LOG_INFO("db", "All data cleared");
         return true;
     } catch (const std::exception& e) {
-        std::cerr << "Error clearing data: " << e.what() << std::endl;
+        LOG_ERROR("db", "Error clearing data: " << e.what());
         return false;
     }
 }
@@ -644,15 +815,16 @@ bool DBClient::clearOldData(int days_to_keep) {
             cutoff_time
         );
         txn.commit();
-        std::cout << "Cleared data older than " << days_to_keep << " days" << std::endl;
+        LOG_INFO("db", "Cleared data older than " << days_to_keep << " days");
         return true;
     } catch (const std::exception& e) {
-        std::cerr << "Error clearing old data: " << e.what() << std::endl;
+        LOG_ERROR("db", "Error clearing old data: " << e.what());
         return false;
     }
 }
 
 std::vector<CellData> DBClient::loadCellsByPci(int pci, int limit) {
+    TRACE_SPAN("db.loadCellsByPci", "db");
     std::vector<CellData> cells;
     if (!isConnected()) return cells;
     
@@ -684,7 +856,7 @@ std::vector<CellData> DBClient::loadCellsByPci(int pci, int limit) {
         }
         txn.commit();
     } catch (const std::exception& e) {
-        std::cerr << "DB error (loadCellsByPci): " << e.what() << std::endl;
+        LOG_ERROR("db", "DB error (loadCellsByPci): " << e.what());
     }
     return cells;
 }
\ No newline at end of file
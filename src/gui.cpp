@@ -1,11 +1,13 @@
 #include "server.hpp"
 #include "heatmap.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "logger.hpp"
 #include "../third-party/imgui/imgui.h"
 #include "../third-party/imgui/backends/imgui_impl_glfw.h"
 #include "../third-party/imgui/backends/imgui_impl_opengl3.h"
 #include "../third-party/implot/implot.h"
 #include <GLFW/glfw3.h>
-#include <iostream>
 #include <fstream>
 #include <vector>
 #include <string>
@@ -15,6 +17,9 @@
 #include <nlohmann/json.hpp>
 #include <zmq.hpp>
 #include <cmath>
+#include <memory>
+#include <thread>
+#include <chrono>
 #include <pqxx/pqxx>
 
 using namespace std;
@@ -192,9 +197,9 @@ void load_points_from_db(vector<MapPoint>& points, pqxx::connection& db_conn) {
             points.push_back(p);
         }
         txn.commit();
-        cout << "Loaded " << points.size() << " points from database" << endl;
+        LOG_DEBUG("gui", "Loaded " << points.size() << " points from database");
     } catch (const exception& e) {
-        cerr << "DB error: " << e.what() << endl;
+        LOG_ERROR("gui", "DB error: " << e.what());
     }
 }
 
@@ -217,9 +222,9 @@ void load_signal_history_from_db(SignalHistory& sig, pqxx::connection& db_conn)
             sig.add_sample();
         }
         txn.commit();
-        cout << "Loaded " << sig.rsrp.size() << " cells, " << sig.sample_count << " samples" << endl;
+        LOG_INFO("gui", "Loaded " << sig.rsrp.size() << " cells, " << sig.sample_count << " samples");
     } catch (const exception& e) {
-        cerr << "Error loading signal: " << e.what() << endl;
+        LOG_ERROR("gui", "Error loading signal: " << e.what());
     }
 }
 
@@ -237,9 +242,9 @@ void load_traffic_from_db(TrafficHistory& traffic, pqxx::connection& db_conn) {
             traffic.add(rx, tx);
         }
         txn.commit();
-        cout << "Loaded " << traffic.sample_count << " traffic samples" << endl;
+        LOG_INFO("gui", "Loaded " << traffic.sample_count << " traffic samples");
     } catch (const exception& e) {
-        cerr << "Error loading traffic: " << e.what() << endl;
+        LOG_ERROR("gui", "Error loading traffic: " << e.what());
     }
 }
 
@@ -260,9 +265,9 @@ void load_locations_from_db(LocationHistory& loc, pqxx::connection& db_conn) {
             loc.add(lat, lon, alt, acc);
         }
         txn.commit();
-        cout << "Loaded " << loc.sample_count << " location samples" << endl;
+        LOG_INFO("gui", "Loaded " << loc.sample_count << " location samples");
     } catch (const exception& e) {
-        cerr << "Error loading locations: " << e.what() << endl;
+        LOG_ERROR("gui", "Error loading locations: " << e.what());
     }
 }
 
@@ -307,6 +312,51 @@ void update_location_from_record(LocationHistory& loc, const json& record) {
     }
 }
 
+void draw_performance_tab(SharedData* shared) {
+    // Отдельный процесс GUI ничего не принимает — его счётчики всегда нулевые
+    if (shared->remote_gui) {
+        static const string host = shared->server_host.empty() ? get_local_ip() : shared->server_host;
+        ImGui::TextWrapped("Attached to a remote server (--gui-only): ingest counters live in the server process.");
+        ImGui::TextWrapped("See http://%s:8081/api/metrics", host.c_str());
+        return;
+    }
+    
+    IngestMetrics& m = ingest_metrics();
+    
+    ImGui::Text("Messages: %llu | Bytes: %s | Errors: %llu | Queue depth: %lld",
+        (unsigned long long)m.messages.load(), formatBytes(m.bytes.load()).c_str(),
+        (unsigned long long)m.errors.load(), (long long)m.queue_depth.load());
+    ImGui::Separator();
+    
+    if (ImGui::BeginTable("stages", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Stage");
+        ImGui::TableSetupColumn("Count");
+        ImGui::TableSetupColumn("p50, us");
+        ImGui::TableSetupColumn("p90, us");
+        ImGui::TableSetupColumn("p99, us");
+        ImGui::TableSetupColumn("max, us");
+        ImGui::TableHeadersRow();
+        
+        for (int s = 0; s < (int)IngestStage::Count; s++) {
+            const LatencyHistogram& h = m.stages[s];
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn(); ImGui::Text("%s", stage_name((IngestStage)s));
+            ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)h.count());
+            ImGui::TableNextColumn(); ImGui::Text("%.1f", h.percentile(0.50) / 1000.0);
+            ImGui::TableNextColumn(); ImGui::Text("%.1f", h.percentile(0.90) / 1000.0);
+            ImGui::TableNextColumn(); ImGui::Text("%.1f", h.percentile(0.99) / 1000.0);
+            ImGui::TableNextColumn(); ImGui::Text("%.1f", h.max() / 1000.0);
+        }
+        ImGui::EndTable();
+    }
+}
+
+// Checkbox работает с bool: флаг читают потоки приёма, поэтому через копию
+static void filter_checkbox(const char* label, std::atomic<bool>& flag) {
+    bool value = flag;
+    if (ImGui::Checkbox(label, &value)) flag = value;
+}
+
 void send_filter_command(SharedData* shared, const string& filter_name, bool value) {
     if (!g_command_socket) return;
     try {
@@ -318,11 +368,101 @@ void send_filter_command(SharedData* shared, const string& filter_name, bool val
     } catch (...) {}
 }
 
+static void push_remote_records(SharedData* shared, vector<json>& records) {
+    if (records.empty()) return;
+    lock_guard<mutex> lock(shared->data_mutex);
+    for (auto& record : records) {
+        shared->recent_records.push_back(std::move(record));
+        if ((int)shared->recent_records.size() > shared->max_history) {
+            shared->recent_records.pop_front();
+        }
+    }
+    shared->counter += (int)records.size();
+    records.clear();
+}
+
+// GUI в отдельном процессе: история — запросом "since", дальше — подписка на PUB-рассылку сервера
+void run_remote_feed(SharedData* shared) {
+    string host = shared->server_host.empty() ? get_local_ip() : shared->server_host;
+    
+    zmq::context_t context(1);
+    zmq::socket_t sub(context, zmq::socket_type::sub);
+    sub.set(zmq::sockopt::rcvtimeo, 200);
+    sub.set(zmq::sockopt::linger, 0);
+    sub.set(zmq::sockopt::subscribe, "");
+    sub.connect("tcp://" + host + ":8082");
+    
+    long long last_seq = 0;
+    vector<json> batch;
+    try {
+        zmq::socket_t req(context, zmq::socket_type::req);
+        req.set(zmq::sockopt::rcvtimeo, 2000);
+        req.set(zmq::sockopt::linger, 0);
+        req.connect("tcp://" + host + ":8080");
+        
+        json cmd = {{"type", "since"}, {"counter", 0}};
+        req.send(zmq::buffer(cmd.dump()), zmq::send_flags::none);
+        zmq::message_t reply;
+        if (req.recv(reply, zmq::recv_flags::none)) {
+            json data = json::parse(string(static_cast<char*>(reply.data()), reply.size()));
+            last_seq = data.value("counter", 0LL);
+            for (auto& record : data["records"]) batch.push_back(std::move(record));
+            push_remote_records(shared, batch);
+        }
+    } catch (const exception& e) {
+        LOG_WARN("gui", "Cannot fetch history from server: " << e.what());
+    }
+    LOG_INFO("gui", "Attached to server " << host << ", live feed on port 8082");
+    
+    // Секции одной записи приходят подряд с одинаковым seq — собираем их обратно
+    json pending;
+    long long pending_seq = 0;
+    auto flush_pending = [&]() {
+        if (pending_seq == 0) return;
+        if (pending_seq > last_seq + 1 && last_seq > 0) {
+            LOG_WARN_RL("gui", 1, "Live feed gap: " << pending_seq - last_seq - 1 << " records missed");
+        }
+        last_seq = pending_seq;
+        batch.push_back(std::move(pending));
+        pending = json();
+        pending_seq = 0;
+        push_remote_records(shared, batch);
+    };
+    
+    while (!shutdown_requested()) {
+        zmq::message_t topic, payload;
+        try {
+            if (!sub.recv(topic, zmq::recv_flags::none)) {
+                flush_pending();
+                continue;
+            }
+            if (!topic.more() || !sub.recv(payload, zmq::recv_flags::none)) continue;
+            
+            json body = json::from_msgpack(static_cast<const uint8_t*>(payload.data()),
+                                           static_cast<const uint8_t*>(payload.data()) + payload.size());
+            long long seq = body.value("seq", 0LL);
+            if (seq <= last_seq) continue; // уже получено с историей
+            
+            if (seq != pending_seq) {
+                flush_pending();
+                pending = body.contains("record") ? body["record"] : json::object();
+                pending_seq = seq;
+            }
+            body.erase("seq");
+            body.erase("record");
+            pending.update(body);
+        } catch (const exception& e) {
+            LOG_WARN_RL("gui", 1, "Live feed error: " << e.what());
+        }
+    }
+}
+
 void run_gui(SharedData* shared) {
-    cout << "Initializing GUI..." << endl;
+    trace_set_thread_name("gui");
+    LOG_INFO("gui", "Initializing GUI...");
     
     if (!glfwInit()) {
-        cerr << "GLFW init failed" << endl;
+        LOG_ERROR("gui", "GLFW init failed");
         return;
     }
     
@@ -354,19 +494,19 @@ void run_gui(SharedData* shared) {
     g_command_socket->set(zmq::sockopt::rcvtimeo, 1000);
     g_command_socket->set(zmq::sockopt::sndtimeo, 1000);
     
-    string server_ip = get_local_ip();
+    string server_ip = shared->server_host.empty() ? get_local_ip() : shared->server_host;
     try {
         g_command_socket->connect("tcp://" + server_ip + ":8080");
-        cout << "Connected to ZMQ server" << endl;
+        LOG_INFO("gui", "Connected to ZMQ server");
     } catch (...) {
-        cerr << "Failed to connect to ZMQ server" << endl;
+        LOG_ERROR("gui", "Failed to connect to ZMQ server");
     }
     
     pqxx::connection db_conn("dbname=cellmap user=postgres password=postgres host=localhost port=5434");
     if (!db_conn.is_open()) {
-        cerr << "Failed to connect to PostgreSQL" << endl;
+        LOG_ERROR("gui", "Failed to connect to PostgreSQL");
     } else {
-        cout << "Connected to PostgreSQL" << endl;
+        LOG_INFO("gui", "Connected to PostgreSQL");
         load_points_from_db(map_points, db_conn);
         update_map_points(map_points);
     }
@@ -393,7 +533,8 @@ void run_gui(SharedData* shared) {
     int minimap_point_size = 5;
     int current_signal_graph = 0;
     
-    while (!glfwWindowShouldClose(window)) {
+    while (!glfwWindowShouldClose(window) && !shutdown_requested()) {
+        TRACE_SPAN("gui.frame", "gui");
         glfwPollEvents();
         
         if (shared->counter != last_count) {
@@ -676,13 +817,13 @@ void run_gui(SharedData* shared) {
             }
             
             if (ImGui::BeginTabItem("Filters")) {
-                ImGui::Checkbox("Location", &shared->filter_location);
-                ImGui::Checkbox("Telephony", &shared->filter_telephony);
-                ImGui::Checkbox("Traffic", &shared->filter_traffic);
+                filter_checkbox("Location", shared->filter_location);
+                filter_checkbox("Telephony", shared->filter_telephony);
+                filter_checkbox("Traffic", shared->filter_traffic);
                 ImGui::Separator();
-                ImGui::Checkbox("LTE (4G)", &shared->filter_lte);
-                ImGui::Checkbox("GSM (2G)", &shared->filter_gsm);
-                ImGui::Checkbox("WCDMA (3G)", &shared->filter_wcdma);
+                filter_checkbox("LTE (4G)", shared->filter_lte);
+                filter_checkbox("GSM (2G)", shared->filter_gsm);
+                filter_checkbox("WCDMA (3G)", shared->filter_wcdma);
                 ImGui::Separator();
                 if (ImGui::Button("Enable All")) {
                     shared->filter_location = shared->filter_telephony = shared->filter_traffic = true;
@@ -705,6 +846,11 @@ void run_gui(SharedData* shared) {
                 ImGui::EndTabItem();
             }
             
+            if (ImGui::BeginTabItem("Performance")) {
+                draw_performance_tab(shared);
+                ImGui::EndTabItem();
+            }
+            
             ImGui::EndTabBar();
         }
         
@@ -727,4 +873,7 @@ void run_gui(SharedData* shared) {
     ImGui_ImplGlfw_Shutdown();
     glfwDestroyWindow(window);
     glfwTerminate();
+    
+    // Окно закрыто — останавливаем и серверную часть процесса
+    request_shutdown();
 }
\ No newline at end of file
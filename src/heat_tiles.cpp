@@ -0,0 +1,126 @@
+#include "heat_tiles.hpp"
+#include "png_writer.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Отдельные точки вместо ячеек, пока их в тайле с полями не больше этого
+static const size_t kMaxRawPoints = 250000;
+
+HeatTileRenderer::HeatTileRenderer(const Options& options) : m_options(options) {
+    m_radius = std::max(1, (int)std::ceil(options.sigma_px * 3));
+    m_kernel.resize(2 * m_radius + 1);
+    for (int d = -m_radius; d <= m_radius; d++) {
+        m_kernel[d + m_radius] = (float)std::exp(-d * d / (2 * options.sigma_px * options.sigma_px));
+    }
+}
+
+// Красный — слабый сигнал, зелёный — сильный
+static void signal_color(double dbm, uint8_t* rgb) {
+    const HeatColorStop* stops = kHeatColorStops;
+    const size_t n = sizeof(kHeatColorStops) / sizeof(kHeatColorStops[0]);
+    if (dbm <= stops[0].dbm) dbm = stops[0].dbm;
+    if (dbm >= stops[n - 1].dbm) dbm = stops[n - 1].dbm;
+
+    size_t i = 1;
+    while (i < n - 1 && dbm > stops[i].dbm) i++;
+    double t = (dbm - stops[i - 1].dbm) / (stops[i].dbm - stops[i - 1].dbm);
+    rgb[0] = (uint8_t)(stops[i - 1].r + t * (stops[i].r - stops[i - 1].r));
+    rgb[1] = (uint8_t)(stops[i - 1].g + t * (stops[i].g - stops[i - 1].g));
+    rgb[2] = (uint8_t)(stops[i - 1].b + t * (stops[i].b - stops[i - 1].b));
+}
+
+static uint32_t clamp_world(int64_t v) {
+    return (uint32_t)std::clamp<int64_t>(v, 0, 0xffffffffLL);
+}
+
+bool HeatTileRenderer::render(const PointIndex& index, int z, int x, int y, std::string& png) const {
+    std::vector<uint8_t> rgba;
+    return renderRgba(index, z, x, y, rgba) &&
+           encode_png_rgba(rgba.data(), kTileSize, kTileSize, m_options.png_level, png);
+}
+
+bool HeatTileRenderer::renderRgba(const PointIndex& index, int z, int x, int y, std::vector<uint8_t>& rgba) const {
+    if (z < 0 || z > kMaxZoom || x < 0 || y < 0 || x >= (1 << z) || y >= (1 << z)) return false;
+    TRACE_SPAN("heat.render", "heat");
+
+    // Пиксель тайла — 2^(24-z) единиц Mercator
+    const int px_shift = 24 - z;
+    const int64_t origin_x = (int64_t)x << (32 - z);
+    const int64_t origin_y = (int64_t)y << (32 - z);
+    const int64_t margin = (int64_t)m_radius << px_shift;
+    const int64_t tile_world = (int64_t)kTileSize << px_shift;
+
+    uint32_t wx0 = clamp_world(origin_x - margin), wx1 = clamp_world(origin_x + tile_world + margin - 1);
+    uint32_t wy0 = clamp_world(origin_y - margin), wy1 = clamp_world(origin_y + tile_world + margin - 1);
+
+    // Ячейка уровня z+6 — пиксель тайла. Глубже 16-го уровня ячейки крупнее пикселя,
+    // там берём сами точки, если их не слишком много
+    ClusterPlan plan = PointIndex::cover(z + 6, wx0, wy0, wx1, wy1);
+    if (z + 6 > PointIndex::kMaxClusterZoom) plan.raw = index.countPoints(plan) <= kMaxRawPoints;
+
+    std::vector<PointCluster> cells;
+    index.collect(plan, cells);
+
+    const int n = kTileSize;
+    const int side = 2 * m_radius + 1;
+    const float* kernel = m_kernel.data();
+    const double px_scale = 1.0 / (double)(1LL << px_shift);
+
+    // Сначала сводим точки в пиксели тайла с полями, потом размываем гауссом
+    // (по строкам, затем по столбцам): время не зависит от числа точек
+    const int padded = n + 2 * m_radius;
+    std::vector<float> bin_count(padded * padded, 0.0f), bin_signal(padded * padded, 0.0f);
+    for (const PointCluster& c : cells) {
+        int bx = (int)std::floor(((double)mercator_x(c.lon) - origin_x) * px_scale) + m_radius;
+        int by = (int)std::floor(((double)mercator_y(c.lat) - origin_y) * px_scale) + m_radius;
+        if (bx < 0 || bx >= padded || by < 0 || by >= padded) continue;
+        bin_count[by * padded + bx] += (float)c.count;
+        bin_signal[by * padded + bx] += (float)(c.count * c.signal);
+    }
+
+    std::vector<float> row_count(padded * n, 0.0f), row_signal(padded * n, 0.0f);
+    for (int by = 0; by < padded; by++) {
+        const float* bc = &bin_count[by * padded];
+        const float* bs = &bin_signal[by * padded];
+        float* rc = &row_count[by * n];
+        float* rs = &row_signal[by * n];
+        for (int bx = 0; bx < padded; bx++) {
+            if (bc[bx] == 0.0f) continue;
+            // Пиксель тайла px — это бин px + r; бин bx задевает px от bx - 2r до bx
+            int x0 = std::max(0, bx - 2 * m_radius), x1 = std::min(n - 1, bx);
+            for (int px = x0; px <= x1; px++) {
+                float k = kernel[bx - px];
+                rc[px] += k * bc[bx];
+                rs[px] += k * bs[bx];
+            }
+        }
+    }
+
+    std::vector<float> weight(n * n, 0.0f), signal(n * n, 0.0f);
+    for (int py = 0; py < n; py++) {
+        float* wr = &weight[py * n];
+        float* sr = &signal[py * n];
+        for (int k = 0; k < side; k++) {
+            const float* rc = &row_count[(py + k) * n];
+            const float* rs = &row_signal[(py + k) * n];
+            float g = kernel[k];
+            for (int px = 0; px < n; px++) {
+                wr[px] += g * rc[px];
+                sr[px] += g * rs[px];
+            }
+        }
+    }
+
+    // Прозрачность растёт с плотностью и упирается в 80%, чтобы подложка была видна
+    rgba.assign(n * n * 4, 0);
+    for (int i = 0; i < n * n; i++) {
+        if (weight[i] < 1e-3f) continue;
+        int alpha = (int)(204.0 * (1.0 - std::exp(-weight[i])));
+        if (alpha < 4) continue;
+        uint8_t* p = &rgba[i * 4];
+        signal_color(signal[i] / weight[i], p);
+        p[3] = (uint8_t)alpha;
+    }
+    return true;
+}
@@ -0,0 +1,295 @@
+#include "heatmap_jobs.hpp"
+#include "heat_tiles.hpp"
+#include "png_writer.hpp"
+#include "json_writer.hpp"
+#include "trace.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// Изображение не больше этого по длинной стороне (4096² RGBA — 64 МБ)
+static const int kMaxImageSize = 4096;
+// Поля вокруг данных, чтобы пятна по краям не обрезались: примерно 3σ размытия
+static const int kPadPixels = 18;
+// Картинку строят один раз и отдают много — сжимаем сильнее, чем тайлы на лету
+static const int kPngLevel = 6;
+
+HeatmapRenderPool::HeatmapRenderPool(int threads) {
+    int count = threads > 0 ? threads : std::max(1, (int)std::thread::hardware_concurrency());
+    for (int i = 1; i < count; i++) m_threads.emplace_back(&HeatmapRenderPool::loop, this);
+}
+
+HeatmapRenderPool::~HeatmapRenderPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_start.notify_all();
+    for (auto& thread : m_threads) thread.join();
+}
+
+void HeatmapRenderPool::run(const std::function<void()>& work) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_work = &work;
+        m_round++;
+        m_busy = (int)m_threads.size();
+    }
+    m_start.notify_all();
+    work();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_busy == 0; });
+    m_work = nullptr;
+}
+
+void HeatmapRenderPool::loop() {
+    trace_set_thread_name("heatmap-render");
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_start.wait(lock, [&] { return m_stopping || m_round != seen; });
+        if (m_stopping) return;
+        seen = m_round;
+        const std::function<void()>* work = m_work;
+        lock.unlock();
+        (*work)();
+        lock.lock();
+        if (--m_busy == 0) m_done.notify_all();
+    }
+}
+
+bool render_heatmap(const PointIndex& index, const HeatmapRequest& request, HeatmapRenderPool* pool,
+                    HeatmapImage& out, std::string& error, std::atomic<int>* progress, std::atomic<int>* total) {
+    TRACE_SPAN("heatmap.render", "heat");
+    static const HeatTileRenderer renderer;
+
+    uint32_t wx0, wy0, wx1, wy1;
+    if (request.has_bbox) {
+        wx0 = mercator_x(std::min(request.min_lon, request.max_lon));
+        wx1 = mercator_x(std::max(request.min_lon, request.max_lon));
+        wy0 = mercator_y(std::max(request.min_lat, request.max_lat));
+        wy1 = mercator_y(std::min(request.min_lat, request.max_lat));
+    } else if (!index.extent(wx0, wy0, wx1, wy1)) {
+        error = "no points";
+        return false;
+    }
+
+    // Наибольший зум, при котором область с полями влезает в max_size
+    const int max_size = std::clamp(request.max_size, HeatTileRenderer::kTileSize, kMaxImageSize);
+    const int pad = request.has_bbox ? 0 : kPadPixels;
+    int z = HeatTileRenderer::kMaxZoom;
+    for (; z > 0; z--) {
+        int s = 24 - z;
+        int64_t w = (int64_t)(wx1 >> s) - (wx0 >> s) + 1 + 2 * pad;
+        int64_t h = (int64_t)(wy1 >> s) - (wy0 >> s) + 1 + 2 * pad;
+        if (std::max(w, h) <= max_size) break;
+    }
+    const int s = 24 - z;
+    const int64_t world_px = (int64_t)HeatTileRenderer::kTileSize << z;
+    const int64_t px0 = std::max<int64_t>(0, (int64_t)(wx0 >> s) - pad);
+    const int64_t py0 = std::max<int64_t>(0, (int64_t)(wy0 >> s) - pad);
+    const int64_t px1 = std::min<int64_t>(world_px - 1, (int64_t)(wx1 >> s) + pad);
+    const int64_t py1 = std::min<int64_t>(world_px - 1, (int64_t)(wy1 >> s) + pad);
+    const int width = (int)(px1 - px0 + 1), height = (int)(py1 - py0 + 1);
+
+    const int n = HeatTileRenderer::kTileSize;
+    const int tx0 = (int)(px0 / n), ty0 = (int)(py0 / n);
+    const int cols = (int)(px1 / n) - tx0 + 1, rows = (int)(py1 / n) - ty0 + 1;
+    const int tiles = cols * rows;
+    if (total) *total = tiles;
+
+    // Тайлы раздаются потокам по одному; каждый пишет только свой прямоугольник картинки
+    std::vector<uint8_t> image((size_t)width * height * 4, 0);
+    std::atomic<int> next{0};
+    std::function<void()> work = [&]() {
+        std::vector<uint8_t> tile;
+        for (int i; (i = next++) < tiles;) {
+            int tx = tx0 + i % cols, ty = ty0 + i / cols;
+            if (renderer.renderRgba(index, z, tx, ty, tile)) {
+                int64_t ox = (int64_t)tx * n, oy = (int64_t)ty * n;
+                int64_t cx0 = std::max(ox, px0), cx1 = std::min(ox + n - 1, px1);
+                int64_t cy0 = std::max(oy, py0), cy1 = std::min(oy + n - 1, py1);
+                for (int64_t y = cy0; y <= cy1; y++) {
+                    memcpy(&image[((y - py0) * width + (cx0 - px0)) * 4], &tile[((y - oy) * n + (cx0 - ox)) * 4],
+                           (cx1 - cx0 + 1) * 4);
+                }
+            }
+            if (progress) (*progress)++;
+        }
+    };
+    if (pool && tiles > 1) {
+        pool->run(work);
+    } else {
+        work();
+    }
+
+    if (!encode_png_rgba(image.data(), width, height, kPngLevel, out.png)) {
+        error = "png encoding failed";
+        return false;
+    }
+    out.width = width;
+    out.height = height;
+
+    // Границы — края крайних пикселей, а не центры
+    const double unit = (double)(1u << s);
+    size_t points = index.countPoints(PointIndex::cover(PointIndex::kMaxClusterZoom, wx0, wy0, wx1, wy1));
+    out.legend.clear();
+    JsonWriter w(out.legend);
+    w.beginObject();
+    w.key("bounds");
+    w.beginArray();
+    w.beginArray();
+    w.value(mercator_lat((double)(py1 + 1) * unit));
+    w.value(mercator_lon((double)px0 * unit));
+    w.endArray();
+    w.beginArray();
+    w.value(mercator_lat((double)py0 * unit));
+    w.value(mercator_lon((double)(px1 + 1) * unit));
+    w.endArray();
+    w.endArray();
+    w.key("crs");
+    w.value("EPSG:3857");
+    w.key("generation");
+    w.value((unsigned long long)index.generation());
+    w.key("height");
+    w.value(height);
+    w.key("points");
+    w.value((unsigned long long)points);
+    w.key("scale");
+    w.beginArray();
+    for (const HeatColorStop& stop : kHeatColorStops) {
+        char color[8];
+        snprintf(color, sizeof(color), "#%02x%02x%02x", stop.r, stop.g, stop.b);
+        w.beginObject();
+        w.key("color");
+        w.value(color);
+        w.key("dbm");
+        w.value(stop.dbm);
+        w.endObject();
+    }
+    w.endArray();
+    w.key("width");
+    w.value(width);
+    w.key("zoom");
+    w.value(z);
+    w.endObject();
+    return true;
+}
+
+const char* heatmap_job_state_name(HeatmapJobState state) {
+    switch (state) {
+    case HeatmapJobState::Queued: return "queued";
+    case HeatmapJobState::Running: return "running";
+    case HeatmapJobState::Done: return "done";
+    case HeatmapJobState::Failed: return "failed";
+    }
+    return "unknown";
+}
+
+HeatmapJobs::HeatmapJobs(IndexSource source, int threads, size_t keep)
+    : m_source(std::move(source)), m_pool(threads), m_keep(std::max<size_t>(1, keep)) {
+    m_worker = std::thread(&HeatmapJobs::workerLoop, this);
+}
+
+HeatmapJobs::~HeatmapJobs() {
+    stop();
+}
+
+void HeatmapJobs::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+    if (m_worker.joinable()) m_worker.join();
+}
+
+std::string HeatmapJobs::submit(const HeatmapRequest& request) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Очередь не растёт без предела: сверх keep ожидающих — отказ
+    if (m_stopping || m_queue.size() >= m_keep) return "";
+
+    auto job = std::make_shared<Job>();
+    job->request = request;
+    job->status.id = std::to_string(m_next_id++);
+    m_jobs[job->status.id] = job;
+    m_order.push_back(job->status.id);
+    m_queue.push_back(job);
+
+    // Вытесняем самые старые готовые; ждущие и текущее не трогаем
+    while (m_order.size() > m_keep) {
+        auto it = m_jobs.find(m_order.front());
+        HeatmapJobState state = it->second->status.state;
+        if (state == HeatmapJobState::Queued || state == HeatmapJobState::Running) break;
+        m_jobs.erase(it);
+        m_order.pop_front();
+    }
+
+    m_cv.notify_one();
+    return job->status.id;
+}
+
+bool HeatmapJobs::status(const std::string& id, HeatmapJobStatus& out) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_jobs.find(id);
+    if (it == m_jobs.end()) return false;
+    const Job& job = *it->second;
+    out = job.status;
+    if (out.state == HeatmapJobState::Running) {
+        out.tiles_done = job.tiles_done.load();
+        out.tiles_total = job.tiles_total.load();
+        out.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - job.started).count();
+    }
+    return true;
+}
+
+void HeatmapJobs::workerLoop() {
+    trace_set_thread_name("heatmap");
+
+    while (true) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_stopping) return;
+            job = m_queue.front();
+            m_queue.pop_front();
+            job->status.state = HeatmapJobState::Running;
+            job->started = std::chrono::steady_clock::now();
+        }
+
+        auto image = std::make_shared<HeatmapImage>();
+        std::string error;
+        bool ok = false;
+        try {
+            PointIndexPtr index = m_source();
+            if (!index) {
+                error = "DB not connected";
+            } else {
+                ok = render_heatmap(*index, job->request, &m_pool, *image, error, &job->tiles_done,
+                                    &job->tiles_total);
+            }
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - job->started).count();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            HeatmapJobStatus& status = job->status;
+            status.state = ok ? HeatmapJobState::Done : HeatmapJobState::Failed;
+            status.tiles_done = job->tiles_done.load();
+            status.tiles_total = job->tiles_total.load();
+            status.seconds = seconds;
+            status.error = error;
+            if (ok) status.image = image;
+        }
+        if (ok) {
+            LOG_INFO("heatmap", "Heatmap #" << job->status.id << ": " << image->width << "x" << image->height
+                     << ", " << image->png.size() << " bytes in " << seconds << " s");
+        } else {
+            LOG_WARN("heatmap", "Heatmap #" << job->status.id << " failed: " << error);
+        }
+    }
+}
@@ -0,0 +1,311 @@
+#include "http.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+static std::string to_lower(std::string s) {
+    for (auto& c : s) c = (char)std::tolower((unsigned char)c);
+    return s;
+}
+
+static std::string trim(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t");
+    if (b == std::string::npos) return "";
+    size_t e = s.find_last_not_of(" \t\r");
+    return s.substr(b, e - b + 1);
+}
+
+std::string HttpRequest::header(const std::string& name) const {
+    for (const auto& [key, value] : headers) {
+        if (key == name) return value;
+    }
+    return "";
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static std::string url_decode(const std::string& s) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); i++) {
+        int hi, lo;
+        if (s[i] == '+') {
+            out += ' ';
+        } else if (s[i] == '%' && i + 2 < s.size() && (hi = hex_digit(s[i + 1])) >= 0 && (lo = hex_digit(s[i + 2])) >= 0) {
+            out += (char)(hi * 16 + lo);
+            i += 2;
+        } else {
+            out += s[i];
+        }
+    }
+    return out;
+}
+
+std::string HttpRequest::param(const std::string& name) const {
+    size_t pos = 0;
+    while (pos <= query.size()) {
+        size_t end = query.find('&', pos);
+        if (end == std::string::npos) end = query.size();
+        size_t eq = query.find('=', pos);
+        if (eq != std::string::npos && eq < end && query.compare(pos, eq - pos, name) == 0 && eq - pos == name.size()) {
+            return url_decode(query.substr(eq + 1, end - eq - 1));
+        }
+        pos = end + 1;
+    }
+    return "";
+}
+
+bool HttpRequest::keepAlive() const {
+    std::string connection = to_lower(header("connection"));
+    if (version == "HTTP/1.0") return connection.find("keep-alive") != std::string::npos;
+    return connection.find("close") == std::string::npos;
+}
+
+void HttpParser::reset() {
+    m_state = State::Headers;
+    m_error_status = 0;
+    m_request = HttpRequest();
+    m_head.clear();
+    m_line.clear();
+    m_chunked = false;
+    m_chunk_state = ChunkState::Size;
+    m_remaining = 0;
+    m_body_handler = nullptr;
+}
+
+void HttpParser::fail(int status) {
+    m_state = State::Error;
+    m_error_status = status;
+}
+
+void HttpParser::emitBody(const char* data, size_t size) {
+    if (size == 0) return;
+    if (m_body_handler) {
+        m_body_handler(data, size);
+        return;
+    }
+    if (m_request.body.size() + size > kMaxBufferedBody) {
+        fail(413);
+        return;
+    }
+    m_request.body.append(data, size);
+}
+
+// Длина из Content-Length: только цифры, без знака и пробелов внутри
+static bool parse_length(const std::string& s, uint64_t& value) {
+    if (s.empty() || s.size() > 19) return false;
+    value = 0;
+    for (char c : s) {
+        if (c < '0' || c > '9') return false;
+        value = value * 10 + (uint64_t)(c - '0');
+    }
+    return true;
+}
+
+// Как ограничено тело: 0 — разобрались, иначе статус ошибки. Transfer-Encoding
+// вместе с Content-Length, разные Content-Length и chunked не последним — 400
+// (по ним прокси и сервер могли бы разойтись в границах запроса); других
+// кодирований сервер не понимает — 501
+static int body_framing(const HttpRequest& request, bool& chunked, uint64_t& length) {
+    std::string te;
+    bool has_length = false;
+    for (const auto& [key, value] : request.headers) {
+        if (key == "transfer-encoding") {
+            te += (te.empty() ? "" : ",") + to_lower(value);
+        } else if (key == "content-length") {
+            uint64_t n;
+            if (!parse_length(value, n) || (has_length && n != length)) return 400;
+            length = n;
+            has_length = true;
+        }
+    }
+    if (te.empty()) return 0;
+    if (has_length) return 400;
+
+    std::vector<std::string> codings;
+    for (size_t pos = 0; pos <= te.size();) {
+        size_t end = te.find(',', pos);
+        if (end == std::string::npos) end = te.size();
+        std::string coding = trim(te.substr(pos, end - pos));
+        if (!coding.empty()) codings.push_back(coding);
+        pos = end + 1;
+    }
+    if (codings.empty()) return 400;
+    if (codings.back() != "chunked") {
+        return std::find(codings.begin(), codings.end(), "chunked") != codings.end() ? 400 : 501;
+    }
+    if (codings.size() > 1) return 501;
+    chunked = true;
+    length = 0;
+    return 0;
+}
+
+bool HttpParser::parseHead() {
+    size_t line_end = m_head.find("\r\n");
+    std::string request_line = m_head.substr(0, line_end);
+
+    size_t sp1 = request_line.find(' ');
+    size_t sp2 = sp1 == std::string::npos ? std::string::npos : request_line.find(' ', sp1 + 1);
+    if (sp2 == std::string::npos) return false;
+
+    m_request.method = request_line.substr(0, sp1);
+    m_request.target = request_line.substr(sp1 + 1, sp2 - sp1 - 1);
+    m_request.version = request_line.substr(sp2 + 1);
+    if (m_request.version.rfind("HTTP/1.", 0) != 0) return false;
+
+    size_t q = m_request.target.find('?');
+    m_request.path = m_request.target.substr(0, q);
+    if (q != std::string::npos) m_request.query = m_request.target.substr(q + 1);
+
+    size_t pos = line_end + 2;
+    while (pos < m_head.size()) {
+        size_t end = m_head.find("\r\n", pos);
+        if (end == std::string::npos || end == pos) break;
+        std::string line = m_head.substr(pos, end - pos);
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) return false;
+        m_request.headers.emplace_back(to_lower(trim(line.substr(0, colon))), trim(line.substr(colon + 1)));
+        pos = end + 2;
+    }
+    return true;
+}
+
+size_t HttpParser::feed(const char* data, size_t size) {
+    if (m_state == State::Headers) {
+        // Граница заголовков может прийти разрезанной между вызовами
+        size_t old = m_head.size();
+        size_t scan_from = old >= 3 ? old - 3 : 0;
+        m_head.append(data, std::min(size, kMaxHeaderBytes + 4 - std::min(old, kMaxHeaderBytes + 4)));
+
+        size_t end = m_head.find("\r\n\r\n", scan_from);
+        if (end == std::string::npos) {
+            if (m_head.size() > kMaxHeaderBytes) fail(431);
+            return size;
+        }
+
+        size_t used = end + 4 - old;
+        m_head.resize(end + 4);
+        if (!parseHead()) {
+            fail(400);
+            return used;
+        }
+
+        if (int status = body_framing(m_request, m_chunked, m_remaining)) {
+            fail(status);
+            return used;
+        }
+
+        m_state = (m_chunked || m_remaining > 0) ? State::Body : State::Done;
+        return used;
+    }
+
+    if (m_state != State::Body) return 0;
+
+    if (m_chunked) return feedChunked(data, size);
+
+    size_t take = (size_t)std::min<uint64_t>(size, m_remaining);
+    emitBody(data, take);
+    m_remaining -= take;
+    if (m_remaining == 0 && m_state == State::Body) m_state = State::Done;
+    return take;
+}
+
+size_t HttpParser::feedChunked(const char* data, size_t size) {
+    size_t pos = 0;
+    while (pos < size && m_state == State::Body) {
+        switch (m_chunk_state) {
+            case ChunkState::Size:
+            case ChunkState::DataEnd:
+            case ChunkState::Trailers: {
+                // Строковые части: размер чанка, CRLF после данных, трейлеры
+                const char* nl = (const char*)memchr(data + pos, '\n', size - pos);
+                size_t take = nl ? (size_t)(nl - (data + pos)) + 1 : size - pos;
+                m_line.append(data + pos, take);
+                pos += take;
+                if (m_line.size() > 4096) {
+                    fail(400);
+                    break;
+                }
+                if (!nl) break;
+
+                std::string line = trim(m_line.substr(0, m_line.size() - 1));
+                m_line.clear();
+
+                if (m_chunk_state == ChunkState::DataEnd) {
+                    if (!line.empty()) fail(400);
+                    m_chunk_state = ChunkState::Size;
+                } else if (m_chunk_state == ChunkState::Trailers) {
+                    if (line.empty()) m_state = State::Done;
+                } else {
+                    // Размер — только шестнадцатеричные цифры, расширения после ';' пропускаем
+                    std::string size_text = trim(line.substr(0, line.find(';')));
+                    uint64_t n = 0;
+                    bool valid = !size_text.empty() && size_text.size() <= 15;
+                    for (char c : size_text) {
+                        int d = hex_digit(c);
+                        if (d < 0) valid = false;
+                        n = n * 16 + (uint64_t)std::max(d, 0);
+                    }
+                    if (!valid) {
+                        fail(400);
+                        break;
+                    }
+                    m_remaining = n;
+                    m_chunk_state = n == 0 ? ChunkState::Trailers : ChunkState::Data;
+                }
+                break;
+            }
+            case ChunkState::Data: {
+                size_t take = (size_t)std::min<uint64_t>(size - pos, m_remaining);
+                emitBody(data + pos, take);
+                pos += take;
+                m_remaining -= take;
+                if (m_remaining == 0) m_chunk_state = ChunkState::DataEnd;
+                break;
+            }
+        }
+    }
+    return pos;
+}
+
+const char* http_status_text(int status) {
+    switch (status) {
+        case 100: return "Continue";
+        case 200: return "OK";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 411: return "Length Required";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        default: return "Unknown";
+    }
+}
+
+std::string http_date(time_t t) {
+    struct tm tm_info;
+    gmtime_r(&t, &tm_info);
+    char buf[64];
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm_info);
+    return buf;
+}
+
+bool parse_http_date(const std::string& text, time_t& t) {
+    struct tm tm_info;
+    memset(&tm_info, 0, sizeof(tm_info));
+    const char* end = strptime(text.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm_info);
+    if (!end) return false;
+    t = timegm(&tm_info);
+    return true;
+}
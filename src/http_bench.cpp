@@ -0,0 +1,332 @@
+#include "http_bench.hpp"
+#include "point_codec.hpp"
+#include "compression.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+std::vector<std::string> tile_burst_paths(double lat, double lon, int zoom, int cols, int rows) {
+    double n = std::pow(2.0, zoom);
+    double rad = lat * M_PI / 180.0;
+    int cx = (int)((lon + 180.0) / 360.0 * n);
+    int cy = (int)((1.0 - std::log(std::tan(rad) + 1.0 / std::cos(rad)) / M_PI) / 2.0 * n);
+
+    std::vector<std::string> paths;
+    for (int dy = -rows / 2; dy < rows - rows / 2; dy++) {
+        for (int dx = -cols / 2; dx < cols - cols / 2; dx++) {
+            paths.push_back("/tile/" + std::to_string(zoom) + "/" + std::to_string(cx + dx) + "/" +
+                            std::to_string(cy + dy) + ".png");
+        }
+    }
+    return paths;
+}
+
+namespace {
+
+struct BenchTotals {
+    LatencyHistogram latency;
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> errors{0};      // ответы 4xx/5xx
+    std::atomic<uint64_t> failures{0};    // обрыв или мусор вместо ответа
+    std::atomic<uint64_t> connects{0};
+    std::atomic<uint64_t> bytes{0};
+};
+
+int connect_to(const HttpBenchOptions& opts) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(opts.host.c_str(), std::to_string(opts.port).c_str(), &hints, &res) != 0 || !res) return -1;
+
+    int fd = socket(res->ai_family, res->ai_socktype, 0);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd >= 0) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+bool send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Читает ответы одного соединения; лишнее остаётся в buffer для следующего ответа
+class ResponseReader {
+public:
+    explicit ResponseReader(int fd) : m_fd(fd) {}
+
+    // false — соединение оборвалось или ответ не разобрать
+    bool next(int& status, bool& keep_alive, size_t& body_bytes) {
+        size_t head_end;
+        while ((head_end = m_buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (!fill()) return false;
+        }
+        std::string head = m_buffer.substr(0, head_end);
+        m_buffer.erase(0, head_end + 4);
+
+        if (head.compare(0, 5, "HTTP/") != 0 || head.size() < 12) return false;
+        status = atoi(head.c_str() + 9);
+        std::string lower = head;
+        for (char& c : lower) c = (char)tolower((unsigned char)c);
+        keep_alive = lower.find("\r\nconnection: close") == std::string::npos &&
+                     lower.compare(0, 8, "http/1.0") != 0;
+
+        if (status == 304 || status == 204) {
+            body_bytes = 0;
+            return true;
+        }
+        if (lower.find("\r\ntransfer-encoding: chunked") != std::string::npos) return readChunked(body_bytes);
+
+        size_t pos = lower.find("\r\ncontent-length:");
+        if (pos == std::string::npos) {
+            // Без длины тело идёт до закрытия соединения
+            while (fill()) {
+            }
+            body_bytes = m_buffer.size();
+            m_buffer.clear();
+            keep_alive = false;
+            return true;
+        }
+        body_bytes = strtoull(lower.c_str() + pos + 17, nullptr, 10);
+        if (!need(body_bytes)) return false;
+        m_buffer.erase(0, body_bytes);
+        return true;
+    }
+
+private:
+    bool fill() {
+        char chunk[65536];
+        while (true) {
+            ssize_t n = recv(m_fd, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            m_buffer.append(chunk, n);
+            return true;
+        }
+    }
+
+    bool need(size_t bytes) {
+        while (m_buffer.size() < bytes) {
+            if (!fill()) return false;
+        }
+        return true;
+    }
+
+    bool readChunked(size_t& body_bytes) {
+        body_bytes = 0;
+        while (true) {
+            size_t eol;
+            while ((eol = m_buffer.find("\r\n")) == std::string::npos) {
+                if (!fill()) return false;
+            }
+            size_t size = strtoull(m_buffer.c_str(), nullptr, 16);
+            m_buffer.erase(0, eol + 2);
+            if (size == 0) {
+                // Трейлеры не шлём — остаётся пустая строка
+                if (!need(2)) return false;
+                m_buffer.erase(0, 2);
+                return true;
+            }
+            if (!need(size + 2)) return false;
+            m_buffer.erase(0, size + 2);
+            body_bytes += size;
+        }
+    }
+
+    int m_fd;
+    std::string m_buffer;
+};
+
+void bench_connection(const HttpBenchOptions& opts, const std::vector<std::string>& paths,
+                      std::atomic<size_t>& next, size_t total, BenchTotals& totals) {
+    int fd = -1;
+    std::unique_ptr<ResponseReader> reader;
+    std::vector<uint64_t> in_flight;
+    std::string request;
+
+    auto reconnect = [&]() {
+        fd = connect_to(opts);
+        if (fd < 0) return false;
+        reader = std::make_unique<ResponseReader>(fd);
+        totals.connects++;
+        return true;
+    };
+
+    while (true) {
+        // Добираем запросы до глубины конвейера
+        request.clear();
+        size_t depth = opts.keep_alive ? (size_t)std::max(1, opts.pipeline) : 1;
+        while (in_flight.size() < depth) {
+            size_t i = next.fetch_add(1);
+            if (i >= total) break;
+            request += "GET " + paths[i % paths.size()] + " HTTP/1.1\r\nHost: " + opts.host + "\r\n";
+            if (!opts.keep_alive) request += "Connection: close\r\n";
+            request += "\r\n";
+            in_flight.push_back(metrics_now_ns());
+        }
+        if (in_flight.empty()) break;
+
+        if (fd < 0 && !reconnect()) {
+            totals.failures += in_flight.size();
+            in_flight.clear();
+            continue;
+        }
+        if (!request.empty() && !send_all(fd, request)) {
+            totals.failures += in_flight.size();
+            close(fd);
+            fd = -1;
+            in_flight.clear();
+            continue;
+        }
+
+        // Ответ на самый старый запрос — конвейер отвечает по порядку
+        int status = 0;
+        bool keep_alive = false;
+        size_t body = 0;
+        if (!reader->next(status, keep_alive, body)) {
+            totals.failures += in_flight.size();
+            close(fd);
+            fd = -1;
+            in_flight.clear();
+            continue;
+        }
+        totals.latency.record(metrics_now_ns() - in_flight.front());
+        in_flight.erase(in_flight.begin());
+        totals.requests++;
+        totals.bytes += body;
+        if (status >= 400) totals.errors++;
+
+        if (!keep_alive) {
+            totals.failures += in_flight.size();
+            close(fd);
+            fd = -1;
+            in_flight.clear();
+        }
+    }
+
+    if (fd >= 0) close(fd);
+}
+
+}
+
+int run_http_bench(const HttpBenchOptions& opts) {
+    std::vector<std::string> paths = opts.paths;
+    if (paths.empty()) paths = tile_burst_paths(55.007969, 82.944546, 13, 8, 5);
+
+    size_t total = paths.size() * (size_t)std::max(1, opts.rounds);
+    LOG_INFO("bench", "HTTP bench: " << opts.host << ":" << opts.port << ", " << paths.size() << " paths x "
+             << opts.rounds << ", " << opts.connections << " connections, pipeline " << opts.pipeline
+             << (opts.keep_alive ? ", keep-alive" : ", Connection: close"));
+
+    BenchTotals totals;
+    std::atomic<size_t> next{0};
+    uint64_t start = metrics_now_ns();
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < std::max(1, opts.connections); i++) {
+        workers.emplace_back(bench_connection, std::cref(opts), std::cref(paths), std::ref(next), total,
+                             std::ref(totals));
+    }
+    for (auto& t : workers) t.join();
+
+    double seconds = (metrics_now_ns() - start) / 1e9;
+    const LatencyHistogram& h = totals.latency;
+    LOG_INFO("bench", "Done: " << totals.requests.load() << " responses in " << seconds << " s ("
+             << (seconds > 0 ? totals.requests.load() / seconds : 0) << " req/s), "
+             << totals.connects.load() << " connections, " << totals.errors.load() << " error responses, "
+             << totals.failures.load() << " failed, " << totals.bytes.load() << " body bytes");
+    LOG_INFO("bench", "Latency ms: p50=" << h.percentile(0.5) / 1e6 << " p90=" << h.percentile(0.9) / 1e6
+             << " p99=" << h.percentile(0.99) / 1e6 << " max=" << h.max() / 1e6);
+
+    return totals.failures.load() ? 1 : 0;
+}
+
+// Лучшее время из нескольких прогонов, мс
+template <typename F>
+static double best_ms(int runs, F&& fn) {
+    double best = 1e18;
+    for (int i = 0; i < runs; i++) {
+        uint64_t start = metrics_now_ns();
+        fn();
+        best = std::min(best, (metrics_now_ns() - start) / 1e6);
+    }
+    return best;
+}
+
+int run_points_bench(int count) {
+    // Трек вокруг центра карты: соседние точки рядом, время идёт с шагом ~1 с
+    std::mt19937 rng(42);
+    std::normal_distribution<double> step(0.0, 0.0003);
+    std::uniform_int_distribution<int> signal(-125, -60);
+    std::uniform_int_distribution<int> dt(900, 1100);
+
+    std::vector<MapPoint> points(count);
+    double lat = 55.007969, lon = 82.944546;
+    long long ts = 1700000000000LL;
+    for (auto& p : points) {
+        lat += step(rng);
+        lon += step(rng);
+        ts -= dt(rng); // как в /api/points: новые первыми
+        p = MapPoint{lat, lon, ts, signal(rng), "GPS"};
+    }
+
+    const int runs = 20;
+    std::string tree_body, json_body, bin_body;
+    // Прежний способ: дерево nlohmann на каждую точку и dump()
+    double tree_ms = best_ms(runs, [&] {
+        json tree = json::array();
+        for (const auto& p : points) {
+            tree.push_back({{"lat", p.lat}, {"lon", p.lon}, {"signal", p.signal_strength}, {"timestamp", p.timestamp}});
+        }
+        tree_body = tree.dump();
+    });
+    double json_ms = best_ms(runs, [&] { json_body = encode_points_json(points); });
+    double bin_ms = best_ms(runs, [&] { encode_points_binary(points, bin_body); });
+
+    std::vector<MapPoint> decoded;
+    double decode_ms = best_ms(runs, [&] { decode_points_binary(bin_body, decoded); });
+    bool exact = decoded.size() == points.size();
+    for (size_t i = 0; exact && i < points.size(); i++) {
+        exact = std::abs(decoded[i].lat - points[i].lat) < 1e-7 && decoded[i].timestamp == points[i].timestamp &&
+                decoded[i].signal_strength == points[i].signal_strength;
+    }
+
+    std::string json_gz, bin_gz;
+    compress_body(json_body.data(), json_body.size(), ContentEncoding::Gzip, 6, json_gz);
+    compress_body(bin_body.data(), bin_body.size(), ContentEncoding::Gzip, 6, bin_gz);
+
+    LOG_INFO("bench", "Points: " << count << ", best of " << runs << " runs");
+    LOG_INFO("bench", "  json (tree):   encode " << tree_ms << " ms");
+    LOG_INFO("bench", "  json (writer): encode " << json_ms << " ms, " << json_body.size() << " B ("
+             << (double)json_body.size() / count << " B/point), gzip " << json_gz.size() << " B, "
+             << (json_body == tree_body ? "identical to tree" : "DIFFERS from tree"));
+    LOG_INFO("bench", "  binary:        encode " << bin_ms << " ms, " << bin_body.size() << " B ("
+             << (double)bin_body.size() / count << " B/point), gzip " << bin_gz.size() << " B, decode "
+             << decode_ms << " ms, round trip " << (exact ? "exact" : "MISMATCH"));
+    return exact && json_body == tree_body ? 0 : 1;
+}
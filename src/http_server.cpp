@@ -0,0 +1,1124 @@
+#include "http_server.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+static uint64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+std::string HttpResponse::serialize(bool keep_alive) const {
+    const std::string& content = shared_body ? *shared_body : body;
+    std::string out;
+    out.reserve((file ? 0 : content.size()) + 256);
+    out += "HTTP/1.1 " + std::to_string(status) + " " + http_status_text(status) + "\r\n";
+    out += "Content-Type: " + content_type + "\r\n";
+    out += "Access-Control-Allow-Origin: *\r\n";
+    for (const auto& [name, value] : headers) {
+        out += name + ": " + value + "\r\n";
+    }
+    if (!etag.empty()) out += "ETag: " + etag + "\r\n";
+    if (last_modified) out += "Last-Modified: " + http_date(last_modified) + "\r\n";
+    // У 304 тела нет вовсе; длину потокового тела заранее не знаем
+    bool no_body = status == 304 || status == 204;
+    if (stream) {
+        out += "Transfer-Encoding: chunked\r\n";
+    } else if (!no_body && event_channel.empty()) {
+        out += "Content-Length: " + std::to_string(file ? file->size : content.size()) + "\r\n";
+    }
+    out += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    if (!file && !stream && !no_body && !head) out += content;
+    return out;
+}
+
+std::string sse_event(const std::string& event, const std::string& data, const std::string& id) {
+    std::string out;
+    out.reserve(data.size() + event.size() + id.size() + 32);
+    if (!event.empty()) out += "event: " + event + "\n";
+    if (!id.empty()) out += "id: " + id + "\n";
+    size_t pos = 0;
+    do {
+        size_t nl = data.find('\n', pos);
+        if (nl == std::string::npos) nl = data.size();
+        out += "data: ";
+        out.append(data, pos, nl - pos);
+        out += '\n';
+        pos = nl + 1;
+    } while (pos < data.size());
+    out += '\n';
+    return out;
+}
+
+// Сжатие по Accept-Encoding. Тела из кэша ответов и файлы сжимаются один раз на
+// вариант (variants), остальные — на каждый запрос
+static void compress_response(const HttpRequest& request, HttpResponse& response, const HttpServer::Options& options) {
+    if (options.compression_level <= 0 || response.status != 200 || response.stream ||
+        !response.event_channel.empty()) {
+        return;
+    }
+    if (!compressible_type(response.content_type)) return;
+    for (const auto& [name, value] : response.headers) {
+        if (name == "Content-Encoding") return;
+    }
+
+    // Ответ зависит от Accept-Encoding — кэши по дороге должны это учитывать
+    response.headers.emplace_back("Vary", "Accept-Encoding");
+
+    size_t size = response.file ? response.file->size : response.shared_body ? response.shared_body->size()
+                                                                            : response.body.size();
+    ContentEncoding encoding = choose_encoding(request.header("accept-encoding"));
+    if (encoding == ContentEncoding::Identity || size < options.compress_min_bytes) return;
+
+    if (response.variants) {
+        const std::string* compressed = response.variants->get(encoding, options.compression_level, [&]() {
+            if (!response.file) return *response.shared_body;
+            const StaticFile& f = *response.file;
+            if (f.data) return std::string(f.data, f.size);
+            std::string raw(f.size, '\0');
+            size_t got = 0;
+            while (got < f.size) {
+                ssize_t n = pread(f.fd, &raw[got], f.size - got, (off_t)got);
+                if (n <= 0) break;
+                got += n;
+            }
+            raw.resize(got);
+            return raw;
+        });
+        if (!compressed) return;
+        response.shared_body = std::shared_ptr<const std::string>(response.variants, compressed);
+        response.file.reset();
+        response.body.clear();
+        size -= std::min(size, compressed->size());
+    } else {
+        const std::string& raw = response.shared_body ? *response.shared_body : response.body;
+        std::string compressed;
+        if (!compress_body(raw.data(), raw.size(), encoding, options.compression_level, compressed) ||
+            compressed.size() >= raw.size()) {
+            return;
+        }
+        size = raw.size() - compressed.size();
+        response.shared_body.reset();
+        response.body = std::move(compressed);
+    }
+
+    response.headers.emplace_back("Content-Encoding", encoding_name(encoding));
+    // Сжатый вариант — другие байты, значит и сильный ETag другой
+    if (!response.etag.empty() && response.etag.back() == '"') {
+        response.etag.insert(response.etag.size() - 1, std::string("-") + encoding_name(encoding));
+    }
+    HttpMetrics& metrics = http_metrics();
+    metrics.compressed_responses++;
+    metrics.compression_saved_bytes += size;
+}
+
+bool etag_matches(const std::string& if_none_match, const std::string& etag, std::string& matched) {
+    size_t pos = 0;
+    while (pos < if_none_match.size()) {
+        size_t comma = if_none_match.find(',', pos);
+        if (comma == std::string::npos) comma = if_none_match.size();
+        std::string tag = if_none_match.substr(pos, comma - pos);
+        pos = comma + 1;
+
+        size_t b = tag.find_first_not_of(" \t");
+        size_t e = tag.find_last_not_of(" \t");
+        if (b == std::string::npos) continue;
+        tag = tag.substr(b, e - b + 1);
+        if (tag == "*") {
+            matched = etag;
+            return true;
+        }
+        if (tag.compare(0, 2, "W/") == 0) tag.erase(0, 2);
+
+        std::string base = tag;
+        for (const char* suffix : {"-gzip\"", "-deflate\""}) {
+            size_t len = strlen(suffix);
+            if (base.size() > len && base.compare(base.size() - len, len, suffix) == 0) {
+                base = base.substr(0, base.size() - len) + "\"";
+                break;
+            }
+        }
+        if (base == etag) {
+            matched = tag;
+            return true;
+        }
+    }
+    return false;
+}
+
+void apply_conditional(const HttpRequest& request, HttpResponse& response) {
+    if (response.status != 200 || (response.etag.empty() && !response.last_modified)) return;
+    if (request.method != "GET" && request.method != "HEAD") return;
+
+    bool not_modified = false;
+    std::string if_none_match = request.header("if-none-match");
+    if (!if_none_match.empty()) {
+        std::string matched;
+        not_modified = !response.etag.empty() && etag_matches(if_none_match, response.etag, matched);
+        if (not_modified) response.etag = matched;
+    } else if (response.last_modified) {
+        time_t since;
+        not_modified = parse_http_date(request.header("if-modified-since"), since) && response.last_modified <= since;
+    }
+    if (!not_modified) return;
+
+    response.status = 304;
+    if (compressible_type(response.content_type)) response.headers.emplace_back("Vary", "Accept-Encoding");
+    response.body.clear();
+    response.shared_body.reset();
+    response.file.reset();
+    response.variants.reset();
+    http_metrics().not_modified++;
+}
+
+static std::string error_response(int status) {
+    HttpResponse response;
+    response.status = status;
+    response.content_type = "text/plain";
+    response.body = http_status_text(status);
+    return response.serialize(false);
+}
+
+// Очередь потокового ответа между потоком пула (пишет chunk'и) и реактором (отправляет)
+struct HttpStream {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::string pending;       // оформленные chunk'и, ещё не забранные реактором
+    bool finished = false;     // производитель закончил
+    bool failed = false;       // оборвался посреди тела — соединение только закрыть
+    bool aborted = false;      // соединение закрыто, писать некуда
+};
+
+struct HttpServer::Reactor {
+    struct Connection {
+        int fd = -1;
+        uint64_t id = 0;
+        HttpParser parser;
+        std::unique_ptr<HttpBodyStream> body;
+        std::string in;            // прочитано, но ещё не разобрано (конвейерные запросы)
+        std::string out;
+        size_t out_pos = 0;
+        StaticFilePtr file;        // тело ответа после заголовков из out
+        size_t file_pos = 0;
+        std::shared_ptr<HttpStream> stream; // потоковое тело: следующие chunk'и
+        std::string channel;       // подписка SSE: ответ не кончается, события дописываются в out
+        std::deque<std::shared_ptr<const std::string>> events; // ещё не отправленные события
+        size_t events_bytes = 0;
+        uint32_t watching = EPOLLIN | EPOLLRDHUP; // текущая маска epoll
+        bool processing = false;   // запрос в пуле, ждём ответ
+        bool paused = false;       // тело не принимается (body->ready() == false), сокет не читаем
+        bool close_after = true;
+        size_t requests = 0;
+        uint64_t last_active_ms = 0;
+    };
+
+    struct Completion {
+        int fd = -1;
+        uint64_t conn_id = 0;
+        std::string bytes;
+        StaticFilePtr file;
+        std::shared_ptr<HttpStream> stream;
+        bool keep_alive = false;
+        bool wake = false;         // только сигнал: в stream появились chunk'и
+        std::string channel;       // ответ открывает подписку на канал
+        std::shared_ptr<const std::string> event; // событие всем подписчикам channel (fd не важен)
+
+        // Готовый ответ: bytes, затем тело из file или из stream
+        static Completion response(int fd, uint64_t conn_id, std::string bytes, bool keep_alive,
+                                   StaticFilePtr file = nullptr, std::shared_ptr<HttpStream> stream = nullptr) {
+            Completion c;
+            c.fd = fd;
+            c.conn_id = conn_id;
+            c.bytes = std::move(bytes);
+            c.keep_alive = keep_alive;
+            c.file = std::move(file);
+            c.stream = std::move(stream);
+            return c;
+        }
+        static Completion wakeStream(int fd, uint64_t conn_id, std::shared_ptr<HttpStream> stream) {
+            Completion c;
+            c.fd = fd;
+            c.conn_id = conn_id;
+            c.stream = std::move(stream);
+            c.wake = true;
+            return c;
+        }
+        // Заголовки подписки SSE; соединение после неё не переиспользуется
+        static Completion subscribe(int fd, uint64_t conn_id, std::string bytes, std::string channel) {
+            Completion c = response(fd, conn_id, std::move(bytes), false);
+            c.channel = std::move(channel);
+            return c;
+        }
+        static Completion broadcast(std::string channel, std::shared_ptr<const std::string> event) {
+            Completion c;
+            c.channel = std::move(channel);
+            c.event = std::move(event);
+            return c;
+        }
+    };
+
+    HttpServer* server = nullptr;
+    int index = 0;
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int event_fd = -1;
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+
+    std::unordered_map<int, Connection> connections;
+    uint64_t next_id = 1;
+    std::unordered_map<std::string, std::unordered_set<int>> channels; // подписчики SSE по каналам
+    std::unordered_set<int> paused;    // соединения с приостановленным телом
+    std::atomic<size_t> subscribers{0};
+
+    std::mutex done_mutex;
+    std::vector<Completion> done;
+
+    bool open(int port);
+    void run();
+    void acceptAll();
+    void onReadable(Connection& conn);
+    void processInput(Connection& conn);
+    void onWritable(Connection& conn);
+    void queueResponse(Connection& conn, std::string bytes, StaticFilePtr file = nullptr,
+                       std::shared_ptr<HttpStream> stream = nullptr);
+    void closeConnection(int fd);
+    void drainCompletions();
+    void sweepIdle();
+    void resumePaused();
+    void watch(Connection& conn, uint32_t events);
+    void pushEvent(Connection& conn, const std::shared_ptr<const std::string>& event);
+
+    // Из потока пула: отдать готовый ответ реактору
+    void post(Completion completion);
+};
+
+bool HttpServer::Reactor::open(int port) {
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    epoll_fd = epoll_create1(0);
+    event_fd = eventfd(0, EFD_NONBLOCK);
+    if (listen_fd < 0 || epoll_fd < 0 || event_fd < 0) return false;
+
+    int opt = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+
+    if (bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listen_fd, 512) < 0) {
+        return false;
+    }
+    set_nonblocking(listen_fd);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = listen_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+    ev.data.fd = event_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &ev);
+    return true;
+}
+
+void HttpServer::Reactor::watch(Connection& conn, uint32_t events) {
+    if (conn.watching == events) return;
+    conn.watching = events;
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.fd = conn.fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.fd, &ev);
+}
+
+void HttpServer::Reactor::run() {
+    trace_set_thread_name("http-reactor");
+
+    struct epoll_event events[256];
+    uint64_t last_sweep = now_ms();
+
+    while (!stopping) {
+        // Приостановленные тела переспрашиваем часто: конвейер освобождается за миллисекунды
+        int n = epoll_wait(epoll_fd, events, 256, paused.empty() ? 1000 : 10);
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listen_fd) {
+                acceptAll();
+                continue;
+            }
+            if (fd == event_fd) {
+                uint64_t value;
+                while (read(event_fd, &value, sizeof(value)) > 0) {
+                }
+                drainCompletions();
+                continue;
+            }
+
+            auto it = connections.find(fd);
+            if (it == connections.end()) continue;
+            Connection& conn = it->second;
+
+            // Клиент ушёл (в том числе пока запрос в пуле — ответ тогда просто отбросится)
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(fd);
+                continue;
+            }
+            // Подписчик ничего не присылает: EPOLLRDHUP у него — только уход
+            if (!conn.channel.empty() && (events[i].events & EPOLLRDHUP)) {
+                closeConnection(fd);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                onWritable(conn);
+                if (!connections.count(fd)) continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+                onReadable(conn);
+            }
+        }
+
+        if (!paused.empty()) resumePaused();
+
+        uint64_t now = now_ms();
+        if (now - last_sweep >= 1000) {
+            sweepIdle();
+            last_sweep = now;
+        }
+    }
+
+    while (!connections.empty()) closeConnection(connections.begin()->first);
+}
+
+void HttpServer::Reactor::acceptAll() {
+    while (true) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK);
+        if (fd < 0) return;
+
+        HttpMetrics& metrics = http_metrics();
+        if (server->m_connections.load() >= server->m_options.max_connections) {
+            // Сверх предела: короткий 503 без чтения запроса
+            std::string reply = error_response(503);
+            send(fd, reply.data(), reply.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            close(fd);
+            metrics.rejected++;
+            continue;
+        }
+
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        Connection& conn = connections[fd];
+        conn.fd = fd;
+        conn.id = next_id++;
+        conn.last_active_ms = now_ms();
+        server->m_connections++;
+        metrics.connections++;
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+void HttpServer::Reactor::onReadable(Connection& conn) {
+    char buffer[65536];
+    int fd = conn.fd;
+
+    // Пока запрос в пуле, не читаем: следующие запросы ждут в сокете, ответы идут по порядку
+    while (!conn.processing && !conn.paused) {
+        ssize_t got = read(fd, buffer, sizeof(buffer));
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (got <= 0) {
+            closeConnection(fd);
+            return;
+        }
+        conn.last_active_ms = now_ms();
+        conn.in.append(buffer, got);
+
+        processInput(conn);
+        if (!connections.count(fd)) return;
+
+        // Тело не успевает уходить дальше — пусть клиента сдерживает TCP
+        if (conn.body && !conn.body->ready()) {
+            conn.paused = true;
+            paused.insert(fd);
+            watch(conn, 0);
+        }
+    }
+}
+
+void HttpServer::Reactor::resumePaused() {
+    std::vector<int> ready;
+    for (int fd : paused) {
+        auto it = connections.find(fd);
+        if (it != connections.end() && it->second.body && it->second.body->ready()) ready.push_back(fd);
+    }
+    for (int fd : ready) {
+        paused.erase(fd);
+        auto it = connections.find(fd);
+        if (it == connections.end()) continue;
+        Connection& conn = it->second;
+        conn.paused = false;
+        conn.last_active_ms = now_ms();
+        watch(conn, EPOLLIN | EPOLLRDHUP);
+        onReadable(conn);
+    }
+}
+
+void HttpServer::Reactor::processInput(Connection& conn) {
+    int fd = conn.fd;
+
+    size_t pos = 0;
+    while (pos < conn.in.size() && !conn.parser.done() && !conn.parser.failed()) {
+        bool in_headers = conn.parser.state() == HttpParser::State::Headers;
+        pos += conn.parser.feed(conn.in.data() + pos, conn.in.size() - pos);
+        if (!in_headers || conn.parser.state() == HttpParser::State::Headers) continue;
+
+        // Заголовки готовы: решаем, куда пойдёт тело
+        HttpRequest& head = conn.parser.request();
+        if (server->m_body_streams) {
+            conn.body = server->m_body_streams(head);
+            if (conn.body) {
+                HttpBodyStream* sink = conn.body.get();
+                conn.parser.setBodyHandler([sink](const char* data, size_t size) { sink->feed(data, size); });
+            }
+        }
+        if (conn.parser.state() == HttpParser::State::Body &&
+            head.header("expect").find("100-continue") != std::string::npos) {
+            const char* cont = "HTTP/1.1 100 Continue\r\n\r\n";
+            send(fd, cont, strlen(cont), MSG_NOSIGNAL | MSG_DONTWAIT);
+        }
+    }
+    // Остаток — начало следующего запроса того же соединения
+    conn.in.erase(0, pos);
+
+    if (conn.parser.failed()) {
+        conn.processing = true;
+        conn.close_after = true;
+        queueResponse(conn, error_response(conn.parser.errorStatus()));
+        return;
+    }
+
+    if (!conn.parser.done()) return;
+
+    conn.processing = true;
+    conn.requests++;
+    watch(conn, 0);
+
+    HttpRequest& request = conn.parser.request();
+    bool keep_alive = request.keepAlive() && conn.requests < server->m_options.max_requests_per_connection;
+    conn.close_after = !keep_alive;
+
+    // Маршруты знают только эти методы; тело уже дочитано, соединение можно оставить
+    if (request.method != "GET" && request.method != "HEAD" && request.method != "POST") {
+        HttpResponse response;
+        response.status = 405;
+        response.content_type = "text/plain";
+        response.body = http_status_text(405);
+        response.headers.emplace_back("Allow", "GET, HEAD, POST");
+        conn.body.reset();
+        HttpMetrics& metrics = http_metrics();
+        metrics.requests++;
+        metrics.errors++;
+        queueResponse(conn, response.serialize(keep_alive));
+        return;
+    }
+
+    Job job{this, fd, conn.id, std::move(request), std::move(conn.body), metrics_now_ns(), keep_alive};
+    if (!server->dispatch(std::move(job))) {
+        http_metrics().rejected++;
+        conn.close_after = true;
+        queueResponse(conn, error_response(503));
+    }
+}
+
+void HttpServer::Reactor::queueResponse(Connection& conn, std::string bytes, StaticFilePtr file,
+                                        std::shared_ptr<HttpStream> stream) {
+    conn.out = std::move(bytes);
+    conn.out_pos = 0;
+    conn.file = std::move(file);
+    conn.file_pos = 0;
+    conn.stream = std::move(stream);
+    onWritable(conn);
+}
+
+void HttpServer::Reactor::onWritable(Connection& conn) {
+    if (!conn.processing) return;
+
+    while (true) {
+        size_t file_size = conn.file ? conn.file->size : 0;
+        while (conn.out_pos < conn.out.size() || conn.file_pos < file_size) {
+            bool head = conn.out_pos < conn.out.size();
+            size_t left = file_size - conn.file_pos;
+            ssize_t n;
+            if (head) {
+                // MSG_MORE: заголовки уйдут одним сегментом с началом файла
+                n = send(conn.fd, conn.out.data() + conn.out_pos, conn.out.size() - conn.out_pos,
+                         MSG_NOSIGNAL | MSG_DONTWAIT | (left ? MSG_MORE : 0));
+            } else if (conn.file->data) {
+                n = send(conn.fd, conn.file->data + conn.file_pos, left, MSG_NOSIGNAL | MSG_DONTWAIT);
+            } else {
+                off_t offset = (off_t)conn.file_pos;
+                n = sendfile(conn.fd, conn.file->fd, &offset, left);
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                watch(conn, EPOLLOUT);
+                return;
+            }
+            if (n <= 0) {
+                closeConnection(conn.fd);
+                return;
+            }
+            if (head) {
+                conn.out_pos += n;
+            } else {
+                conn.file_pos += n;
+                http_metrics().file_bytes += n;
+            }
+        }
+
+        if (!conn.channel.empty()) {
+            // Подписка: дописываем накопленные события; пока их нет — ждём только обрыва
+            conn.last_active_ms = now_ms();
+            if (conn.events.empty()) {
+                watch(conn, EPOLLRDHUP);
+                return;
+            }
+            conn.out.clear();
+            conn.out_pos = 0;
+            for (const auto& event : conn.events) conn.out += *event;
+            conn.events.clear();
+            conn.events_bytes = 0;
+            continue;
+        }
+
+        if (!conn.stream) break;
+
+        // Потоковое тело: забираем накопленные chunk'и; пока их нет — ждём сигнала от пула
+        bool finished;
+        bool failed;
+        {
+            std::lock_guard<std::mutex> lock(conn.stream->mutex);
+            conn.out.clear();
+            conn.out_pos = 0;
+            conn.out.swap(conn.stream->pending);
+            finished = conn.stream->finished;
+            failed = conn.stream->failed;
+        }
+        conn.stream->cv.notify_all();
+        if (!conn.out.empty()) continue;
+        if (failed) {
+            closeConnection(conn.fd);
+            return;
+        }
+        if (!finished) {
+            watch(conn, 0);
+            return;
+        }
+        conn.stream.reset();
+        break;
+    }
+
+    if (conn.close_after) {
+        closeConnection(conn.fd);
+        return;
+    }
+
+    // Ответ ушёл целиком: соединение ждёт следующий запрос
+    conn.out.clear();
+    conn.out_pos = 0;
+    conn.file.reset();
+    conn.file_pos = 0;
+    conn.processing = false;
+    conn.parser.reset();
+    conn.body.reset();
+    conn.last_active_ms = now_ms();
+    watch(conn, EPOLLIN | EPOLLRDHUP);
+    if (!conn.in.empty()) processInput(conn);
+}
+
+void HttpServer::Reactor::closeConnection(int fd) {
+    auto it = connections.find(fd);
+    if (it == connections.end()) return;
+
+    if (it->second.stream) {
+        std::lock_guard<std::mutex> lock(it->second.stream->mutex);
+        it->second.stream->aborted = true;
+        it->second.stream->cv.notify_all();
+    }
+    if (!it->second.channel.empty()) {
+        channels[it->second.channel].erase(fd);
+        subscribers--;
+        server->m_subscribers--;
+        http_metrics().sse_subscribers--;
+    }
+
+    paused.erase(fd);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections.erase(it);
+    server->m_connections--;
+    http_metrics().connections--;
+}
+
+void HttpServer::Reactor::post(Completion completion) {
+    {
+        std::lock_guard<std::mutex> lock(done_mutex);
+        done.push_back(std::move(completion));
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(event_fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+void HttpServer::Reactor::drainCompletions() {
+    std::vector<Completion> batch;
+    {
+        std::lock_guard<std::mutex> lock(done_mutex);
+        batch.swap(done);
+    }
+
+    for (auto& c : batch) {
+        if (c.event) {
+            // pushEvent может закрыть соединение, поэтому обходим копию списка
+            auto ch = channels.find(c.channel);
+            if (ch == channels.end()) continue;
+            std::vector<int> fds(ch->second.begin(), ch->second.end());
+            for (int fd : fds) {
+                auto it = connections.find(fd);
+                if (it != connections.end()) pushEvent(it->second, c.event);
+            }
+            continue;
+        }
+
+        // Соединение могло закрыться, а fd — достаться новому клиенту
+        auto it = connections.find(c.fd);
+        if (it == connections.end() || it->second.id != c.conn_id) continue;
+        if (c.wake) {
+            if (it->second.stream == c.stream) onWritable(it->second);
+            continue;
+        }
+        if (!c.channel.empty()) {
+            it->second.channel = c.channel;
+            channels[c.channel].insert(c.fd);
+            subscribers++;
+            server->m_subscribers++;
+            http_metrics().sse_subscribers++;
+        }
+        it->second.close_after = !c.keep_alive;
+        queueResponse(it->second, std::move(c.bytes), std::move(c.file), std::move(c.stream));
+    }
+}
+
+// Медленный подписчик не держит память: если очередь переросла предел, события
+// заменяются одним "reset" — клиент сам перечитает состояние и продолжит с новых
+void HttpServer::Reactor::pushEvent(Connection& conn, const std::shared_ptr<const std::string>& event) {
+    static const auto reset = std::make_shared<const std::string>(sse_event("reset", ""));
+    HttpMetrics& metrics = http_metrics();
+    if (conn.events_bytes + event->size() > server->m_options.event_buffer_bytes) {
+        if (conn.events.size() != 1 || conn.events.front() != reset) metrics.sse_coalesced++;
+        conn.events.clear();
+        conn.events.push_back(reset);
+        conn.events_bytes = reset->size();
+    } else {
+        conn.events.push_back(event);
+        conn.events_bytes += event->size();
+        metrics.sse_events++;
+    }
+    // Если сокет занят, события уйдут по EPOLLOUT
+    if (!(conn.watching & EPOLLOUT)) onWritable(conn);
+}
+
+void HttpServer::Reactor::sweepIdle() {
+    uint64_t now = now_ms();
+    std::vector<int> expired;
+    std::vector<int> quiet;
+    for (const auto& [fd, conn] : connections) {
+        if (!conn.channel.empty()) {
+            // Подписчик, который не принимает данные, закрываем; молчащему шлём комментарий,
+            // чтобы прокси и браузер не сочли соединение мёртвым
+            bool pending = conn.out_pos < conn.out.size() || !conn.events.empty();
+            if (pending && now - conn.last_active_ms > (uint64_t)server->m_options.idle_timeout_ms) {
+                expired.push_back(fd);
+            } else if (!pending && now - conn.last_active_ms > (uint64_t)server->m_options.event_heartbeat_ms) {
+                quiet.push_back(fd);
+            }
+            continue;
+        }
+        // Приостановленное тело ждёт сервер, а не клиента
+        if (conn.processing || conn.paused) continue;
+        // Между запросами — короткий таймаут keep-alive, недочитанный запрос — подольше
+        bool between = conn.in.empty() && conn.parser.idle();
+        uint64_t limit = between ? server->m_options.keepalive_timeout_ms : server->m_options.idle_timeout_ms;
+        if (now - conn.last_active_ms > limit) expired.push_back(fd);
+    }
+    for (int fd : expired) {
+        auto it = connections.find(fd);
+        if (it != connections.end() && (!it->second.channel.empty() ||
+                                        !(it->second.in.empty() && it->second.parser.idle()))) {
+            http_metrics().timeouts++;
+        }
+        closeConnection(fd);
+    }
+
+    static const auto heartbeat = std::make_shared<const std::string>(": ping\n\n");
+    for (int fd : quiet) {
+        auto it = connections.find(fd);
+        if (it != connections.end()) pushEvent(it->second, heartbeat);
+    }
+}
+
+// Потоки с общей ограниченной очередью задач. gauge — метрика длины очереди
+struct HttpServer::Pool {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> threads;
+    size_t max_pending;
+    std::atomic<int64_t>& gauge;
+    bool stopping = false;
+
+    Pool(int count, size_t max, std::atomic<int64_t>& queue_gauge, const char* name)
+        : max_pending(max), gauge(queue_gauge) {
+        for (int i = 0; i < std::max(1, count); i++) {
+            threads.emplace_back([this, name] {
+                trace_set_thread_name(name);
+                run();
+            });
+        }
+    }
+
+    // false — очередь полна или пул останавливается
+    bool push(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping || tasks.size() >= max_pending) return false;
+            tasks.push_back(std::move(task));
+            gauge++;
+        }
+        cv.notify_one();
+        return true;
+    }
+
+    // discard — невыполненные задачи выбросить, иначе дождаться их
+    void stop(bool discard) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            if (discard) {
+                gauge -= (int64_t)tasks.size();
+                tasks.clear();
+            }
+        }
+        cv.notify_all();
+        for (auto& thread : threads) {
+            if (thread.joinable()) thread.join();
+        }
+        threads.clear();
+    }
+
+    void run() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return !tasks.empty() || stopping; });
+                if (tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                gauge--;
+            }
+            task();
+        }
+    }
+};
+
+HttpServer::HttpServer(const Options& options, Handler handler, BodyStreamFactory body_streams,
+                       FilePredicate is_file)
+    : m_options(options), m_handler(std::move(handler)), m_body_streams(std::move(body_streams)),
+      m_is_file(std::move(is_file)) {}
+
+HttpServer::~HttpServer() {
+    stop();
+}
+
+bool HttpServer::start() {
+    int reactors = m_options.reactors > 0 ? m_options.reactors
+                                          : std::max(1, (int)std::thread::hardware_concurrency());
+
+    for (int i = 0; i < reactors; i++) {
+        auto reactor = std::make_unique<Reactor>();
+        reactor->server = this;
+        reactor->index = i;
+        if (!reactor->open(m_options.port)) {
+            LOG_ERROR("http", "HTTP server bind failed on port " << m_options.port << ": " << strerror(errno));
+            if (reactor->listen_fd >= 0) close(reactor->listen_fd);
+            if (reactor->epoll_fd >= 0) close(reactor->epoll_fd);
+            if (reactor->event_fd >= 0) close(reactor->event_fd);
+            stop();
+            return false;
+        }
+        m_reactors.push_back(std::move(reactor));
+    }
+
+    HttpMetrics& metrics = http_metrics();
+    m_pool = std::make_unique<Pool>(m_options.workers, m_options.max_pending, metrics.pending, "http-worker");
+    m_file_pool = std::make_unique<Pool>(m_options.file_workers, m_options.max_pending, metrics.pending, "http-file");
+    m_stream_pool = std::make_unique<Pool>(m_options.stream_workers, m_options.max_pending_streams,
+                                           metrics.pending_streams, "http-stream");
+    for (auto& reactor : m_reactors) {
+        reactor->thread = std::thread(&Reactor::run, reactor.get());
+    }
+
+    LOG_INFO("http", "HTTP server started on port " << m_options.port << " (" << reactors << " reactors, "
+             << m_pool->threads.size() << " workers, " << m_file_pool->threads.size() << " file, "
+             << m_stream_pool->threads.size() << " stream)");
+    return true;
+}
+
+void HttpServer::stop() {
+    // Сначала реакторы (новые запросы не приходят, соединения закрыты — потоковые тела
+    // обрываются), потом пулы дорабатывают очереди; ждущие потоковые ответы писать уже некуда
+    for (auto& reactor : m_reactors) {
+        reactor->stopping = true;
+        uint64_t one = 1;
+        ssize_t ignored = write(reactor->event_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+    for (auto& reactor : m_reactors) {
+        if (reactor->thread.joinable()) reactor->thread.join();
+    }
+
+    if (m_stream_pool) m_stream_pool->stop(true);
+    if (m_pool) m_pool->stop(false);
+    if (m_file_pool) m_file_pool->stop(false);
+    m_pool.reset();
+    m_file_pool.reset();
+    m_stream_pool.reset();
+
+    for (auto& reactor : m_reactors) {
+        close(reactor->listen_fd);
+        close(reactor->epoll_fd);
+        close(reactor->event_fd);
+    }
+    m_reactors.clear();
+}
+
+void HttpServer::publish(const std::string& channel, std::string event) {
+    if (m_subscribers.load(std::memory_order_relaxed) == 0) return;
+    auto shared = std::make_shared<const std::string>(std::move(event));
+    for (auto& reactor : m_reactors) {
+        if (reactor->subscribers.load(std::memory_order_relaxed) == 0) continue;
+        reactor->post(Reactor::Completion::broadcast(channel, shared));
+    }
+}
+
+// Файлы и тайлы не ждут за запросами к БД: у них свой пул
+bool HttpServer::dispatch(Job job) {
+    Pool& pool = (m_is_file && !job.body && m_is_file(job.request)) ? *m_file_pool : *m_pool;
+    auto shared = std::make_shared<Job>(std::move(job));
+    return pool.push([this, shared] { handleJob(*shared); });
+}
+
+// Пишет тело потокового ответа chunk'ами в HttpStream соединения. Копит до
+// stream_chunk_bytes (первый chunk — сразу, ради времени до первого байта) и
+// ждёт, пока очередь к сокету не станет меньше stream_buffer_bytes.
+class ChunkWriter : public HttpChunkSink {
+public:
+    ChunkWriter(HttpServer::Reactor* reactor, int fd, uint64_t conn_id, std::shared_ptr<HttpStream> stream,
+                const HttpServer::Options& options)
+        : m_reactor(reactor), m_fd(fd), m_conn_id(conn_id), m_stream(std::move(stream)), m_options(options) {}
+
+    bool write(const char* data, size_t size) override {
+        if (m_broken) return false;
+        m_buffer.append(data, size);
+        size_t threshold = m_sent ? m_options.stream_chunk_bytes : 1;
+        return m_buffer.size() < threshold || flush(false);
+    }
+
+    // Остаток, терминатор "0\r\n\r\n"; failed — оборвать соединение без терминатора
+    void finish(bool failed) {
+        if (m_broken) return;
+        if (failed) {
+            {
+                std::lock_guard<std::mutex> lock(m_stream->mutex);
+                m_stream->failed = true;
+            }
+            wake();
+            return;
+        }
+        flush(true);
+    }
+
+private:
+    bool flush(bool last) {
+        std::string framed;
+        if (!m_buffer.empty()) {
+            char size_line[24];
+            snprintf(size_line, sizeof(size_line), "%zx\r\n", m_buffer.size());
+            framed.reserve(m_buffer.size() + 32);
+            framed += size_line;
+            framed += m_buffer;
+            framed += "\r\n";
+            m_buffer.clear();
+        }
+        if (last) framed += "0\r\n\r\n";
+
+        bool was_empty = false;
+        {
+            std::unique_lock<std::mutex> lock(m_stream->mutex);
+            // Клиент не читает дольше таймаута — дальше не ждём
+            bool ready = m_stream->cv.wait_for(lock, std::chrono::milliseconds(m_options.idle_timeout_ms), [&] {
+                return m_stream->aborted || m_reactor->stopping || m_stream->pending.size() < m_options.stream_buffer_bytes;
+            });
+            if (!ready || m_stream->aborted || m_reactor->stopping) {
+                if (!ready) http_metrics().timeouts++;
+                m_stream->failed = true;
+                m_broken = true;
+            } else {
+                was_empty = m_stream->pending.empty();
+                m_stream->pending += framed;
+                if (last) m_stream->finished = true;
+            }
+        }
+        if (m_broken) {
+            wake();
+            return false;
+        }
+
+        m_sent += framed.size();
+        http_metrics().streamed_bytes += framed.size();
+        // Реактор сам заберёт всё, что накопилось, — будим его только на первый chunk в очереди
+        if (was_empty) wake();
+        return true;
+    }
+
+    void wake() {
+        m_reactor->post(HttpServer::Reactor::Completion::wakeStream(m_fd, m_conn_id, m_stream));
+    }
+
+    HttpServer::Reactor* m_reactor;
+    int m_fd;
+    uint64_t m_conn_id;
+    std::shared_ptr<HttpStream> m_stream;
+    const HttpServer::Options& m_options;
+    std::string m_buffer;
+    size_t m_sent = 0;
+    bool m_broken = false;
+};
+
+// Потоковый ответ: заголовки уходят сразу, тело производит обработчик в потоке пула потоков
+void HttpServer::runStream(Job& job, HttpResponse& response) {
+    TRACE_SPAN("http.stream", "http");
+    http_metrics().streamed_responses++;
+
+    // HTTP/1.0 не знает chunked: собираем тело целиком и отдаём обычным ответом
+    if (job.request.version == "HTTP/1.0") {
+        struct StringSink : HttpChunkSink {
+            std::string body;
+            bool write(const char* data, size_t size) override {
+                body.append(data, size);
+                return true;
+            }
+        } sink;
+        response.stream(sink);
+        response.stream = nullptr;
+        response.body = std::move(sink.body);
+        job.reactor->post(Reactor::Completion::response(job.fd, job.conn_id, response.serialize(job.keep_alive),
+                                                        job.keep_alive));
+        return;
+    }
+
+    auto stream = std::make_shared<HttpStream>();
+    job.reactor->post(Reactor::Completion::response(job.fd, job.conn_id, response.serialize(job.keep_alive),
+                                                    job.keep_alive, nullptr, stream));
+
+    ChunkWriter sink(job.reactor, job.fd, job.conn_id, stream, m_options);
+    bool failed = false;
+    try {
+        response.stream(sink);
+    } catch (const std::exception& e) {
+        // Статус уже ушёл — остаётся оборвать тело, чтобы клиент не принял его за полное
+        LOG_ERROR_RL("http", 10, "HTTP stream error for " << job.request.path << ": " << e.what());
+        failed = true;
+    }
+    sink.finish(failed);
+}
+
+void HttpServer::handleJob(Job& job) {
+    HttpResponse response;
+    {
+        TRACE_SPAN("http.request", "http");
+        try {
+            m_handler(job.request, response, job.body.get());
+        } catch (const std::exception& e) {
+            LOG_ERROR_RL("http", 10, "HTTP handler error for " << job.request.path << ": " << e.what());
+            response = HttpResponse();
+            response.status = 500;
+            response.content_type = "text/plain";
+            response.body = http_status_text(500);
+        }
+    }
+
+    apply_conditional(job.request, response);
+    compress_response(job.request, response, m_options);
+
+    HttpMetrics& metrics = http_metrics();
+    metrics.requests++;
+    if (response.status >= 400) metrics.errors++;
+    metrics.latency.record(metrics_now_ns() - job.start_ns);
+
+    // HEAD: те же заголовки, что у GET, но тело (файл, поток, подписку) не отдаём
+    if (job.request.method == "HEAD") {
+        response.head = true;
+        job.reactor->post(Reactor::Completion::response(job.fd, job.conn_id, response.serialize(job.keep_alive),
+                                                        job.keep_alive));
+        return;
+    }
+
+    if (response.stream) {
+        // Медленный клиент держит поток до idle_timeout_ms — пусть держит не обработчики
+        auto shared_job = std::make_shared<Job>(std::move(job));
+        auto shared_response = std::make_shared<HttpResponse>(std::move(response));
+        if (!m_stream_pool->push([this, shared_job, shared_response] { runStream(*shared_job, *shared_response); })) {
+            metrics.rejected++;
+            shared_job->reactor->post(Reactor::Completion::response(shared_job->fd, shared_job->conn_id,
+                                                                    error_response(503), false));
+        }
+        return;
+    }
+
+    if (!response.event_channel.empty()) {
+        // Подписка живёт до обрыва, соединение потом не переиспользуется
+        job.reactor->post(Reactor::Completion::subscribe(job.fd, job.conn_id, response.serialize(false),
+                                                         std::move(response.event_channel)));
+        return;
+    }
+
+    std::string bytes = response.serialize(job.keep_alive);
+    job.reactor->post(Reactor::Completion::response(job.fd, job.conn_id, std::move(bytes), job.keep_alive,
+                                                    std::move(response.file)));
+}
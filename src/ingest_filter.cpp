@@ -0,0 +1,144 @@
+#include "ingest_filter.hpp"
+#include "metrics.hpp"
+
+IngestFilter ingest_filter_snapshot(const SharedData& shared) {
+    IngestFilter filter;
+    filter.location = shared.filter_location;
+    filter.telephony = shared.filter_telephony;
+    filter.traffic = shared.filter_traffic;
+    filter.lte = shared.filter_lte;
+    filter.gsm = shared.filter_gsm;
+    filter.wcdma = shared.filter_wcdma;
+    return filter;
+}
+
+static bool enabled(const IngestFilter& filter, IngestFilterKind kind) {
+    switch (kind) {
+        case IngestFilterKind::Location: return filter.location;
+        case IngestFilterKind::Telephony: return filter.telephony;
+        case IngestFilterKind::Traffic: return filter.traffic;
+        case IngestFilterKind::Lte: return filter.lte;
+        case IngestFilterKind::Gsm: return filter.gsm;
+        case IngestFilterKind::Wcdma: return filter.wcdma;
+        default: return true;
+    }
+}
+
+// Ключ верхнего уровня записи -> секция (в т.ч. координаты в корне, как понимает DBClient)
+static bool section_of(const std::string& key, IngestFilterKind& kind) {
+    if (key == "location" || key == "latitude" || key == "longitude" ||
+        key == "altitude" || key == "accuracy" || key == "speed") {
+        kind = IngestFilterKind::Location;
+    } else if (key == "telephony" || key == "cellInfo") {
+        kind = IngestFilterKind::Telephony;
+    } else if (key == "traffic") {
+        kind = IngestFilterKind::Traffic;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Технология соты; без поля type определяем так же, как DBClient::importJsonData
+static bool technology_of(const json& cell, IngestFilterKind& kind) {
+    std::string type;
+    auto it = cell.find("type");
+    if (it != cell.end() && it->is_string()) {
+        type = it->get<std::string>();
+    } else if (cell.contains("pci") && cell.contains("rsrp")) {
+        type = "LTE";
+    } else if (cell.contains("dbm") && !cell.contains("rsrp")) {
+        type = "GSM";
+    }
+
+    if (type == "LTE") kind = IngestFilterKind::Lte;
+    else if (type == "GSM") kind = IngestFilterKind::Gsm;
+    else if (type == "WCDMA") kind = IngestFilterKind::Wcdma;
+    else return false;
+    return true;
+}
+
+static bool has_payload(const json& record) {
+    for (const char* key : {"location", "telephony", "cellInfo", "traffic", "latitude", "longitude"}) {
+        if (record.contains(key)) return true;
+    }
+    return false;
+}
+
+bool parse_filtered(const char* data, size_t size, const IngestFilter& filter, json& out) {
+    if (filter.passesAll()) {
+        out = json::parse(data, data + size);
+        return true;
+    }
+
+    IngestMetrics& metrics = ingest_metrics();
+
+    // Глубина записи: 0 для одиночного объекта, 1 для элементов массива
+    int base = 0;
+    bool in_telephony = false;
+    bool had_payload = false;
+    unsigned dropped_sections = 0;
+    int dropped_cells = 0;
+
+    json::parser_callback_t callback = [&](int depth, json::parse_event_t event, json& parsed) {
+        if (depth == 0 && event == json::parse_event_t::array_start) {
+            base = 1;
+            return true;
+        }
+
+        if (depth == base && event == json::parse_event_t::object_start) {
+            in_telephony = false;
+            had_payload = false;
+            dropped_sections = 0;
+            dropped_cells = 0;
+            return true;
+        }
+
+        // Секции верхнего уровня: отброшенный ключ не строится в DOM вместе со значением
+        if (depth == base + 1 && event == json::parse_event_t::key) {
+            const std::string& key = parsed.get_ref<const std::string&>();
+            in_telephony = key == "telephony";
+
+            IngestFilterKind kind;
+            if (!section_of(key, kind)) return true;
+            had_payload = true;
+            if (enabled(filter, kind)) return true;
+
+            dropped_sections |= 1u << (int)kind;
+            return false;
+        }
+
+        // Соты внутри telephony: тип известен только после разбора объекта соты
+        if (in_telephony && depth == base + 2 && event == json::parse_event_t::object_end) {
+            IngestFilterKind kind;
+            if (technology_of(parsed, kind) && !enabled(filter, kind)) {
+                metrics.filtered[(int)kind]++;
+                dropped_cells++;
+                return false;
+            }
+            return true;
+        }
+
+        // Телефония, из которой выкинули все соты, не нужна
+        if (in_telephony && depth == base + 1 && event == json::parse_event_t::object_end) {
+            return !(parsed.empty() && dropped_cells > 0);
+        }
+
+        if (depth == base && event == json::parse_event_t::object_end) {
+            for (int k = 0; k < (int)IngestFilterKind::Count; k++) {
+                if (dropped_sections & (1u << k)) metrics.filtered[k]++;
+            }
+            if (had_payload && !has_payload(parsed)) {
+                metrics.filtered_records++;
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Отброшенный целиком верхний уровень парсер возвращает как null
+    out = json::parse(data, data + size, callback);
+    if (out.is_null()) return false;
+    if (out.is_array() && out.empty()) return false;
+    return true;
+}
@@ -0,0 +1,245 @@
+#include "ingest_pipeline.hpp"
+#include "db_client.hpp"
+#include "point_index.hpp"
+#include "publisher.hpp"
+#include "response_cache.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+// Сколько записей поток сохранения забирает за раз: одна перезапись журнала на пачку
+static const size_t kMaxBatch = 64;
+
+IngestPipeline::IngestPipeline(SharedData* shared, DBClient* db, MeasurementPublisher* publisher,
+                               std::unique_ptr<SamplingPolicy> policy, size_t capacity)
+    : m_shared(shared), m_db(db), m_publisher(publisher), m_capacity(std::max<size_t>(1, capacity)),
+      m_policy(std::move(policy)) {
+    {
+        std::lock_guard<std::mutex> lock(shared->data_mutex);
+        m_next_seq = shared->counter;
+    }
+    m_worker = std::thread(&IngestPipeline::workerLoop, this);
+}
+
+IngestPipeline::~IngestPipeline() {
+    stop();
+}
+
+void IngestPipeline::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_not_empty.notify_all();
+    m_not_full.notify_all();
+    if (m_worker.joinable()) m_worker.join();
+}
+
+void IngestPipeline::setBatchListener(BatchListener listener) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_listener = std::move(listener);
+}
+
+size_t IngestPipeline::depth() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queue.size();
+}
+
+long long IngestPipeline::submit(json data) {
+    std::vector<json> records;
+    if (data.is_array()) {
+        for (auto& item : data) {
+            if (item.is_object()) records.push_back(std::move(item));
+        }
+    } else if (data.is_object()) {
+        records.push_back(std::move(data));
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (auto& record : records) {
+        m_not_full.wait(lock, [&] { return m_queue.size() < m_capacity || m_stopping; });
+        m_queue.push_back({std::move(record), ++m_next_seq});
+        ingest_metrics().queue_depth++;
+        m_not_empty.notify_one();
+    }
+    return m_next_seq.load();
+}
+
+bool IngestPipeline::trySubmit(json& record, long long& seq) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_queue.size() >= m_capacity && !m_stopping) return false;
+    seq = ++m_next_seq;
+    m_queue.push_back({std::move(record), seq});
+    ingest_metrics().queue_depth++;
+    m_not_empty.notify_one();
+    return true;
+}
+
+SamplingAdvice IngestPipeline::advise(const std::string& imei, int records) {
+    SamplingSignals signals;
+    signals.queue_depth = depth();
+    signals.queue_capacity = m_capacity;
+    signals.db_latency_ns = m_db_latency_ns.load(std::memory_order_relaxed);
+
+    SamplingAdvice advice;
+    {
+        std::lock_guard<std::mutex> lock(m_policy_mutex);
+        // Время — под блокировкой: иначе трекер получал бы моменты не по порядку
+        uint64_t now = metrics_now_ns();
+        const std::string& key = imei.empty() ? "unknown" : imei;
+        signals.device_rate = records > 0 ? m_rates.observe(key, now, records) : m_rates.rate(key);
+        signals.total_rate = m_rates.totalRate(now);
+        signals.active_devices = m_rates.activeDevices(now);
+        if (m_policy) advice = m_policy->advise(signals);
+    }
+
+    IngestMetrics& metrics = ingest_metrics();
+    metrics.advised_interval_ms = advice.interval_ms;
+    metrics.advised_batch = advice.batch;
+    metrics.active_devices = signals.active_devices;
+    return advice;
+}
+
+void IngestPipeline::workerLoop() {
+    trace_set_thread_name("ingest-store");
+
+    std::vector<Pending> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_not_empty.wait(lock, [&] { return !m_queue.empty() || m_stopping; });
+            if (m_queue.empty()) break; // остановка, и всё уже сохранено
+
+            size_t n = std::min(m_queue.size(), kMaxBatch);
+            for (size_t i = 0; i < n; i++) {
+                batch.push_back(std::move(m_queue.front()));
+                m_queue.pop_front();
+            }
+        }
+        m_not_full.notify_all();
+
+        store(batch);
+        ingest_metrics().queue_depth -= (int64_t)batch.size();
+        batch.clear();
+    }
+}
+
+void IngestPipeline::store(std::vector<Pending>& batch) {
+    TRACE_SPAN("ingest.store", "ingest");
+    IngestMetrics& metrics = ingest_metrics();
+
+    // Сохраняем в БД через DBClient
+    if (m_db && m_db->isConnected()) {
+        std::vector<StoredPoint> points;
+        for (const auto& p : batch) {
+            uint64_t start = metrics_now_ns();
+            if (!m_db->importJsonData(p.record, &points)) metrics.errors++;
+            record_stage(IngestStage::DbInsert, start);
+
+            // Сглаженное время сохранения одной записи — сигнал для политики выборки
+            uint64_t dur = metrics_now_ns() - start;
+            uint64_t prev = m_db_latency_ns.load(std::memory_order_relaxed);
+            m_db_latency_ns.store(prev ? prev + ((int64_t)dur - (int64_t)prev) / 8 : dur,
+                                  std::memory_order_relaxed);
+        }
+        // Индекс точек дополняется сохранёнными строками, без повторного чтения БД;
+        // до смены поколения — чтобы индекс нового поколения их уже содержал
+        point_index_append(std::move(points));
+        // Кэшированные ответы API больше не отражают БД
+        bump_data_generation();
+    }
+
+    // Сохраняем в JSON файлы (для совместимости со старым кодом)
+    {
+        StageTimer timer(IngestStage::Journal);
+        try {
+            journal(batch);
+        } catch (const std::exception& e) {
+            LOG_ERROR_RL("server", 10, "Journal write failed: " << e.what());
+        }
+    }
+
+    // Также сохраняем в память для GUI и рассылаем подписчикам
+    {
+        StageTimer timer(IngestStage::Publish);
+        {
+            std::lock_guard<std::mutex> lock(m_shared->data_mutex);
+            for (const auto& p : batch) {
+                m_shared->recent_records.push_back(p.record);
+                if (m_shared->recent_records.size() > (size_t)m_shared->max_history) {
+                    m_shared->recent_records.pop_front();
+                }
+                m_shared->counter = (int)p.seq;
+            }
+        }
+        if (m_publisher) {
+            for (const auto& p : batch) m_publisher->publish(p.record, p.seq);
+        }
+
+        BatchListener listener;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            listener = m_listener;
+        }
+        if (listener) {
+            std::vector<const json*> records;
+            records.reserve(batch.size());
+            for (const auto& p : batch) records.push_back(&p.record);
+            listener(records, batch.back().seq);
+        }
+    }
+
+    LOG_INFO_RL("server", 1, "Data #" << batch.back().seq << " saved");
+}
+
+// Файл журнала — один JSON-массив, поэтому дописывание = перезапись целиком.
+// Пишем рядом и переименовываем: сервер отдаёт эти файлы (в т.ч. через mmap), и
+// усечение на месте под отображением дало бы SIGBUS или полуписаный ответ
+static void append_json_array(const std::string& path, const std::vector<json>& items) {
+    if (items.empty()) return;
+
+    json all = json::array();
+    std::ifstream in(path);
+    if (in.is_open()) {
+        try {
+            all = json::parse(in);
+        } catch (...) {
+            all = json::array();
+        }
+        if (!all.is_array()) all = json::array();
+    }
+
+    for (const auto& item : items) all.push_back(item);
+
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp);
+        out << all.dump(4);
+        if (!out.flush()) throw std::runtime_error("cannot write " + tmp);
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("cannot replace " + path);
+    }
+}
+
+void IngestPipeline::journal(const std::vector<Pending>& batch) {
+    std::vector<json> all, locations, telephony, traffic;
+    for (const auto& p : batch) {
+        const json& r = p.record;
+        long long timestamp = r.value("timestamp", 0LL);
+        all.push_back(r);
+        if (r.contains("location")) locations.push_back({{"timestamp", timestamp}, {"location", r["location"]}});
+        if (r.contains("telephony")) telephony.push_back({{"timestamp", timestamp}, {"telephony", r["telephony"]}});
+        if (r.contains("traffic")) traffic.push_back({{"timestamp", timestamp}, {"traffic", r["traffic"]}});
+    }
+
+    append_json_array("data/all_data.json", all);
+    append_json_array("data/locations.json", locations);
+    append_json_array("data/telephony.json", telephony);
+    append_json_array("data/traffic.json", traffic);
+}
@@ -0,0 +1,91 @@
+#include "json_writer.hpp"
+#include <nlohmann/json.hpp>
+#include <charconv>
+#include <cmath>
+
+void JsonWriter::key(std::string_view name) {
+    separator();
+    json_append_string(m_out, name);
+    m_out += ':';
+    m_after_key = true;
+}
+
+void JsonWriter::value(long long v) {
+    separator();
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    m_out.append(buf, res.ptr - buf);
+}
+
+void JsonWriter::value(unsigned long long v) {
+    separator();
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    m_out.append(buf, res.ptr - buf);
+}
+
+void JsonWriter::value(double v) {
+    separator();
+    json_append_double(m_out, v);
+}
+
+void JsonWriter::value(bool v) {
+    separator();
+    m_out += v ? "true" : "false";
+}
+
+void JsonWriter::value(std::string_view v) {
+    separator();
+    json_append_string(m_out, v);
+}
+
+void JsonWriter::null() {
+    separator();
+    m_out += "null";
+}
+
+void JsonWriter::raw(std::string_view json) {
+    separator();
+    m_out.append(json.data(), json.size());
+}
+
+// Те же цифры, что у json::dump(): его grisu2 не всегда даёт кратчайшую запись
+// (146.87604853162549 против 146.8760485316255 у std::to_chars), поэтому для
+// double берём форматтер самой библиотеки — без дерева и без аллокаций
+void json_append_double(std::string& out, double v) {
+    if (!std::isfinite(v)) {
+        out += "null";
+        return;
+    }
+    char buf[64];
+    char* end = nlohmann::detail::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, end - buf);
+}
+
+void json_append_string(std::string& out, std::string_view s) {
+    static const char* hex = "0123456789abcdef";
+    out += '"';
+    size_t plain = 0;
+    for (size_t i = 0; i < s.size(); i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        out.append(s.data() + plain, i - plain);
+        plain = i + 1;
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 15];
+        }
+    }
+    out.append(s.data() + plain, s.size() - plain);
+    out += '"';
+}
@@ -0,0 +1,203 @@
+#include "logger.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+std::atomic<int> g_log_level{(int)LogLevel::Info};
+
+struct LogRecord {
+    int64_t time_us = 0;
+    uint64_t seq = 0;
+    LogLevel level = LogLevel::Info;
+    const char* component = "";
+    int thread = 0;
+    std::string message;
+};
+
+// Очередь одного потока (SPSC): пишет поток-владелец, читает только сбрасывающий поток
+struct LogQueue {
+    static constexpr uint64_t kCapacity = 4096;
+
+    int thread = 0;
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    LogRecord slots[kCapacity];
+};
+
+static std::mutex g_queues_mutex;
+static std::vector<std::shared_ptr<LogQueue>> g_queues;
+static std::atomic<uint64_t> g_seq{0};
+static std::atomic<uint64_t> g_dropped{0};
+
+static std::mutex g_flusher_mutex;
+static std::condition_variable g_flusher_cv;
+static std::thread g_flusher;
+static bool g_flusher_stop = false;
+
+static thread_local LogQueue* t_queue = nullptr;
+
+static const char* level_name(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "DEBUG";
+        case LogLevel::Info: return "INFO ";
+        case LogLevel::Warn: return "WARN ";
+        case LogLevel::Error: return "ERROR";
+        default: return "?    ";
+    }
+}
+
+void log_set_level(LogLevel level) {
+    g_log_level.store((int)level, std::memory_order_relaxed);
+}
+
+bool log_parse_level(const std::string& name, LogLevel& level) {
+    if (name == "debug") level = LogLevel::Debug;
+    else if (name == "info") level = LogLevel::Info;
+    else if (name == "warn") level = LogLevel::Warn;
+    else if (name == "error") level = LogLevel::Error;
+    else if (name == "off") level = LogLevel::Off;
+    else return false;
+    return true;
+}
+
+bool LogRateLimit::allow(uint32_t per_second, uint64_t& suppressed) {
+    int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    int64_t window = m_window.load(std::memory_order_relaxed);
+    if (window != now && m_window.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+        m_count.store(0, std::memory_order_relaxed);
+    }
+
+    if (m_count.fetch_add(1, std::memory_order_relaxed) < per_second) {
+        suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    m_suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+static void format_record(const LogRecord& r, std::string& out) {
+    time_t secs = (time_t)(r.time_us / 1000000);
+    struct tm tm_info;
+    localtime_r(&secs, &tm_info);
+
+    char prefix[96];
+    size_t n = strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S", &tm_info);
+    snprintf(prefix + n, sizeof(prefix) - n, ".%03d %s [%s] t%d: ",
+             (int)(r.time_us / 1000 % 1000), level_name(r.level), r.component, r.thread);
+
+    out += prefix;
+    out += r.message;
+    out += '\n';
+}
+
+// Забирает всё накопленное из очередей и печатает одним блоком на поток вывода
+static void drain_queues() {
+    std::vector<std::shared_ptr<LogQueue>> queues;
+    {
+        std::lock_guard<std::mutex> lock(g_queues_mutex);
+        queues = g_queues;
+    }
+
+    std::vector<LogRecord> batch;
+    for (auto& q : queues) {
+        uint64_t tail = q->tail.load(std::memory_order_relaxed);
+        uint64_t head = q->head.load(std::memory_order_acquire);
+        for (; tail < head; tail++) {
+            batch.push_back(std::move(q->slots[tail & (LogQueue::kCapacity - 1)]));
+        }
+        q->tail.store(tail, std::memory_order_release);
+    }
+
+    uint64_t dropped = g_dropped.exchange(0, std::memory_order_relaxed);
+    if (batch.empty() && !dropped) return;
+
+    std::sort(batch.begin(), batch.end(),
+              [](const LogRecord& a, const LogRecord& b) { return a.seq < b.seq; });
+
+    std::string out, err;
+    for (const auto& r : batch) {
+        format_record(r, r.level >= LogLevel::Warn ? err : out);
+    }
+    if (dropped) {
+        err += "log: " + std::to_string(dropped) + " records dropped (queue full)\n";
+    }
+
+    if (!out.empty()) {
+        fwrite(out.data(), 1, out.size(), stdout);
+        fflush(stdout);
+    }
+    if (!err.empty()) {
+        fwrite(err.data(), 1, err.size(), stderr);
+        fflush(stderr);
+    }
+}
+
+static void flusher_loop() {
+    std::unique_lock<std::mutex> lock(g_flusher_mutex);
+    while (!g_flusher_stop) {
+        g_flusher_cv.wait_for(lock, std::chrono::milliseconds(50));
+        lock.unlock();
+        drain_queues();
+        lock.lock();
+    }
+}
+
+static LogQueue* register_queue() {
+    auto queue = std::make_shared<LogQueue>();
+
+    std::lock_guard<std::mutex> lock(g_queues_mutex);
+    queue->thread = (int)g_queues.size();
+    g_queues.push_back(queue);
+
+    {
+        std::lock_guard<std::mutex> flock(g_flusher_mutex);
+        if (!g_flusher.joinable() && !g_flusher_stop) g_flusher = std::thread(flusher_loop);
+    }
+
+    t_queue = queue.get();
+    return t_queue;
+}
+
+void log_write(LogLevel level, const char* component, std::string message) {
+    LogQueue* q = t_queue ? t_queue : register_queue();
+
+    uint64_t head = q->head.load(std::memory_order_relaxed);
+    if (head - q->tail.load(std::memory_order_acquire) >= LogQueue::kCapacity) {
+        g_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    LogRecord& r = q->slots[head & (LogQueue::kCapacity - 1)];
+    r.time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    r.seq = g_seq.fetch_add(1, std::memory_order_relaxed);
+    r.level = level;
+    r.component = component;
+    r.thread = q->thread;
+    r.message = std::move(message);
+
+    q->head.store(head + 1, std::memory_order_release);
+}
+
+void log_shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(g_flusher_mutex);
+        g_flusher_stop = true;
+    }
+    g_flusher_cv.notify_all();
+    if (g_flusher.joinable()) g_flusher.join();
+    drain_queues();
+}
+
+// Если выход произошёл без log_shutdown(), дописываем хвост до разрушения g_flusher
+static struct LogShutdownGuard {
+    ~LogShutdownGuard() { log_shutdown(); }
+} g_log_shutdown_guard;
@@ -1,17 +1,149 @@
 #include "server.hpp"
+#ifndef HEAPMAP_HEADLESS
 #include "heatmap.hpp"
+#endif
+#include "replay.hpp"
+#include "http_bench.hpp"
+#include "trace.hpp"
+#include "logger.hpp"
 #include <thread>
+#include <string>
+#include <cstdlib>
+#include <cctype>
+#include <csignal>
 
 using namespace std;
 
-int main() {
+static void on_stop_signal(int) {
+    request_shutdown();
+}
+
+int main(int argc, char** argv) {
+    ReplayOptions replay;
+    bool replay_mode = false;
+    HttpBenchOptions bench;
+    bool bench_mode = false;
+    int points_bench = 0;
+#ifdef HEAPMAP_HEADLESS
+    bool headless = true;
+#else
+    bool headless = false;
+#endif
+    bool gui_only = false;
     SharedData shared;
     
-    thread gui_thread(run_gui, &shared);
-    thread server_thread(run_server, &shared);
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        
+        if (arg == "--replay" && has_value) {
+            replay_mode = true;
+            replay.path = argv[++i];
+        } else if (arg == "--speed" && has_value) {
+            string v = argv[++i];
+            replay.speed = (v == "max") ? 0.0 : atof(v.c_str());
+        } else if (arg == "--streams" && has_value) {
+            replay.streams = max(1, atoi(argv[++i]));
+        } else if (arg == "--loops" && has_value) {
+            replay.loops = max(1, atoi(argv[++i]));
+        } else if (arg == "--endpoint" && has_value) {
+            replay.endpoint = argv[++i];
+        } else if (arg == "--keep-timestamps") {
+            replay.rebase_timestamps = false;
+        } else if (arg == "--trace") {
+            trace_set_enabled(true);
+        } else if (arg == "--log-level" && has_value) {
+            LogLevel level;
+            if (log_parse_level(argv[++i], level)) log_set_level(level);
+        } else if (arg == "--headless") {
+            headless = true;
+        } else if (arg == "--gui-only") {
+            gui_only = true;
+            shared.remote_gui = true;
+        } else if (arg == "--server" && has_value) {
+            shared.server_host = argv[++i];
+        } else if (arg == "--sampling" && has_value) {
+            shared.sampling_policy = argv[++i];
+        } else if (arg == "--gzip-level" && has_value) {
+            shared.http_compression_level = max(0, min(9, atoi(argv[++i])));
+        } else if (arg == "--adaptive") {
+            replay.adaptive = true;
+        } else if (arg == "--http-bench") {
+            bench_mode = true;
+            // Необязательный путь; без него — пачка тайлов
+            if (has_value && argv[i + 1][0] == '/') bench.paths.push_back(argv[++i]);
+        } else if (arg == "--bench-host" && has_value) {
+            bench.host = argv[++i];
+        } else if (arg == "--bench-connections" && has_value) {
+            bench.connections = max(1, atoi(argv[++i]));
+        } else if (arg == "--bench-rounds" && has_value) {
+            bench.rounds = max(1, atoi(argv[++i]));
+        } else if (arg == "--bench-pipeline" && has_value) {
+            bench.pipeline = max(1, atoi(argv[++i]));
+        } else if (arg == "--points-bench") {
+            points_bench = has_value && isdigit((unsigned char)argv[i + 1][0]) ? atoi(argv[++i]) : 10000;
+        } else if (arg == "--no-keep-alive") {
+            bench.keep_alive = false;
+        }
+    }
+    
+    // Режим воспроизведения: работает как обычное устройство против запущенного сервера
+    if (replay_mode) {
+        int rc = run_replay(replay);
+        log_shutdown();
+        return rc;
+    }
+    
+    if (points_bench > 0) {
+        int rc = run_points_bench(points_bench);
+        log_shutdown();
+        return rc;
+    }
+    
+    if (bench_mode) {
+        int rc = run_http_bench(bench);
+        log_shutdown();
+        return rc;
+    }
+    
+    signal(SIGINT, on_stop_signal);
+    signal(SIGTERM, on_stop_signal);
+    signal(SIGPIPE, SIG_IGN);
+    trace_install_signal_handler();
+    
+#ifndef HEAPMAP_HEADLESS
+    // Отдельный процесс GUI, подключённый к уже работающему серверу
+    if (gui_only) {
+        thread feed_thread(run_remote_feed, &shared);
+        run_gui(&shared);
+        request_shutdown();
+        feed_thread.join();
+        log_shutdown();
+        return 0;
+    }
+    
+    if (!headless) {
+        thread gui_thread(run_gui, &shared);
+        thread server_thread(run_server, &shared);
+        
+        gui_thread.join();
+        server_thread.join();
+        
+        log_shutdown();
+        return 0;
+    }
+#else
+    (void)headless; // в этой сборке GUI нет вовсе
+    if (gui_only) {
+        LOG_ERROR("main", "This build has no GUI (HEAPMAP_HEADLESS)");
+        log_shutdown();
+        return 1;
+    }
+#endif
     
-    gui_thread.join();
-    server_thread.join();
+    // Без GUI: приём, БД и HTTP; остановка по SIGINT/SIGTERM
+    run_server(&shared);
     
+    log_shutdown();
     return 0;
 }
\ No newline at end of file
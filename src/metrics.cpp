@@ -0,0 +1,248 @@
+#include "metrics.hpp"
+#include "trace.hpp"
+#include <cstdio>
+#include <sstream>
+
+int LatencyHistogram::bucket_index(uint64_t ns) {
+    if (ns < (uint64_t)kSubCount) return (int)ns;
+    int msb = 63 - __builtin_clzll(ns);
+    int shift = msb - kSubBits;
+    int group = shift + 1;
+    int sub = (int)((ns >> shift) & (kSubCount - 1));
+    return group * kSubCount + sub;
+}
+
+uint64_t LatencyHistogram::bucket_upper(int index) {
+    int group = index / kSubCount;
+    int sub = index % kSubCount;
+    if (group == 0) return (uint64_t)sub;
+    int shift = group - 1;
+    uint64_t lower = (uint64_t)(kSubCount + sub) << shift;
+    return lower + ((1ULL << shift) - 1);
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+    m_buckets[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(ns, std::memory_order_relaxed);
+
+    uint64_t prev = m_max.load(std::memory_order_relaxed);
+    while (ns > prev && !m_max.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+    uint64_t total = count();
+    if (total == 0) return 0;
+
+    uint64_t target = (uint64_t)(q * total);
+    if (target >= total) target = total - 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; i++) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen > target) return bucket_upper(i);
+    }
+    return max();
+}
+
+uint64_t LatencyHistogram::count_le(uint64_t ns) const {
+    int last = bucket_index(ns);
+    uint64_t seen = 0;
+    for (int i = 0; i <= last; i++) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+    }
+    return seen;
+}
+
+const char* stage_name(IngestStage stage) {
+    switch (stage) {
+        case IngestStage::Dispatch: return "dispatch";
+        case IngestStage::Parse: return "parse";
+        case IngestStage::DbInsert: return "db_insert";
+        case IngestStage::Journal: return "journal";
+        case IngestStage::Publish: return "publish";
+        case IngestStage::Reply: return "reply";
+        default: return "unknown";
+    }
+}
+
+const char* filter_kind_name(IngestFilterKind kind) {
+    switch (kind) {
+        case IngestFilterKind::Location: return "location";
+        case IngestFilterKind::Telephony: return "telephony";
+        case IngestFilterKind::Traffic: return "traffic";
+        case IngestFilterKind::Lte: return "lte";
+        case IngestFilterKind::Gsm: return "gsm";
+        case IngestFilterKind::Wcdma: return "wcdma";
+        default: return "unknown";
+    }
+}
+
+IngestMetrics& ingest_metrics() {
+    static IngestMetrics metrics;
+    return metrics;
+}
+
+HttpMetrics& http_metrics() {
+    static HttpMetrics metrics;
+    return metrics;
+}
+
+void record_stage(IngestStage stage, uint64_t start_ns) {
+    uint64_t dur = metrics_now_ns() - start_ns;
+    ingest_metrics().stage(stage).record(dur);
+    if (trace_enabled()) trace_complete(stage_name(stage), "ingest", start_ns, dur);
+}
+
+// Границы le для экспорта, в секундах
+static const double kExportBounds[] = {
+    0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005,
+    0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+    0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0
+};
+
+// Ряды одной гистограммы; labels — "stage=\"parse\"," или пусто
+static void render_histogram(std::ostringstream& out, const char* metric, const std::string& labels,
+                             const LatencyHistogram& h) {
+    char num[64];
+    for (double bound : kExportBounds) {
+        snprintf(num, sizeof(num), "%g", bound);
+        out << metric << "_bucket{" << labels << "le=\"" << num << "\"} " << h.count_le((uint64_t)(bound * 1e9)) << "\n";
+    }
+    out << metric << "_bucket{" << labels << "le=\"+Inf\"} " << h.count() << "\n";
+
+    std::string plain = labels.empty() ? "" : "{" + labels.substr(0, labels.size() - 1) + "}";
+    snprintf(num, sizeof(num), "%.9f", h.sum() / 1e9);
+    out << metric << "_sum" << plain << " " << num << "\n";
+    out << metric << "_count" << plain << " " << h.count() << "\n";
+}
+
+std::string render_prometheus_metrics() {
+    IngestMetrics& m = ingest_metrics();
+    std::ostringstream out;
+
+    out << "# HELP heapmap_ingest_stage_seconds Time spent in each ingest stage\n";
+    out << "# TYPE heapmap_ingest_stage_seconds histogram\n";
+    for (int s = 0; s < (int)IngestStage::Count; s++) {
+        std::string labels = std::string("stage=\"") + stage_name((IngestStage)s) + "\",";
+        render_histogram(out, "heapmap_ingest_stage_seconds", labels, m.stages[s]);
+    }
+
+    out << "# HELP heapmap_ingest_messages_total Data messages received\n";
+    out << "# TYPE heapmap_ingest_messages_total counter\n";
+    out << "heapmap_ingest_messages_total " << m.messages.load() << "\n";
+    out << "# HELP heapmap_ingest_bytes_total Payload bytes received\n";
+    out << "# TYPE heapmap_ingest_bytes_total counter\n";
+    out << "heapmap_ingest_bytes_total " << m.bytes.load() << "\n";
+    out << "# HELP heapmap_ingest_errors_total Messages answered with ERROR\n";
+    out << "# TYPE heapmap_ingest_errors_total counter\n";
+    out << "heapmap_ingest_errors_total " << m.errors.load() << "\n";
+    out << "# HELP heapmap_ingest_queue_depth Records accepted but not yet stored\n";
+    out << "# TYPE heapmap_ingest_queue_depth gauge\n";
+    out << "heapmap_ingest_queue_depth " << m.queue_depth.load() << "\n";
+    out << "# HELP heapmap_publish_messages_total Messages sent on the PUB socket\n";
+    out << "# TYPE heapmap_publish_messages_total counter\n";
+    out << "heapmap_publish_messages_total " << m.published.load() << "\n";
+    out << "# HELP heapmap_publish_bytes_total Bytes sent on the PUB socket\n";
+    out << "# TYPE heapmap_publish_bytes_total counter\n";
+    out << "heapmap_publish_bytes_total " << m.published_bytes.load() << "\n";
+    out << "# HELP heapmap_ingest_filtered_total Sections (location/telephony/traffic) or cells (lte/gsm/wcdma) dropped by ingest filters\n";
+    out << "# TYPE heapmap_ingest_filtered_total counter\n";
+    for (int k = 0; k < (int)IngestFilterKind::Count; k++) {
+        out << "heapmap_ingest_filtered_total{filter=\"" << filter_kind_name((IngestFilterKind)k) << "\"} "
+            << m.filtered[k].load() << "\n";
+    }
+    out << "# HELP heapmap_ingest_filtered_records_total Records with nothing left after filtering (not stored or published)\n";
+    out << "# TYPE heapmap_ingest_filtered_records_total counter\n";
+    out << "heapmap_ingest_filtered_records_total " << m.filtered_records.load() << "\n";
+    out << "# HELP heapmap_sampling_interval_ms Sample interval last advised to a device\n";
+    out << "# TYPE heapmap_sampling_interval_ms gauge\n";
+    out << "heapmap_sampling_interval_ms " << m.advised_interval_ms.load() << "\n";
+    out << "# HELP heapmap_sampling_batch Records per message last advised to a device\n";
+    out << "# TYPE heapmap_sampling_batch gauge\n";
+    out << "heapmap_sampling_batch " << m.advised_batch.load() << "\n";
+    out << "# HELP heapmap_ingest_active_devices Devices seen in the last 30 seconds\n";
+    out << "# TYPE heapmap_ingest_active_devices gauge\n";
+    out << "heapmap_ingest_active_devices " << m.active_devices.load() << "\n";
+    out << "# HELP heapmap_raw_records_total Records received by the raw TCP/UDP listener\n";
+    out << "# TYPE heapmap_raw_records_total counter\n";
+    out << "heapmap_raw_records_total{transport=\"tcp\"} " << m.raw_tcp_frames.load() << "\n";
+    out << "heapmap_raw_records_total{transport=\"udp\"} " << m.raw_udp_datagrams.load() << "\n";
+    out << "# HELP heapmap_raw_lost_total Records missing according to per-source sequence gaps\n";
+    out << "# TYPE heapmap_raw_lost_total counter\n";
+    out << "heapmap_raw_lost_total " << m.raw_lost.load() << "\n";
+    out << "# HELP heapmap_raw_out_of_order_total Records that arrived behind their source sequence (duplicates or reordering)\n";
+    out << "# TYPE heapmap_raw_out_of_order_total counter\n";
+    out << "heapmap_raw_out_of_order_total " << m.raw_out_of_order.load() << "\n";
+
+    HttpMetrics& http = http_metrics();
+    out << "# HELP heapmap_http_request_seconds Time from a complete HTTP request to its response\n";
+    out << "# TYPE heapmap_http_request_seconds histogram\n";
+    render_histogram(out, "heapmap_http_request_seconds", "", http.latency);
+    out << "# HELP heapmap_http_requests_total HTTP requests handled\n";
+    out << "# TYPE heapmap_http_requests_total counter\n";
+    out << "heapmap_http_requests_total " << http.requests.load() << "\n";
+    out << "# HELP heapmap_http_errors_total HTTP responses with status 4xx or 5xx\n";
+    out << "# TYPE heapmap_http_errors_total counter\n";
+    out << "heapmap_http_errors_total " << http.errors.load() << "\n";
+    out << "# HELP heapmap_http_connections Open HTTP connections\n";
+    out << "# TYPE heapmap_http_connections gauge\n";
+    out << "heapmap_http_connections " << http.connections.load() << "\n";
+    out << "# HELP heapmap_http_pending_requests Requests waiting for a worker\n";
+    out << "# TYPE heapmap_http_pending_requests gauge\n";
+    out << "heapmap_http_pending_requests " << http.pending.load() << "\n";
+    out << "# HELP heapmap_http_pending_streams Streamed responses waiting for a stream thread\n";
+    out << "# TYPE heapmap_http_pending_streams gauge\n";
+    out << "heapmap_http_pending_streams " << http.pending_streams.load() << "\n";
+    out << "# HELP heapmap_http_rejected_total Connections or requests refused with 503 over limits\n";
+    out << "# TYPE heapmap_http_rejected_total counter\n";
+    out << "heapmap_http_rejected_total " << http.rejected.load() << "\n";
+    out << "# HELP heapmap_http_timeouts_total Connections closed with an incomplete request after the idle timeout\n";
+    out << "# TYPE heapmap_http_timeouts_total counter\n";
+    out << "heapmap_http_timeouts_total " << http.timeouts.load() << "\n";
+    out << "# HELP heapmap_http_file_cache_total Static file lookups by result (miss reopens the file)\n";
+    out << "# TYPE heapmap_http_file_cache_total counter\n";
+    out << "heapmap_http_file_cache_total{result=\"hit\"} " << http.file_cache_hits.load() << "\n";
+    out << "heapmap_http_file_cache_total{result=\"miss\"} " << http.file_cache_misses.load() << "\n";
+    out << "# HELP heapmap_http_file_mapped_bytes Static files held in memory (mmap)\n";
+    out << "# TYPE heapmap_http_file_mapped_bytes gauge\n";
+    out << "heapmap_http_file_mapped_bytes " << http.file_mapped_bytes.load() << "\n";
+    out << "# HELP heapmap_http_file_bytes_total Static file body bytes sent via sendfile or from mmap\n";
+    out << "# TYPE heapmap_http_file_bytes_total counter\n";
+    out << "heapmap_http_file_bytes_total " << http.file_bytes.load() << "\n";
+    out << "# HELP heapmap_http_response_cache_total API response cache lookups by result (coalesced waited for a concurrent build)\n";
+    out << "# TYPE heapmap_http_response_cache_total counter\n";
+    out << "heapmap_http_response_cache_total{result=\"hit\"} " << http.response_cache_hits.load() << "\n";
+    out << "heapmap_http_response_cache_total{result=\"miss\"} " << http.response_cache_misses.load() << "\n";
+    out << "heapmap_http_response_cache_total{result=\"coalesced\"} " << http.response_cache_coalesced.load() << "\n";
+    out << "# HELP heapmap_http_compressed_responses_total Responses sent with gzip or deflate\n";
+    out << "# TYPE heapmap_http_compressed_responses_total counter\n";
+    out << "heapmap_http_compressed_responses_total " << http.compressed_responses.load() << "\n";
+    out << "# HELP heapmap_http_compressions_total Bodies actually run through zlib (cached variants count once)\n";
+    out << "# TYPE heapmap_http_compressions_total counter\n";
+    out << "heapmap_http_compressions_total " << http.compressions.load() << "\n";
+    out << "# HELP heapmap_http_compression_saved_bytes_total Body bytes not sent thanks to compression\n";
+    out << "# TYPE heapmap_http_compression_saved_bytes_total counter\n";
+    out << "heapmap_http_compression_saved_bytes_total " << http.compression_saved_bytes.load() << "\n";
+    out << "# HELP heapmap_http_not_modified_total Conditional requests answered 304 without a body\n";
+    out << "# TYPE heapmap_http_not_modified_total counter\n";
+    out << "heapmap_http_not_modified_total " << http.not_modified.load() << "\n";
+    out << "# HELP heapmap_http_streamed_responses_total Responses streamed with chunked transfer encoding\n";
+    out << "# TYPE heapmap_http_streamed_responses_total counter\n";
+    out << "heapmap_http_streamed_responses_total " << http.streamed_responses.load() << "\n";
+    out << "# HELP heapmap_http_streamed_bytes_total Chunked body bytes handed to the reactors\n";
+    out << "# TYPE heapmap_http_streamed_bytes_total counter\n";
+    out << "heapmap_http_streamed_bytes_total " << http.streamed_bytes.load() << "\n";
+    out << "# HELP heapmap_http_sse_subscribers Open Server-Sent Events subscriptions\n";
+    out << "# TYPE heapmap_http_sse_subscribers gauge\n";
+    out << "heapmap_http_sse_subscribers " << http.sse_subscribers.load() << "\n";
+    out << "# HELP heapmap_http_sse_events_total Events queued to Server-Sent Events subscribers\n";
+    out << "# TYPE heapmap_http_sse_events_total counter\n";
+    out << "heapmap_http_sse_events_total " << http.sse_events.load() << "\n";
+    out << "# HELP heapmap_http_sse_coalesced_total Slow subscriber queues replaced by a single reset event\n";
+    out << "# TYPE heapmap_http_sse_coalesced_total counter\n";
+    out << "heapmap_http_sse_coalesced_total " << http.sse_coalesced.load() << "\n";
+
+    return out.str();
+}
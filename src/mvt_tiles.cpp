@@ -0,0 +1,139 @@
+#include "mvt_tiles.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+static const uint32_t kMvtBuffer = 64;
+
+// Поля protobuf, которые нужны тайлу (vector_tile.proto, версия 2.1)
+namespace {
+
+enum WireType { kVarint = 0, kLengthDelimited = 2 };
+
+enum TileField { kTileLayers = 3 };
+enum LayerField { kLayerName = 1, kLayerFeatures = 2, kLayerKeys = 3, kLayerValues = 4, kLayerExtent = 5, kLayerVersion = 15 };
+enum FeatureField { kFeatureTags = 2, kFeatureType = 3, kFeatureGeometry = 4 };
+enum ValueField { kValueUint = 5, kValueSint = 6 };
+
+const uint32_t kGeomPoint = 1;
+const uint32_t kCommandMoveTo = 1;
+
+class ProtoWriter {
+public:
+    explicit ProtoWriter(std::string& out) : m_out(out) {}
+
+    void varint(uint64_t v) {
+        while (v >= 0x80) {
+            m_out += (char)(v | 0x80);
+            v >>= 7;
+        }
+        m_out += (char)v;
+    }
+    void uintField(int field, uint64_t v) {
+        varint((uint64_t)field << 3 | kVarint);
+        varint(v);
+    }
+    void bytesField(int field, const std::string& data) {
+        varint((uint64_t)field << 3 | kLengthDelimited);
+        varint(data.size());
+        m_out += data;
+    }
+    // packed repeated uint32
+    void packedField(int field, const uint32_t* values, size_t count) {
+        std::string packed;
+        ProtoWriter w(packed);
+        for (size_t i = 0; i < count; i++) w.varint(values[i]);
+        bytesField(field, packed);
+    }
+
+private:
+    std::string& m_out;
+};
+
+uint32_t zigzag32(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+uint64_t zigzag64(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+} // namespace
+
+std::string encode_mvt_points(const std::string& layer_name, const std::vector<MvtPoint>& points) {
+    std::string layer;
+    ProtoWriter lw(layer);
+    lw.uintField(kLayerVersion, 2);
+    lw.bytesField(kLayerName, layer_name);
+
+    // Таблица значений общая на слой: у соседних точек сигнал часто одинаковый
+    std::vector<std::string> values;
+    std::unordered_map<uint64_t, uint32_t> count_values, signal_values;
+    auto value_index = [&](std::unordered_map<uint64_t, uint32_t>& seen, int field, uint64_t v) {
+        auto it = seen.find(v);
+        if (it != seen.end()) return it->second;
+        std::string value;
+        ProtoWriter(value).uintField(field, v);
+        values.push_back(std::move(value));
+        return seen[v] = (uint32_t)values.size() - 1;
+    };
+
+    std::string feature;
+    for (const MvtPoint& p : points) {
+        uint32_t tags[4] = {
+            0, value_index(count_values, kValueUint, p.count),
+            1, value_index(signal_values, kValueSint, zigzag64(p.signal)),
+        };
+        uint32_t geometry[3] = {(1 << 3) | kCommandMoveTo, zigzag32(p.x), zigzag32(p.y)};
+
+        feature.clear();
+        ProtoWriter fw(feature);
+        fw.packedField(kFeatureTags, tags, 4);
+        fw.uintField(kFeatureType, kGeomPoint);
+        fw.packedField(kFeatureGeometry, geometry, 3);
+        lw.bytesField(kLayerFeatures, feature);
+    }
+
+    lw.bytesField(kLayerKeys, "count");
+    lw.bytesField(kLayerKeys, "signal");
+    for (const std::string& value : values) lw.bytesField(kLayerValues, value);
+    lw.uintField(kLayerExtent, kMvtExtent);
+
+    std::string tile;
+    ProtoWriter(tile).bytesField(kTileLayers, layer);
+    return tile;
+}
+
+bool encode_mvt_tile(const PointIndex& index, int z, int x, int y, std::string& out) {
+    if (z < 0 || z > kMvtMaxZoom || x < 0 || y < 0 || x >= (1 << z) || y >= (1 << z)) return false;
+    TRACE_SPAN("mvt.encode", "mvt");
+
+    const int64_t origin_x = (int64_t)x << (32 - z);
+    const int64_t origin_y = (int64_t)y << (32 - z);
+    const int64_t tile_world = 1LL << (32 - z);
+    const double scale = (double)kMvtExtent / (double)tile_world;
+
+    // Ячейка уровня z+2 — 16 px тайла
+    ClusterPlan plan = PointIndex::cover(z + 2, (uint32_t)origin_x, (uint32_t)origin_y,
+                                         (uint32_t)(origin_x + tile_world - 1), (uint32_t)(origin_y + tile_world - 1));
+    if (z + 2 > PointIndex::kMaxClusterZoom) plan.raw = index.countPoints(plan) <= PointIndex::kMaxItems;
+
+    std::vector<PointCluster> clusters;
+    index.collect(plan, clusters);
+
+    // Ячейка 16-го уровня на крупных зумах больше тайла: чужие точки отбрасываем,
+    // оставляя обычный для MVT запас за краем, чтобы значки на стыке не обрезались
+    const double lo = -(double)kMvtBuffer, hi = (double)(kMvtExtent + kMvtBuffer);
+    std::vector<MvtPoint> points;
+    points.reserve(clusters.size());
+    for (const PointCluster& c : clusters) {
+        double px = std::floor(((double)mercator_x(c.lon) - origin_x) * scale);
+        double py = std::floor(((double)mercator_y(c.lat) - origin_y) * scale);
+        if (px < lo || px >= hi || py < lo || py >= hi) continue;
+        points.push_back({(int32_t)px, (int32_t)py, c.count, (int32_t)std::lround(c.signal)});
+    }
+
+    out = encode_mvt_points("measurements", points);
+    return true;
+}
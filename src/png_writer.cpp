@@ -0,0 +1,52 @@
+#include "png_writer.hpp"
+#include <cstring>
+#include <vector>
+#include <zlib.h>
+
+static void put_u32(std::string& out, uint32_t v) {
+    char b[4] = {(char)(v >> 24), (char)(v >> 16), (char)(v >> 8), (char)v};
+    out.append(b, 4);
+}
+
+// Длина, тип, данные, CRC по типу и данным
+static void put_chunk(std::string& out, const char* type, const char* data, size_t size) {
+    put_u32(out, (uint32_t)size);
+    size_t start = out.size();
+    out.append(type, 4);
+    out.append(data, size);
+    put_u32(out, (uint32_t)crc32(0, (const Bytef*)out.data() + start, (uInt)(size + 4)));
+}
+
+bool encode_png_rgba(const uint8_t* rgba, int width, int height, int level, std::string& out) {
+    if (width <= 0 || height <= 0) return false;
+    const size_t stride = (size_t)width * 4;
+
+    // Байт фильтра перед каждой строкой; Sub: разность с тем же каналом пикселя слева
+    std::vector<uint8_t> filtered((stride + 1) * height);
+    for (int y = 0; y < height; y++) {
+        const uint8_t* src = rgba + y * stride;
+        uint8_t* dst = filtered.data() + y * (stride + 1);
+        dst[0] = 1;
+        memcpy(dst + 1, src, 4);
+        for (size_t i = 4; i < stride; i++) dst[1 + i] = (uint8_t)(src[i] - src[i - 4]);
+    }
+
+    uLongf packed_size = compressBound((uLong)filtered.size());
+    std::string packed(packed_size, '\0');
+    if (compress2((Bytef*)&packed[0], &packed_size, filtered.data(), (uLong)filtered.size(), level) != Z_OK) {
+        return false;
+    }
+
+    out.clear();
+    out.reserve(packed_size + 64);
+    out.append("\x89PNG\r\n\x1a\n", 8);
+
+    std::string header;
+    put_u32(header, (uint32_t)width);
+    put_u32(header, (uint32_t)height);
+    header.append("\x08\x06\x00\x00\x00", 5); // 8 бит, RGBA, deflate, адаптивный фильтр, без interlace
+    put_chunk(out, "IHDR", header.data(), header.size());
+    put_chunk(out, "IDAT", packed.data(), packed_size);
+    put_chunk(out, "IEND", "", 0);
+    return true;
+}
@@ -0,0 +1,108 @@
+#include "point_codec.hpp"
+#include "json_writer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+std::string encode_points_json(const std::vector<MapPoint>& points) {
+    std::string out;
+    out.reserve(points.size() * 90 + 2);
+
+    // Ключи по алфавиту — как json::dump(), вывод прежний байт в байт
+    JsonWriter w(out);
+    w.beginArray();
+    for (const auto& p : points) {
+        w.beginObject();
+        w.key("lat");
+        w.value(p.lat);
+        w.key("lon");
+        w.value(p.lon);
+        w.key("signal");
+        w.value(p.signal_strength);
+        w.key("timestamp");
+        w.value(p.timestamp);
+        w.endObject();
+    }
+    w.endArray();
+    return out;
+}
+
+template <typename T>
+static void put(char*& dst, T value) {
+    memcpy(dst, &value, sizeof(T));
+    dst += sizeof(T);
+}
+
+template <typename T>
+static T get(const char*& src) {
+    T value;
+    memcpy(&value, src, sizeof(T));
+    src += sizeof(T);
+    return value;
+}
+
+static int32_t quantize(double deg) {
+    return (int32_t)std::lround(deg * kPointsCoordScale);
+}
+
+bool encode_points_binary(const std::vector<MapPoint>& points, std::string& out) {
+    static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "binary points format is little-endian");
+
+    size_t n = points.size();
+    out.resize(kPointsHeaderSize + n * (3 * sizeof(int32_t) + 1));
+    char* dst = &out[0];
+
+    int64_t base = n ? (int64_t)points[0].timestamp : 0;
+    memcpy(dst, "HMP1", 4);
+    dst += 4;
+    put<uint32_t>(dst, (uint32_t)n);
+    put<int64_t>(dst, base);
+    put<uint32_t>(dst, kPointsCoordScale);
+    put<uint32_t>(dst, 0);
+
+    // Столбец за столбцом: каждый цикл пишет подряд, без ветвлений по типу поля
+    for (const auto& p : points) put<int32_t>(dst, quantize(p.lat));
+    for (const auto& p : points) put<int32_t>(dst, quantize(p.lon));
+
+    int64_t prev = base;
+    for (const auto& p : points) {
+        int64_t dt = (int64_t)p.timestamp - prev;
+        if (dt < std::numeric_limits<int32_t>::min() || dt > std::numeric_limits<int32_t>::max()) return false;
+        put<int32_t>(dst, (int32_t)dt);
+        prev = p.timestamp;
+    }
+
+    for (const auto& p : points) put<int8_t>(dst, (int8_t)std::clamp(p.signal_strength, -128, 127));
+    return true;
+}
+
+bool decode_points_binary(const std::string& data, std::vector<MapPoint>& points) {
+    if (data.size() < kPointsHeaderSize || memcmp(data.data(), "HMP1", 4) != 0) return false;
+
+    const char* src = data.data() + 4;
+    uint32_t n = get<uint32_t>(src);
+    int64_t timestamp = get<int64_t>(src);
+    double scale = get<uint32_t>(src);
+    get<uint32_t>(src);
+    if (data.size() != kPointsHeaderSize + (size_t)n * (3 * sizeof(int32_t) + 1)) return false;
+
+    points.assign(n, MapPoint{});
+    for (auto& p : points) p.lat = get<int32_t>(src) / scale;
+    for (auto& p : points) p.lon = get<int32_t>(src) / scale;
+    for (auto& p : points) {
+        timestamp += get<int32_t>(src);
+        p.timestamp = timestamp;
+    }
+    for (auto& p : points) {
+        p.signal_strength = get<int8_t>(src);
+        p.type = "GPS";
+    }
+    return true;
+}
+
+bool wants_binary_points(const std::string& format_param, const std::string& accept) {
+    if (format_param == "bin") return true;
+    if (format_param == "json") return false;
+    return accept.find(kPointsBinaryType) != std::string::npos;
+}
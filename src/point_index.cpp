@@ -0,0 +1,326 @@
+#include "point_index.hpp"
+#include "json_writer.hpp"
+#include "response_cache.hpp"
+#include "trace.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <iterator>
+#include <mutex>
+
+static const double kMaxMercatorLat = 85.05112878;
+
+uint32_t mercator_x(double lon) {
+    double x = (lon + 180.0) / 360.0;
+    return (uint32_t)std::clamp(x * 4294967296.0, 0.0, 4294967295.0);
+}
+
+uint32_t mercator_y(double lat) {
+    double r = std::clamp(lat, -kMaxMercatorLat, kMaxMercatorLat) * M_PI / 180.0;
+    double y = (1.0 - std::log(std::tan(r) + 1.0 / std::cos(r)) / M_PI) / 2.0;
+    return (uint32_t)std::clamp(y * 4294967296.0, 0.0, 4294967295.0);
+}
+
+double mercator_lon(double wx) {
+    return wx / 4294967296.0 * 360.0 - 180.0;
+}
+
+double mercator_lat(double wy) {
+    double n = M_PI * (1.0 - 2.0 * wy / 4294967296.0);
+    return std::atan(std::sinh(n)) * 180.0 / M_PI;
+}
+
+// Ячейка 64 px на зуме z: мир шириной 256·2^z px делится на 2^(z+2) ячеек
+static int cell_shift(int level) {
+    return 30 - level;
+}
+
+static uint64_t cell_key(uint32_t cx, uint32_t cy) {
+    return ((uint64_t)cy << 32) | cx;
+}
+
+std::string ClusterPlan::key() const {
+    char buf[96];
+    snprintf(buf, sizeof(buf), "z=%d&cells=%u,%u,%u,%u%s", level, x0, y0, x1, y1, raw ? "&raw" : "");
+    return buf;
+}
+
+PointIndex::PointIndex(const PointIndex& base, uint64_t generation)
+    : m_generation(generation), m_points(base.m_points), m_sorted(base.m_sorted) {}
+
+void PointIndex::add(double lat, double lon, int signal) {
+    m_points.push_back({lat, lon, mercator_x(lon), mercator_y(lat), signal});
+}
+
+void PointIndex::finish() {
+    TRACE_SPAN("index.finish", "index");
+    const int shift = cell_shift(kMaxClusterZoom);
+    auto finest = [shift](const Point& p) { return cell_key(p.x >> shift, p.y >> shift); };
+
+    auto less = [&](const Point& a, const Point& b) { return finest(a) < finest(b); };
+    std::sort(m_points.begin() + m_sorted, m_points.end(), less);
+    std::inplace_merge(m_points.begin(), m_points.begin() + m_sorted, m_points.end(), less);
+    m_sorted = m_points.size();
+
+    // Нижний уровень — подряд идущие точки одной ячейки
+    std::vector<Cell>& bottom = m_levels[kMaxClusterZoom];
+    bottom.clear();
+    for (size_t i = 0; i < m_points.size(); i++) {
+        const Point& p = m_points[i];
+        uint64_t key = finest(p);
+        if (bottom.empty() || bottom.back().key != key) bottom.push_back({key, (uint32_t)i, 0, 0, 0, 0});
+        Cell& c = bottom.back();
+        c.count++;
+        c.sum_lat += p.lat;
+        c.sum_lon += p.lon;
+        c.sum_signal += p.signal;
+    }
+
+    // Каждый следующий уровень — сумма четырёх ячеек предыдущего
+    for (int level = kMaxClusterZoom - 1; level >= 0; level--) {
+        std::vector<Cell> parents = m_levels[level + 1];
+        for (Cell& c : parents) {
+            uint32_t cx = (uint32_t)c.key >> 1, cy = (uint32_t)(c.key >> 32) >> 1;
+            c.key = cell_key(cx, cy);
+        }
+        std::sort(parents.begin(), parents.end(), [](const Cell& a, const Cell& b) { return a.key < b.key; });
+
+        std::vector<Cell>& cells = m_levels[level];
+        cells.clear();
+        for (const Cell& c : parents) {
+            if (cells.empty() || cells.back().key != c.key) {
+                cells.push_back(c);
+                continue;
+            }
+            Cell& merged = cells.back();
+            merged.count += c.count;
+            merged.sum_lat += c.sum_lat;
+            merged.sum_lon += c.sum_lon;
+            merged.sum_signal += c.sum_signal;
+        }
+    }
+}
+
+ClusterPlan PointIndex::plan(const ClusterQuery& query) const {
+    ClusterPlan plan;
+    int zoom = std::clamp(query.zoom, 0, 24);
+    uint32_t wx0 = mercator_x(query.min_lon), wx1 = mercator_x(query.max_lon);
+    uint32_t wy0 = mercator_y(query.max_lat), wy1 = mercator_y(query.min_lat);
+    if (wx0 > wx1) std::swap(wx0, wx1);
+    if (wy0 > wy1) std::swap(wy0, wy1);
+
+    // Ячеек в области не больше kMaxItems: на уровне 0 их всего 4×4
+    for (int level = std::min(zoom, kMaxClusterZoom); level >= 0; level--) {
+        plan = cover(level, wx0, wy0, wx1, wy1);
+        if ((uint64_t)(plan.x1 - plan.x0 + 1) * (plan.y1 - plan.y0 + 1) <= kMaxItems) break;
+    }
+
+    plan.raw = zoom > kMaxClusterZoom && plan.level == kMaxClusterZoom && countPoints(plan) <= kMaxItems;
+    return plan;
+}
+
+ClusterPlan PointIndex::cover(int level, uint32_t wx0, uint32_t wy0, uint32_t wx1, uint32_t wy1) {
+    ClusterPlan plan;
+    plan.level = std::clamp(level, 0, (int)kMaxClusterZoom);
+    int shift = cell_shift(plan.level);
+    plan.x0 = wx0 >> shift;
+    plan.x1 = wx1 >> shift;
+    plan.y0 = wy0 >> shift;
+    plan.y1 = wy1 >> shift;
+    return plan;
+}
+
+template <typename F>
+void PointIndex::forEachCell(const ClusterPlan& plan, F&& f) const {
+    const std::vector<Cell>& cells = m_levels[plan.level];
+    for (uint32_t y = plan.y0; y <= plan.y1; y++) {
+        uint64_t last = cell_key(plan.x1, y);
+        auto it = std::lower_bound(cells.begin(), cells.end(), cell_key(plan.x0, y),
+                                   [](const Cell& c, uint64_t key) { return c.key < key; });
+        for (; it != cells.end() && it->key <= last; ++it) f(*it);
+    }
+}
+
+bool PointIndex::extent(uint32_t& wx0, uint32_t& wy0, uint32_t& wx1, uint32_t& wy1) const {
+    if (m_points.empty()) return false;
+    wx0 = wy0 = UINT32_MAX;
+    wx1 = wy1 = 0;
+    for (const Point& p : m_points) {
+        wx0 = std::min(wx0, p.x);
+        wx1 = std::max(wx1, p.x);
+        wy0 = std::min(wy0, p.y);
+        wy1 = std::max(wy1, p.y);
+    }
+    return true;
+}
+
+size_t PointIndex::countPoints(const ClusterPlan& plan) const {
+    size_t count = 0;
+    forEachCell(plan, [&](const Cell& c) { count += c.count; });
+    return count;
+}
+
+void PointIndex::collect(const ClusterPlan& plan, std::vector<PointCluster>& out) const {
+    out.clear();
+    if (m_points.empty()) return;
+
+    if (plan.raw) {
+        forEachCell(plan, [&](const Cell& c) {
+            for (uint32_t i = c.first; i < c.first + c.count; i++) {
+                const Point& p = m_points[i];
+                out.push_back({p.lat, p.lon, 1, (double)p.signal});
+            }
+        });
+        return;
+    }
+
+    forEachCell(plan, [&](const Cell& c) {
+        out.push_back({c.sum_lat / c.count, c.sum_lon / c.count, c.count, c.sum_signal / c.count});
+    });
+}
+
+// --- Индекс текущего поколения ---
+
+static const int kIndexMaxStaleMs = 5000;
+// Больше ждущих строк не копим: индекс давно не спрашивали, проще перечитать БД
+static const size_t kMaxPendingRows = 4 * 1024 * 1024;
+
+static std::mutex g_index_mutex;
+static std::condition_variable g_index_cv;
+static PointIndexPtr g_index;
+static uint64_t g_index_built_ms = 0;
+static bool g_index_building = false;
+static bool g_index_rebuild = true;          // следующий индекс — целиком из БД
+static long long g_index_scanned_id = 0;     // строки с id не больше уже прочитаны из БД
+static std::vector<StoredPoint> g_index_pending;
+
+static uint64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void point_index_append(std::vector<StoredPoint> rows) {
+    if (rows.empty()) return;
+    std::lock_guard<std::mutex> lock(g_index_mutex);
+    // Впереди полное чтение БД — оно эти строки и так увидит
+    if (g_index_rebuild && !g_index_building) return;
+    if (g_index_pending.size() + rows.size() > kMaxPendingRows) {
+        std::vector<StoredPoint>().swap(g_index_pending);
+        g_index_rebuild = true;
+        return;
+    }
+    g_index_pending.insert(g_index_pending.end(), std::make_move_iterator(rows.begin()),
+                           std::make_move_iterator(rows.end()));
+}
+
+void point_index_invalidate() {
+    std::lock_guard<std::mutex> lock(g_index_mutex);
+    g_index_rebuild = true;
+    std::vector<StoredPoint>().swap(g_index_pending);
+}
+
+PointIndexPtr point_index(DBClient& db) {
+    std::unique_lock<std::mutex> lock(g_index_mutex);
+
+    while (true) {
+        bool current = !g_index_rebuild && g_index_pending.empty();
+        if (g_index && (current || now_ms() - g_index_built_ms <= kIndexMaxStaleMs)) {
+            return g_index;
+        }
+        if (!g_index_building) break;
+        // Строит другой поток: старый индекс лучше, чем ожидание
+        if (g_index) return g_index;
+        g_index_cv.wait(lock, [] { return !g_index_building; });
+    }
+
+    g_index_building = true;
+    uint64_t generation = data_generation();
+    const bool full = g_index_rebuild || !g_index;
+    PointIndexPtr base = g_index;
+    std::vector<StoredPoint> rows;
+    if (full) {
+        g_index_rebuild = false;
+        g_index_pending.clear();
+    } else {
+        rows.swap(g_index_pending);
+    }
+    long long scanned = g_index_scanned_id;
+    lock.unlock();
+
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<PointIndex> index;
+    bool ok = true;
+    if (full) {
+        index = std::make_shared<PointIndex>(generation);
+        ok = db.streamPoints(0, [&](const MapPoint& p) {
+            index->add(p.lat, p.lon, p.signal_strength);
+            return true;
+        }, &scanned);
+        // Сохранённое, пока шло чтение; что чтение уже видело, отсеется по id
+        lock.lock();
+        rows.swap(g_index_pending);
+        lock.unlock();
+    } else {
+        index = std::make_shared<PointIndex>(*base, generation);
+    }
+    size_t added = 0;
+    if (ok) {
+        for (const StoredPoint& row : rows) {
+            if (row.id <= scanned) continue;
+            index->add(row.point.lat, row.point.lon, row.point.signal_strength);
+            added++;
+        }
+        index->finish();
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    lock.lock();
+    g_index_building = false;
+    if (ok) {
+        g_index = index;
+        g_index_built_ms = now_ms();
+        g_index_scanned_id = scanned;
+        if (full) {
+            LOG_DEBUG("index", "Point index read from DB: " << index->size() << " points in " << ms << " ms");
+        } else {
+            LOG_DEBUG("index", "Point index updated: +" << added << " points, " << index->size() << " in " << ms << " ms");
+        }
+    } else {
+        g_index_rebuild = true;
+        // БД недоступна — повторим не раньше чем через kIndexMaxStaleMs
+        if (g_index) g_index_built_ms = now_ms();
+    }
+    g_index_cv.notify_all();
+    return g_index;
+}
+
+std::string encode_clusters_json(const ClusterPlan& plan, const std::vector<PointCluster>& clusters) {
+    std::string out;
+    out.reserve(clusters.size() * 80 + 64);
+
+    JsonWriter w(out);
+    w.beginObject();
+    w.key("items");
+    w.beginArray();
+    for (const auto& c : clusters) {
+        w.beginObject();
+        w.key("count");
+        w.value(c.count);
+        w.key("lat");
+        w.value(c.lat);
+        w.key("lon");
+        w.value(c.lon);
+        w.key("signal");
+        w.value(std::round(c.signal * 10) / 10);
+        w.endObject();
+    }
+    w.endArray();
+    w.key("level");
+    w.value(plan.level);
+    w.key("raw");
+    w.value(plan.raw);
+    w.endObject();
+    return out;
+}
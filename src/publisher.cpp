@@ -0,0 +1,66 @@
+#include "publisher.hpp"
+#include "metrics.hpp"
+#include "logger.hpp"
+
+MeasurementPublisher::MeasurementPublisher(zmq::context_t& context, const std::string& endpoint, int hwm) {
+    try {
+        m_socket = std::make_unique<zmq::socket_t>(context, zmq::socket_type::pub);
+        m_socket->set(zmq::sockopt::sndhwm, hwm);
+        m_socket->set(zmq::sockopt::linger, 0);
+        m_socket->bind(endpoint);
+        m_bound = true;
+        LOG_INFO("publisher", "Publishing measurements on " << endpoint);
+    } catch (const zmq::error_t& e) {
+        LOG_ERROR("publisher", "Failed to bind PUB socket " << endpoint << ": " << e.what());
+    }
+}
+
+void MeasurementPublisher::send(const std::string& topic, const json& body) {
+    std::vector<uint8_t> payload = json::to_msgpack(body);
+
+    try {
+        m_socket->send(zmq::buffer(topic), zmq::send_flags::sndmore | zmq::send_flags::dontwait);
+        m_socket->send(zmq::buffer(payload.data(), payload.size()), zmq::send_flags::dontwait);
+    } catch (const zmq::error_t& e) {
+        LOG_WARN_RL("publisher", 1, "Publish failed: " << e.what());
+        return;
+    }
+
+    IngestMetrics& metrics = ingest_metrics();
+    metrics.published++;
+    metrics.published_bytes += topic.size() + payload.size();
+}
+
+void MeasurementPublisher::publish(const json& record, long long seq) {
+    if (!m_bound || !record.is_object()) return;
+
+    std::string imei = record.value("imei", "");
+    if (imei.empty()) imei = "unknown";
+
+    json base = {
+        {"seq", seq},
+        {"timestamp", record.value("timestamp", 0LL)},
+        {"imei", imei}
+    };
+
+    bool any = false;
+    for (const char* section : {"location", "telephony", "traffic"}) {
+        bool present = record.contains(section);
+        if (std::string(section) == "telephony") present = present || record.contains("cellInfo");
+        if (!present) continue;
+
+        json body = base;
+        if (record.contains(section)) body[section] = record[section];
+        if (std::string(section) == "telephony" && record.contains("cellInfo")) {
+            body["cellInfo"] = record["cellInfo"];
+        }
+        send(std::string(section) + "/" + imei, body);
+        any = true;
+    }
+
+    if (!any) {
+        json body = base;
+        body["record"] = record;
+        send("raw/" + imei, body);
+    }
+}
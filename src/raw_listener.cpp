@@ -0,0 +1,249 @@
+#include "raw_listener.hpp"
+#include "ingest_pipeline.hpp"
+#include "ingest_filter.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "logger.hpp"
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Датаграмм за один recvmmsg и предел числа TCP-соединений
+static const int kUdpBatch = 64;
+static const size_t kUdpDatagram = 65536;
+static const size_t kMaxConnections = 1024;
+static const size_t kMaxUdpSources = 65536;
+
+static bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static uint32_t read_u32(const char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return ntohl(v);
+}
+
+RawIngestListener::RawIngestListener(SharedData* shared, IngestPipeline* pipeline, int port)
+    : m_shared(shared), m_pipeline(pipeline), m_port(port) {}
+
+RawIngestListener::~RawIngestListener() {
+    stop();
+}
+
+bool RawIngestListener::start() {
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(m_port);
+
+    int opt = 1;
+    m_tcp_fd = socket(AF_INET, SOCK_STREAM, 0);
+    m_udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    m_epoll_fd = epoll_create1(0);
+    if (m_tcp_fd < 0 || m_udp_fd < 0 || m_epoll_fd < 0) {
+        LOG_ERROR("raw", "Raw listener socket creation failed");
+        stop();
+        return false;
+    }
+
+    setsockopt(m_tcp_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (bind(m_tcp_fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(m_tcp_fd, 128) < 0 ||
+        bind(m_udp_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        LOG_ERROR("raw", "Raw listener bind failed on port " << m_port << ": " << strerror(errno));
+        stop();
+        return false;
+    }
+
+    // Приёмный буфер побольше: всплески датаграмм не должны теряться в ядре
+    int rcvbuf = 4 << 20;
+    setsockopt(m_udp_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    m_udp_storage.resize(kUdpBatch * kUdpDatagram);
+    set_nonblocking(m_tcp_fd);
+    set_nonblocking(m_udp_fd);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = m_tcp_fd;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_tcp_fd, &ev);
+    ev.data.fd = m_udp_fd;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_udp_fd, &ev);
+
+    m_thread = std::thread(&RawIngestListener::loop, this);
+    LOG_INFO("raw", "Raw TCP/UDP ingest listening on port " << m_port);
+    return true;
+}
+
+void RawIngestListener::stop() {
+    m_stop = true;
+    if (m_thread.joinable()) m_thread.join();
+
+    for (auto& [fd, conn] : m_connections) close(fd);
+    m_connections.clear();
+    if (m_tcp_fd >= 0) close(m_tcp_fd);
+    if (m_udp_fd >= 0) close(m_udp_fd);
+    if (m_epoll_fd >= 0) close(m_epoll_fd);
+    m_tcp_fd = m_udp_fd = m_epoll_fd = -1;
+}
+
+void RawIngestListener::loop() {
+    trace_set_thread_name("raw-ingest");
+
+    struct epoll_event events[64];
+    while (!m_stop && !shutdown_requested()) {
+        int n = epoll_wait(m_epoll_fd, events, 64, 200);
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == m_tcp_fd) {
+                acceptConnections();
+            } else if (fd == m_udp_fd) {
+                readDatagrams();
+            } else {
+                auto it = m_connections.find(fd);
+                if (it == m_connections.end()) continue;
+                if ((events[i].events & (EPOLLHUP | EPOLLERR)) || !readConnection(fd, it->second)) {
+                    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+                    close(fd);
+                    m_connections.erase(it);
+                }
+            }
+        }
+    }
+}
+
+void RawIngestListener::acceptConnections() {
+    while (true) {
+        int fd = accept(m_tcp_fd, nullptr, nullptr);
+        if (fd < 0) return;
+
+        if (m_connections.size() >= kMaxConnections) {
+            LOG_WARN_RL("raw", 1, "Raw TCP connection limit reached, rejecting");
+            close(fd);
+            continue;
+        }
+
+        set_nonblocking(fd);
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.fd = fd;
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+        m_connections[fd];
+    }
+}
+
+bool RawIngestListener::readConnection(int fd, Connection& conn) {
+    char chunk[65536];
+
+    while (true) {
+        ssize_t got = read(fd, chunk, sizeof(chunk));
+        if (got < 0 && errno == EINTR) continue;
+        if (got == 0) return false;
+        if (got < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+
+        conn.buffer.append(chunk, got);
+
+        // Разбираем все целые кадры, хвост остаётся до следующего чтения
+        size_t pos = 0;
+        while (conn.buffer.size() - pos >= 8) {
+            uint32_t len = read_u32(conn.buffer.data() + pos);
+            if (len > kMaxFrame) {
+                LOG_WARN_RL("raw", 1, "Raw TCP frame too large (" << len << " bytes), closing connection");
+                ingest_metrics().errors++;
+                return false;
+            }
+            if (conn.buffer.size() - pos < 8 + (size_t)len) break;
+
+            uint32_t seq = read_u32(conn.buffer.data() + pos + 4);
+            ingest_metrics().raw_tcp_frames++;
+            handleRecord(conn.buffer.data() + pos + 8, len, seq, conn.expected_seq, conn.has_seq);
+            pos += 8 + len;
+        }
+        conn.buffer.erase(0, pos);
+    }
+}
+
+void RawIngestListener::readDatagrams() {
+    struct mmsghdr msgs[kUdpBatch];
+    struct iovec iovs[kUdpBatch];
+    struct sockaddr_in addrs[kUdpBatch];
+
+    while (true) {
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < kUdpBatch; i++) {
+            iovs[i].iov_base = m_udp_storage.data() + i * kUdpDatagram;
+            iovs[i].iov_len = kUdpDatagram;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        }
+
+        // Одним системным вызовом забираем до kUdpBatch датаграмм
+        int n = recvmmsg(m_udp_fd, msgs, kUdpBatch, MSG_DONTWAIT, nullptr);
+        if (n <= 0) return;
+
+        for (int i = 0; i < n; i++) {
+            size_t size = msgs[i].msg_len;
+            if (size < 4 || (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)) {
+                ingest_metrics().errors++;
+                continue;
+            }
+
+            uint64_t source = ((uint64_t)addrs[i].sin_addr.s_addr << 16) | addrs[i].sin_port;
+            if (m_udp_sources.size() >= kMaxUdpSources && !m_udp_sources.count(source)) {
+                m_udp_sources.clear();
+            }
+            Connection& src = m_udp_sources[source];
+
+            const char* data = (const char*)iovs[i].iov_base;
+            ingest_metrics().raw_udp_datagrams++;
+            handleRecord(data + 4, size - 4, read_u32(data), src.expected_seq, src.has_seq);
+        }
+
+        if (n < kUdpBatch) return;
+    }
+}
+
+void RawIngestListener::handleRecord(const char* data, size_t size, uint32_t seq,
+                                     uint32_t& expected, bool& has_seq) {
+    TRACE_SPAN("raw.record", "ingest");
+    IngestMetrics& metrics = ingest_metrics();
+    metrics.messages++;
+    metrics.bytes += size;
+
+    // Учёт потерь: разрыв в seq — пропавшие записи, seq из прошлого — повтор или перестановка
+    if (has_seq) {
+        if (seq == expected) {
+            expected = seq + 1;
+        } else if ((int32_t)(seq - expected) > 0) {
+            metrics.raw_lost += seq - expected;
+            expected = seq + 1;
+        } else {
+            metrics.raw_out_of_order++;
+        }
+    } else {
+        has_seq = true;
+        expected = seq + 1;
+    }
+
+    try {
+        json record;
+        bool has_data;
+        {
+            StageTimer timer(IngestStage::Parse);
+            has_data = parse_filtered(data, size, ingest_filter_snapshot(*m_shared), record);
+        }
+        if (has_data) m_pipeline->submit(std::move(record));
+    } catch (const std::exception& e) {
+        LOG_ERROR_RL("raw", 10, "Raw record rejected: " << e.what());
+        metrics.errors++;
+    }
+}
@@ -0,0 +1,294 @@
+#include "replay.hpp"
+#include "logger.hpp"
+#include <zmq.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+static long long now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::vector<json> load_replay_records(const std::string& path) {
+    std::vector<json> records;
+
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        LOG_ERROR("replay", "Cannot open replay file: " << path);
+        return records;
+    }
+
+    std::stringstream ss;
+    ss << file.rdbuf();
+    std::string content = ss.str();
+
+    size_t first = content.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) return records;
+
+    try {
+        if (content[first] == '[') {
+            json data = json::parse(content);
+            for (auto& item : data) {
+                if (item.is_object()) records.push_back(std::move(item));
+            }
+        } else {
+            // Сегмент журнала: одна запись на строку
+            std::istringstream lines(content);
+            std::string line;
+            while (std::getline(lines, line)) {
+                if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+                json item = json::parse(line);
+                if (item.is_object()) records.push_back(std::move(item));
+            }
+        }
+    } catch (const std::exception& e) {
+        LOG_ERROR("replay", "Error parsing replay file " << path << ": " << e.what());
+    }
+
+    // Записи в файле бывают не по порядку, а паузы считаются от первой: сортируем по времени
+    // (стабильно — одинаковые timestamp сохраняют порядок файла)
+    auto by_time = [](const json& a, const json& b) {
+        return a.value("timestamp", 0LL) < b.value("timestamp", 0LL);
+    };
+    if (!std::is_sorted(records.begin(), records.end(), by_time)) {
+        std::stable_sort(records.begin(), records.end(), by_time);
+        LOG_INFO("replay", "Replay records sorted by timestamp (file order differs)");
+    }
+
+    return records;
+}
+
+// Поток i > 0 получает собственный IMEI, чтобы сервер видел отдельные устройства
+static std::string rewrite_imei(const std::string& imei, int stream) {
+    if (stream == 0) return imei;
+    std::string base = imei.empty() ? "350000000000000" : imei;
+    std::string suffix = std::to_string(stream);
+    if (suffix.size() >= base.size()) return suffix;
+    return base.substr(0, base.size() - suffix.size()) + suffix;
+}
+
+struct ReplayStats {
+    std::atomic<long long> sent{0};
+    std::atomic<long long> errors{0};
+    std::atomic<long long> messages{0};
+    std::atomic<long long> advised_interval_sum{0};
+    std::atomic<long long> advised_batch_sum{0};
+};
+
+// Ответ сервера "OK:<n>;interval_ms=<i>;batch=<b>"; поля совета необязательны
+static void parse_advice(const std::string& reply, int& interval_ms, int& batch) {
+    size_t pos = reply.find("interval_ms=");
+    if (pos != std::string::npos) interval_ms = std::max(0, atoi(reply.c_str() + pos + 12));
+    pos = reply.find("batch=");
+    if (pos != std::string::npos) batch = std::max(1, atoi(reply.c_str() + pos + 6));
+}
+
+static void replay_stream(const ReplayOptions& opts, const std::vector<json>& records,
+                          int stream, zmq::context_t& context, ReplayStats& stats) {
+    std::unique_ptr<zmq::socket_t> socket;
+    auto connect = [&]() {
+        socket = std::make_unique<zmq::socket_t>(context, zmq::socket_type::req);
+        socket->set(zmq::sockopt::rcvtimeo, 5000);
+        socket->set(zmq::sockopt::linger, 0);
+        socket->connect(opts.endpoint);
+    };
+    connect();
+
+    long long first_ts = records.front().value("timestamp", 0LL);
+
+    // Совет сервера (режим --adaptive): пауза на запись и записей в сообщении
+    int interval_ms = 0;
+    int batch = 1;
+
+    for (int loop = 0; loop < opts.loops; loop++) {
+        auto start = Clock::now();
+
+        for (size_t i = 0; i < records.size();) {
+            size_t count = opts.adaptive ? std::min<size_t>(batch, records.size() - i) : 1;
+
+            if (!opts.adaptive && opts.speed > 0) {
+                long long offset = records[i].value("timestamp", first_ts) - first_ts;
+                if (offset < 0) offset = 0;
+                auto due = start + std::chrono::microseconds((long long)(offset * 1000.0 / opts.speed));
+                std::this_thread::sleep_until(due);
+            }
+
+            json out = json::array();
+            for (size_t k = i; k < i + count; k++) {
+                json item = records[k];
+                std::string imei = rewrite_imei(item.value("imei", ""), stream);
+                if (!imei.empty()) item["imei"] = imei;
+                if (opts.rebase_timestamps) item["timestamp"] = now_ms();
+                out.push_back(std::move(item));
+            }
+
+            std::string payload = count == 1 ? out[0].dump() : out.dump();
+            zmq::message_t reply;
+            bool ok = false;
+            try {
+                socket->send(zmq::buffer(payload), zmq::send_flags::none);
+                auto res = socket->recv(reply, zmq::recv_flags::none);
+                std::string text = res.has_value() ? std::string(static_cast<char*>(reply.data()), reply.size()) : "";
+                ok = text.rfind("OK", 0) == 0;
+                if (ok && opts.adaptive) {
+                    parse_advice(text, interval_ms, batch);
+                    stats.advised_interval_sum += interval_ms;
+                    stats.advised_batch_sum += batch;
+                }
+                if (!res.has_value()) connect(); // REQ застрял без ответа — пересоздаём
+            } catch (const zmq::error_t& e) {
+                LOG_ERROR_RL("replay", 10, "Replay stream " << stream << " error: " << e.what());
+                connect();
+            }
+
+            stats.messages++;
+            if (ok) stats.sent += count;
+            else stats.errors += count;
+            i += count;
+
+            // Устройство снимает запись раз в interval_ms, пачка из count записей копится count интервалов
+            if (opts.adaptive && opts.speed > 0 && interval_ms > 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(
+                    (long long)(interval_ms * 1000.0 * count / opts.speed)));
+            }
+        }
+    }
+}
+
+// Сырой протокол (raw-tcp://host:port, raw-udp://host:port): без ответа, каждой записи свой seq
+static int open_raw_socket(const std::string& endpoint, bool& udp) {
+    udp = endpoint.rfind("raw-udp://", 0) == 0;
+    std::string address = endpoint.substr(10);
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) return -1;
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = udp ? SOCK_DGRAM : SOCK_STREAM;
+
+    struct addrinfo* res = nullptr;
+    if (getaddrinfo(address.substr(0, colon).c_str(), address.substr(colon + 1).c_str(), &hints, &res) != 0) {
+        return -1;
+    }
+
+    int fd = socket(res->ai_family, res->ai_socktype, 0);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+static bool send_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static void replay_stream_raw(const ReplayOptions& opts, const std::vector<json>& records,
+                              int stream, ReplayStats& stats) {
+    bool udp = false;
+    int fd = open_raw_socket(opts.endpoint, udp);
+    if (fd < 0) {
+        LOG_ERROR("replay", "Replay stream " << stream << ": cannot connect to " << opts.endpoint);
+        stats.errors += (long long)records.size() * opts.loops;
+        return;
+    }
+
+    long long first_ts = records.front().value("timestamp", 0LL);
+    uint32_t seq = 0;
+    std::string frame;
+
+    for (int loop = 0; loop < opts.loops; loop++) {
+        auto start = Clock::now();
+
+        for (const auto& record : records) {
+            if (opts.speed > 0) {
+                long long offset = record.value("timestamp", first_ts) - first_ts;
+                if (offset < 0) offset = 0;
+                auto due = start + std::chrono::microseconds((long long)(offset * 1000.0 / opts.speed));
+                std::this_thread::sleep_until(due);
+            }
+
+            json out = record;
+            std::string imei = rewrite_imei(record.value("imei", ""), stream);
+            if (!imei.empty()) out["imei"] = imei;
+            if (opts.rebase_timestamps) out["timestamp"] = now_ms();
+            std::string payload = out.dump();
+
+            // TCP: [u32 длина][u32 seq][JSON], UDP: [u32 seq][JSON]
+            uint32_t len_be = htonl((uint32_t)payload.size());
+            uint32_t seq_be = htonl(seq++);
+            frame.clear();
+            if (!udp) frame.append((const char*)&len_be, 4);
+            frame.append((const char*)&seq_be, 4);
+            frame += payload;
+
+            bool ok = send_all(fd, frame.data(), frame.size());
+            stats.messages++;
+            if (ok) stats.sent++;
+            else stats.errors++;
+        }
+    }
+
+    close(fd);
+}
+
+int run_replay(const ReplayOptions& opts) {
+    std::vector<json> records = load_replay_records(opts.path);
+    if (records.empty()) {
+        LOG_ERROR("replay", "No records to replay in " << opts.path);
+        return 1;
+    }
+
+    LOG_INFO("replay", "Replaying " << records.size() << " records from " << opts.path
+             << " to " << opts.endpoint << " (speed: "
+             << (opts.speed > 0 ? std::to_string(opts.speed) + "x" : "max")
+             << ", streams: " << opts.streams << ", loops: " << opts.loops << ")");
+
+    zmq::context_t context(1);
+    ReplayStats stats;
+    auto start = Clock::now();
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < opts.streams; i++) {
+        if (opts.endpoint.rfind("raw-", 0) == 0) {
+            threads.emplace_back(replay_stream_raw, std::cref(opts), std::cref(records), i, std::ref(stats));
+        } else {
+            threads.emplace_back(replay_stream, std::cref(opts), std::cref(records), i,
+                                 std::ref(context), std::ref(stats));
+        }
+    }
+    for (auto& t : threads) t.join();
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    LOG_INFO("replay", "Replay finished: " << stats.sent << " sent, " << stats.errors << " errors in "
+             << elapsed << " s (" << (elapsed > 0 ? stats.sent / elapsed : 0) << " records/s, "
+             << stats.messages << " messages)");
+    if (opts.adaptive && stats.messages > 0) {
+        LOG_INFO("replay", "Server advice: average interval "
+                 << stats.advised_interval_sum / stats.messages << " ms, average batch "
+                 << (double)stats.advised_batch_sum / stats.messages);
+    }
+
+    return stats.errors > 0 ? 2 : 0;
+}
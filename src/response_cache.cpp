@@ -0,0 +1,140 @@
+#include "response_cache.hpp"
+#include "metrics.hpp"
+#include <atomic>
+#include <chrono>
+#include <ctime>
+
+// Начало отсчёта — время запуска: ETag "g<поколение>" не повторится после перезапуска сервера
+static std::atomic<uint64_t> g_data_generation{(uint64_t)time(nullptr) << 20};
+
+uint64_t data_generation() {
+    return g_data_generation.load(std::memory_order_acquire);
+}
+
+void bump_data_generation() {
+    g_data_generation.fetch_add(1, std::memory_order_acq_rel);
+}
+
+static uint64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool ResponseCache::fresh(const Entry& e, uint64_t generation, uint64_t now) const {
+    return e.generation == generation || now - e.built_ms <= (uint64_t)m_options.max_stale_ms;
+}
+
+ResponseCache::EntryPtr ResponseCache::get(const std::string& key, const Builder& build) {
+    HttpMetrics& metrics = http_metrics();
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true) {
+        // Поколение берём до построения: запись, пришедшая во время запроса к БД,
+        // сделает ответ устаревшим, а не потеряется
+        uint64_t generation = data_generation();
+        uint64_t now = now_ms();
+
+        Slot& slot = m_slots[key];
+        if (slot.entry && fresh(*slot.entry, generation, now)) {
+            metrics.response_cache_hits++;
+            m_lru.splice(m_lru.begin(), m_lru, slot.lru);
+            return slot.entry;
+        }
+
+        if (slot.flight) {
+            std::shared_ptr<Flight> flight = slot.flight;
+            metrics.response_cache_coalesced++;
+            m_cv.wait(lock, [&] { return flight->done; });
+            if (flight->result) return flight->result;
+            continue; // строивший упал — пробуем сами
+        }
+
+        metrics.response_cache_misses++;
+        auto flight = std::make_shared<Flight>();
+        slot.flight = flight;
+        lock.unlock();
+
+        auto entry = std::make_shared<Entry>();
+        try {
+            build(*entry);
+        } catch (...) {
+            lock.lock();
+            flight->done = true;
+            auto it = m_slots.find(key);
+            if (it != m_slots.end() && it->second.flight == flight) {
+                it->second.flight.reset();
+                if (!it->second.entry) m_slots.erase(it);
+            }
+            m_cv.notify_all();
+            throw;
+        }
+        if (!entry->generation || entry->generation > generation) entry->generation = generation;
+        entry->built_ms = now_ms();
+        entry->built_at = time(nullptr);
+
+        lock.lock();
+        flight->done = true;
+        flight->result = entry;
+        Slot& done = m_slots[key];
+        if (done.flight == flight) done.flight.reset();
+        if (!done.entry || done.entry->generation <= generation) store(key, done, entry);
+        evict();
+        m_cv.notify_all();
+        return entry;
+    }
+}
+
+void ResponseCache::store(const std::string& key, Slot& slot, EntryPtr entry) {
+    if (slot.entry) {
+        m_bytes -= slot.entry->body.size();
+        m_lru.splice(m_lru.begin(), m_lru, slot.lru);
+    } else {
+        m_lru.push_front(key);
+        slot.lru = m_lru.begin();
+    }
+    m_bytes += entry->body.size();
+    slot.entry = std::move(entry);
+}
+
+void ResponseCache::drop(Slot& slot) {
+    m_bytes -= slot.entry->body.size();
+    m_lru.erase(slot.lru);
+    slot.entry.reset();
+}
+
+// Ключи с параметрами могут копиться: вытесняем с конца LRU, пока не влезем в пределы.
+// У строящегося ключа выбрасываем только запись — слот нужен ждущим
+void ResponseCache::evict() {
+    while (!m_lru.empty() && (m_lru.size() > m_options.max_entries || m_bytes > m_options.max_bytes)) {
+        auto it = m_slots.find(m_lru.back());
+        drop(it->second);
+        if (!it->second.flight) m_slots.erase(it);
+    }
+}
+
+void ResponseCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_slots.begin(); it != m_slots.end();) {
+        if (it->second.entry) drop(it->second);
+        if (it->second.flight) {
+            ++it;
+        } else {
+            it = m_slots.erase(it);
+        }
+    }
+}
+
+ResponseCache& response_cache() {
+    static ResponseCache cache;
+    return cache;
+}
+
+ResponseCache& tile_cache() {
+    static ResponseCache cache([] {
+        ResponseCache::Options options;
+        options.max_entries = 4096;
+        options.max_bytes = 64 << 20;
+        return options;
+    }());
+    return cache;
+}
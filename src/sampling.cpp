@@ -0,0 +1,93 @@
+#include "sampling.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Устройство без записей дольше этого считается отключившимся
+static const uint64_t kDeviceIdleNs = 30ULL * 1000000000ULL;
+
+AdaptiveSamplingPolicy::AdaptiveSamplingPolicy(const Config& config)
+    : m_config(config), m_interval_ms(config.base_interval_ms) {}
+
+SamplingAdvice AdaptiveSamplingPolicy::advise(const SamplingSignals& s) {
+    const Config& c = m_config;
+    int devices = std::max(1, s.active_devices);
+
+    // Сколько записей в секунду БД успевает сохранять при целевой загрузке
+    double capacity = s.db_latency_ns > 0 ? c.target_utilization * 1e9 / s.db_latency_ns : 0;
+    double fill = s.queue_capacity ? (double)s.queue_depth / s.queue_capacity : 0;
+
+    double target = c.base_interval_ms;
+    if (capacity > 0) {
+        target = std::max(target, 1000.0 * devices / capacity);
+    }
+    if (fill > c.queue_high) {
+        target *= 1.0 + (fill - c.queue_high) * 8.0;
+    }
+    target = std::min<double>(std::max<double>(target, c.min_interval_ms), c.max_interval_ms);
+
+    double alpha = target > m_interval_ms ? c.backoff_alpha : c.recover_alpha;
+    m_interval_ms += alpha * (target - m_interval_ms);
+
+    // Нагрузка > 1 — текущий поток записей уже не помещается в целевую загрузку
+    double pressure = fill / c.queue_high;
+    if (capacity > 0) pressure = std::max(pressure, s.total_rate / capacity);
+
+    SamplingAdvice advice;
+    advice.interval_ms = (int)std::lround(m_interval_ms);
+    advice.batch = 1;
+    if (pressure > 0.5) {
+        // Под нагрузкой меньше сообщений: записи копятся на устройстве и приходят пачкой
+        advice.batch = std::min(c.max_batch, 1 + (int)std::ceil((pressure - 0.5) * 2 * (c.max_batch - 1) / 4));
+    }
+    return advice;
+}
+
+std::unique_ptr<SamplingPolicy> make_sampling_policy(const std::string& name) {
+    if (name == "fixed") return std::make_unique<FixedSamplingPolicy>();
+    if (name == "adaptive") return std::make_unique<AdaptiveSamplingPolicy>();
+    return nullptr;
+}
+
+double DeviceRateTracker::observe(const std::string& imei, uint64_t now_ns, int records) {
+    expire(now_ns);
+
+    Device& d = m_devices[imei];
+    if (d.last_ns && now_ns > d.last_ns) {
+        double instant = records * 1e9 / (now_ns - d.last_ns);
+        double rate = d.rate > 0 ? d.rate + 0.2 * (instant - d.rate) : instant;
+        m_total_rate += rate - d.rate;
+        d.rate = rate;
+    }
+    d.last_ns = std::max(d.last_ns, now_ns);
+    return d.rate;
+}
+
+double DeviceRateTracker::rate(const std::string& imei) const {
+    auto it = m_devices.find(imei);
+    return it == m_devices.end() ? 0.0 : it->second.rate;
+}
+
+double DeviceRateTracker::totalRate(uint64_t now_ns) {
+    expire(now_ns);
+    return std::max(0.0, m_total_rate);
+}
+
+int DeviceRateTracker::activeDevices(uint64_t now_ns) {
+    expire(now_ns);
+    return (int)m_devices.size();
+}
+
+// Момент раньше уже виденного ничего не вытесняет: разности без знака не переполняются
+void DeviceRateTracker::expire(uint64_t now_ns) {
+    if (now_ns < m_last_expire_ns + 1000000000ULL) return;
+    m_last_expire_ns = now_ns;
+
+    for (auto it = m_devices.begin(); it != m_devices.end();) {
+        if (now_ns > it->second.last_ns && now_ns - it->second.last_ns > kDeviceIdleNs) {
+            m_total_rate -= it->second.rate;
+            it = m_devices.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
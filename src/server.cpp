@@ -1,19 +1,37 @@
 #include "server.hpp"
 #include "db_client.hpp"
+#include "publisher.hpp"
+#include "ingest_filter.hpp"
+#include "ingest_pipeline.hpp"
+#include "raw_listener.hpp"
+#include "batch_ingest.hpp"
+#include "http_server.hpp"
+#include "response_cache.hpp"
+#include "point_codec.hpp"
+#include "point_index.hpp"
+#include "heat_tiles.hpp"
+#include "mvt_tiles.hpp"
+#include "heatmap_jobs.hpp"
+#include "json_writer.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "logger.hpp"
 #include <zmq.hpp>
 #include <nlohmann/json.hpp>
 #include <fstream>
-#include <iostream>
 #include <string>
 #include <thread>
 #include <sstream>
 #include <filesystem>
 #include <cstring>
+#include <cstdlib>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <regex>
 #ifndef _WIN32
@@ -21,6 +39,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <cstring>
+#include <cstdlib>
 #endif
 
 using namespace std;
@@ -28,9 +47,29 @@ using namespace zmq;
 namespace fs = std::filesystem;
 using json = nlohmann::json;
 
-// Глобальный клиент БД (заменяет db_conn)
+static const char* kDbConnString = "dbname=cellmap user=postgres password=postgres host=localhost port=5434";
+
+// Глобальный клиент БД (заменяет db_conn): схема, импорт при старте и конвейер приёма
 static unique_ptr<DBClient> g_db_client;
 
+static atomic<bool> g_shutdown{false};
+
+// Конвейер приёма, пока работает run_server (для POST /api/ingest)
+static atomic<IngestPipeline*> g_pipeline{nullptr};
+
+// HTTP-сервер, пока работает run_http_server (рассылка /api/stream из конвейера)
+// Под мьютексом: publish не должен застать сервер посреди stop()
+static mutex g_http_server_mutex;
+static HttpServer* g_http_server = nullptr;
+
+void request_shutdown() {
+    g_shutdown.store(true);
+}
+
+bool shutdown_requested() {
+    return g_shutdown.load();
+}
+
 string get_local_ip() {
     string ip = "127.0.0.1";
     
@@ -63,17 +102,47 @@ string get_local_ip() {
 // Сохранение в БД через DBClient (заменяет старую save_to_db)
 void save_to_db_v2(const json& data) {
     if (!g_db_client || !g_db_client->isConnected()) return;
-    g_db_client->importJsonData(data);
+    if (g_db_client->importJsonData(data)) {
+        point_index_invalidate();
+        bump_data_generation();
+    }
+}
+
+static string record_imei(const json& data) {
+    const json& record = data.is_array() && !data.empty() ? data[0] : data;
+    return record.is_object() ? record.value("imei", "") : "";
+}
+
+// Ответ устройству: номер последней принятой записи и совет по выборке
+static string advice_reply(long long accepted, const SamplingAdvice& advice) {
+    return "OK:" + to_string(accepted) + ";interval_ms=" + to_string(advice.interval_ms) +
+           ";batch=" + to_string(advice.batch);
+}
+
+// Файл с диска целиком: тело уйдёт через sendfile (мелкие — из mmap-кэша); false — файла нет.
+// ETag — хэш содержимого, так что повторный запрос с If-None-Match получит 304
+static bool serve_file(const string& path, HttpResponse& out, const char* cache_control = "no-cache") {
+    StaticFilePtr file = static_files().get(path);
+    if (!file) return false;
+    out.variants = shared_ptr<const CompressedVariants>(file, &file->compressed);
+    out.etag = file->etag();
+    out.last_modified = file->mtime;
+    out.headers.emplace_back("Cache-Control", cache_control);
+    out.file = move(file);
+    out.content_type = out.file->content_type;
+    out.body.clear();
+    return true;
 }
 
 // Обработка HTTP запросов для тайлов
-void handle_tile_request(int client_fd, const string& path) {
+void handle_tile_request(const string& path, HttpResponse& out) {
     // Формат: /tile/{z}/{x}/{y}.png
-    regex tile_pattern(R"(/tile/(\d+)/(\d+)/(\d+)\.png)");
+    static const regex tile_pattern(R"(/tile/(\d+)/(\d+)/(\d+)\.png)");
     smatch match;
     
-    string response;
-    string content_type = "image/png";
+    string& response = out.body;
+    string& content_type = out.content_type;
+    content_type = "image/png";
     
     if (regex_match(path, match, tile_pattern)) {
         int z = stoi(match[1]);
@@ -84,268 +153,756 @@ void handle_tile_request(int client_fd, const string& path) {
         string cache_path = "build/tiles_cache/" + to_string(z) + "/" + 
                            to_string(x) + "/" + to_string(y) + ".png";
         
-        ifstream file(cache_path, ios::binary);
-        if (file.is_open()) {
-            stringstream ss;
-            ss << file.rdbuf();
-            response = ss.str();
-            content_type = "image/png";
-        } else {
+        // Тайл по адресу меняется редко: браузер час берёт его из своего кэша, потом сверяет ETag
+        if (!serve_file(cache_path, out, "public, max-age=3600")) {
+            out.status = 404;
             response = "Tile not found";
             content_type = "text/plain";
         }
     } else {
+        out.status = 404;
         response = "Not found";
         content_type = "text/plain";
     }
+}
+
+// Тело POST /api/ingest: записи уходят в конвейер прямо с реактора, по мере прихода
+struct IngestBodyStream : HttpBodyStream {
+    BatchIngest batch;
+    IngestPipeline* pipeline;
+
+    IngestBodyStream(SharedData* shared, IngestPipeline* pipeline) : batch(shared, pipeline), pipeline(pipeline) {}
+    void feed(const char* data, size_t size) override { batch.feed(data, size); }
+    bool ready() override { return batch.ready(); }
+};
+
+// У каждого потока пула HTTP своё соединение с БД: pqxx::connection не потокобезопасен
+static DBClient* worker_db() {
+    static thread_local unique_ptr<DBClient> db;
+    static thread_local chrono::steady_clock::time_point next_attempt;
+    
+    if (db && db->isConnected()) return db.get();
     
-    string http_response = "HTTP/1.1 200 OK\r\n";
-    http_response += "Content-Type: " + content_type + "\r\n";
-    http_response += "Access-Control-Allow-Origin: *\r\n";
-    http_response += "Content-Length: " + to_string(response.length()) + "\r\n";
-    http_response += "Connection: close\r\n\r\n";
-    http_response += response;
+    auto now = chrono::steady_clock::now();
+    if (now < next_attempt) return nullptr;
+    next_attempt = now + chrono::seconds(5);
     
-    send(client_fd, http_response.c_str(), http_response.length(), 0);
+    db = make_unique<DBClient>(kDbConnString);
+    return db->isConnected() ? db.get() : nullptr;
 }
 
-void run_http_server(SharedData* shared) {
-    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd < 0) {
-        cerr << "HTTP socket creation failed" << endl;
+// Ответ из кэша по поколению данных; build строит его заново (один на все одновременные запросы).
+// ETag — поколение, на котором построен ответ: опрос без новых данных получает 304;
+// variant отличает представления одного URL (JSON и двоичное)
+static void serve_cached(const string& key, HttpResponse& out, const ResponseCache::Builder& build,
+                         const char* variant = "", ResponseCache& cache = response_cache()) {
+    ResponseCache::EntryPtr entry = cache.get(key, build);
+    out.shared_body = shared_ptr<const string>(entry, &entry->body);
+    out.variants = shared_ptr<const CompressedVariants>(entry, &entry->compressed);
+    out.content_type = entry->content_type;
+    out.etag = "\"g" + to_string(entry->generation) + variant + "\"";
+    out.last_modified = entry->built_at;
+    out.headers.emplace_back("Cache-Control", "no-cache");
+}
+
+// Тайл, который строится по индексу точек (/heat, /mvt): format — шаблон sscanf для z/x/y.
+// Кэш по пути тайла (свой, отдельно от ответов API), сбрасывается поколением данных
+static void serve_index_tile(const string& path, HttpResponse& out, const char* format, int max_zoom,
+                             const function<bool(const PointIndex&, int, int, int, string&)>& build,
+                             const char* content_type) {
+    int z, x, y;
+    char tail;
+    PointIndexPtr index;
+    if (sscanf(path.c_str(), format, &z, &x, &y, &tail) != 3 ||
+        z < 0 || z > max_zoom || x < 0 || y < 0 || x >= (1 << z) || y >= (1 << z)) {
+        out.status = 404;
+        out.body = "Not found";
+        out.content_type = "text/plain";
+    } else if (DBClient* db = worker_db(); !db || !(index = point_index(*db))) {
+        out.status = 503;
+        out.body = "DB not connected";
+        out.content_type = "text/plain";
+    } else {
+        serve_cached(path, out, [&build, index, z, x, y, content_type](ResponseCache::Entry& e) {
+            if (!build(*index, z, x, y, e.body)) throw runtime_error("tile encoding failed");
+            e.content_type = content_type;
+            e.generation = index->generation();
+        }, "", tile_cache());
+    }
+}
+
+// /heat/{z}/{x}/{y}.png — тепловой слой
+static void handle_heat_request(const string& path, HttpResponse& out) {
+    static const HeatTileRenderer renderer;
+    serve_index_tile(path, out, "/heat/%d/%d/%d.png%c", HeatTileRenderer::kMaxZoom,
+                     [](const PointIndex& index, int z, int x, int y, string& body) {
+                         return renderer.render(index, z, x, y, body);
+                     }, "image/png");
+}
+
+// /mvt/{z}/{x}/{y}.pbf — точки и кластеры для клиентов со своей стилизацией (MapLibre и т. п.)
+static void handle_mvt_request(const string& path, HttpResponse& out) {
+    serve_index_tile(path, out, "/mvt/%d/%d/%d.pbf%c", kMvtMaxZoom, encode_mvt_tile, kMvtContentType);
+}
+
+// Фоновые сборки теплокарты; индекс поток заданий берёт через своё соединение с БД
+static HeatmapJobs& heatmap_jobs() {
+    static HeatmapJobs jobs([]() -> PointIndexPtr {
+        DBClient* db = worker_db();
+        return db ? point_index(*db) : nullptr;
+    });
+    return jobs;
+}
+
+static string heatmap_job_json(const HeatmapJobStatus& job) {
+    string out;
+    JsonWriter w(out);
+    w.beginObject();
+    if (!job.error.empty()) {
+        w.key("error");
+        w.value(job.error);
+    }
+    w.key("id");
+    w.value(job.id);
+    if (job.image) {
+        w.key("legend");
+        w.value("/api/heatmap/" + job.id + ".json");
+        w.key("png");
+        w.value("/api/heatmap/" + job.id + ".png");
+    }
+    w.key("progress");
+    w.value(job.tiles_total ? (double)job.tiles_done / job.tiles_total : 0.0);
+    w.key("seconds");
+    w.value(job.seconds);
+    w.key("state");
+    w.value(heatmap_job_state_name(job.state));
+    w.endObject();
+    return out;
+}
+
+// /api/heatmap/{id} — состояние задания, {id}.png и {id}.json — готовая картинка и легенда
+static void handle_heatmap_job_request(const string& path, HttpResponse& out) {
+    string name = path.substr(strlen("/api/heatmap/"));
+    string suffix;
+    size_t dot = name.find('.');
+    if (dot != string::npos) {
+        suffix = name.substr(dot);
+        name.resize(dot);
+    }
+
+    HeatmapJobStatus job;
+    if ((suffix != "" && suffix != ".png" && suffix != ".json") || !heatmap_jobs().status(name, job)) {
+        out.status = 404;
+        out.content_type = "application/json";
+        out.body = "{\"error\": \"no such job\"}";
         return;
     }
-    
-    int opt = 1;
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        cerr << "HTTP setsockopt failed" << endl;
+    if (suffix.empty()) {
+        out.content_type = "application/json";
+        out.headers.emplace_back("Cache-Control", "no-store");
+        out.body = heatmap_job_json(job);
+        return;
     }
-    
-    struct sockaddr_in address;
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(8081);
-    
-    if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
-        cerr << "HTTP server bind failed on port 8081" << endl;
-        close(server_fd);
+    if (!job.image) {
+        // Ещё не готово (или не удалось): вместо картинки — состояние
+        out.status = 404;
+        out.content_type = "application/json";
+        out.body = heatmap_job_json(job);
         return;
     }
+    // Результат задания не меняется: отдаём без копии, ETag — номер задания
+    bool png = suffix == ".png";
+    out.shared_body = shared_ptr<const string>(job.image, png ? &job.image->png : &job.image->legend);
+    out.content_type = png ? "image/png" : "application/json";
+    out.etag = "\"hm" + job.id + suffix + "\"";
+}
+
+// Страница /api/range: по умолчанию и не больше чем
+static const long long kRangeDefaultLimit = 1000;
+static const long long kRangeMaxLimit = 50000;
+
+static bool parse_ll(const string& s, long long& value) {
+    if (s.empty()) return false;
+    char* end = nullptr;
+    value = strtoll(s.c_str(), &end, 10);
+    return *end == '\0';
+}
+
+// bbox=min_lon,min_lat,max_lon,max_lat (порядок GeoJSON и Leaflet toBBoxString())
+static bool parse_bbox(const string& s, double& min_lon, double& min_lat, double& max_lon, double& max_lat) {
+    char tail;
+    if (sscanf(s.c_str(), "%lf,%lf,%lf,%lf%c", &min_lon, &min_lat, &max_lon, &max_lat, &tail) != 4) return false;
+    return min_lon <= max_lon && min_lat <= max_lat && min_lat >= -90 && max_lat <= 90 &&
+           min_lon >= -180 && max_lon <= 180;
+}
+
+// Параметры /api/range: imei, from, to (мс), bbox=min_lon,min_lat,max_lon,max_lat, types=LTE,GSM,
+// limit, after — токен продолжения из прошлой страницы. false — ошибка в error
+static bool parse_range_query(const HttpRequest& request, RangeQuery& q, string& error) {
+    auto fail = [&](const char* message) {
+        error = message;
+        return false;
+    };
+
+    q.imei = request.param("imei");
+
+    string from = request.param("from"), to = request.param("to");
+    if (!from.empty() && (!parse_ll(from, q.from) || q.from < 0)) return fail("bad from");
+    if (!to.empty() && (!parse_ll(to, q.to) || q.to <= q.from)) return fail("bad to");
+
+    string bbox = request.param("bbox");
+    if (!bbox.empty()) {
+        if (!parse_bbox(bbox, q.min_lon, q.min_lat, q.max_lon, q.max_lat)) {
+            return fail("bad bbox, expected min_lon,min_lat,max_lon,max_lat");
+        }
+        q.has_bbox = true;
+    }
+
+    string types = request.param("types");
+    for (size_t pos = 0; pos < types.size();) {
+        size_t end = types.find(',', pos);
+        if (end == string::npos) end = types.size();
+        string type = types.substr(pos, end - pos);
+        if (!type.empty()) {
+            if (type.size() > 16 || q.types.size() >= 8) return fail("bad types");
+            q.types.push_back(type);
+        }
+        pos = end + 1;
+    }
+
+    string limit = request.param("limit");
+    q.limit = kRangeDefaultLimit;
+    if (!limit.empty() && (!parse_ll(limit, q.limit) || q.limit <= 0)) return fail("bad limit");
+    q.limit = min(q.limit, kRangeMaxLimit);
+
+    // Токен — "<timestamp>_<id>" последней отданной строки
+    string after = request.param("after");
+    if (!after.empty()) {
+        size_t sep = after.find('_');
+        if (sep == string::npos || !parse_ll(after.substr(0, sep), q.after_timestamp) ||
+            !parse_ll(after.substr(sep + 1), q.after_id)) {
+            return fail("bad after");
+        }
+        q.has_after = true;
+    }
+    return true;
+}
+
+// Точка карты из принятой записи: координаты из location (или корня записи),
+// сигнал — сильнейшая сота, как в /api/points
+static bool record_point(const json& record, MapPoint& p) {
+    const json& loc = record.contains("location") && record["location"].is_object() ? record["location"] : record;
+    auto lat = loc.find("latitude");
+    auto lon = loc.find("longitude");
+    if (lat == loc.end() || lon == loc.end() || !lat->is_number() || !lon->is_number()) return false;
+    p.lat = lat->get<double>();
+    p.lon = lon->get<double>();
+    if (p.lat == 0.0 && p.lon == 0.0) return false;
+
+    p.signal_strength = -120;
+    bool found = false;
+    auto telephony = record.find("telephony");
+    if (telephony != record.end() && telephony->is_object()) {
+        for (const auto& cell : *telephony) {
+            if (!cell.is_object()) continue;
+            auto v = cell.find("rsrp");
+            if (v == cell.end() || !v->is_number()) v = cell.find("dbm");
+            if (v == cell.end() || !v->is_number()) continue;
+            int dbm = v->get<int>();
+            if (!found || dbm > p.signal_strength) p.signal_strength = dbm;
+            found = true;
+        }
+    }
+    p.timestamp = record.value("timestamp", 0LL);
+    return true;
+}
+
+// Слушатель конвейера: пачка сохранённых записей — одно событие "points" для /api/stream.
+// Без подписчиков ничего не собирает; сам не ждёт, кадр раскладывают реакторы
+static void publish_live_points(const vector<const json*>& records, long long last_seq) {
+    {
+        lock_guard<mutex> lock(g_http_server_mutex);
+        if (!g_http_server || !g_http_server->subscribers()) return;
+    }
+
+    string data;
+    JsonWriter w(data);
+    w.beginArray();
+    size_t count = 0;
+    for (const json* record : records) {
+        MapPoint p;
+        if (!record_point(*record, p)) continue;
+        w.beginObject();
+        w.key("lat");
+        w.value(p.lat);
+        w.key("lon");
+        w.value(p.lon);
+        w.key("signal");
+        w.value(p.signal_strength);
+        w.key("timestamp");
+        w.value(p.timestamp);
+        w.endObject();
+        count++;
+    }
+    w.endArray();
+    if (!count) return;
+
+    // publish только раскладывает кадр по очередям реакторов, держать мьютекс недолго
+    string event = sse_event("points", data, to_string(last_seq));
+    lock_guard<mutex> lock(g_http_server_mutex);
+    if (g_http_server) g_http_server->publish("points", std::move(event));
+}
+
+// Только файлы с диска: такие запросы идут в отдельный пул и не ждут за запросами к БД
+static bool is_file_request(const HttpRequest& request) {
+    const string& path = request.path;
+    return path.compare(0, 6, "/tile/") == 0 || path == "/" || path == "/heatmap.html" ||
+           path == "/data/all_data.json" || path == "/data/location_danil.json" || path == "/data/locations.json";
+}
+
+// Маршруты HTTP; выполняется в потоке пула
+static void handle_http_request(const HttpRequest& request, HttpResponse& out, HttpBodyStream* body) {
+    const string& path = request.path;
+    string& response = out.body;
+    string& content_type = out.content_type;
+    int& status = out.status;
     
-    if (listen(server_fd, 10) < 0) {
-        cerr << "HTTP server listen failed" << endl;
-        close(server_fd);
+    // Обработка запросов тайлов
+    if (path.find("/tile/") == 0) {
+        handle_tile_request(path, out);
+        return;
+    }
+    if (path.find("/heat/") == 0) {
+        handle_heat_request(path, out);
+        return;
+    }
+    if (path.find("/mvt/") == 0) {
+        handle_mvt_request(path, out);
         return;
     }
     
-    cout << "HTTP server started on port 8081" << endl;
-    
-    while (true) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
-        
-        if (client_fd < 0) continue;
-        
-        char buffer[8192] = {0};
-        read(client_fd, buffer, sizeof(buffer) - 1);
-        
-        string request(buffer);
-        string response;
-        string content_type = "text/html";
-        
-        // Парсим путь
-        string path = "/";
-        size_t path_start = request.find("GET ") + 4;
-        size_t path_end = request.find(" ", path_start);
-        if (path_end != string::npos) {
-            path = request.substr(path_start, path_end - path_start);
+    // Обработка API запросов
+    if (path == "/api/ingest") {
+        content_type = "application/json";
+        if (request.method != "POST") {
+            status = 405;
+            response = "{\"error\": \"use POST\"}";
+        } else if (!body) {
+            status = 503;
+            response = "{\"error\": \"ingest pipeline not running\"}";
+        } else {
+            IngestBodyStream& stream = *static_cast<IngestBodyStream*>(body);
+            BatchIngest& batch = stream.batch;
+            batch.finish();
+            JsonWriter w(response);
+            w.beginObject();
+            w.key("accepted");
+            w.value(batch.accepted());
+            // Совет по выборке каждому устройству тела — как в ответе ZMQ
+            w.key("advice");
+            w.beginObject();
+            for (const auto& [imei, records] : batch.devices()) {
+                SamplingAdvice advice = stream.pipeline->advise(imei, records);
+                w.key(imei);
+                w.beginObject();
+                w.key("batch");
+                w.value(advice.batch);
+                w.key("interval_ms");
+                w.value(advice.interval_ms);
+                w.endObject();
+            }
+            w.endObject();
+            w.key("filtered");
+            w.value(batch.filtered());
+            w.key("last");
+            w.value(batch.lastSeq());
+            w.key("rejected");
+            w.value(batch.rejected());
+            w.endObject();
         }
-        
-        // Обработка запросов тайлов
-        if (path.find("/tile/") == 0) {
-            handle_tile_request(client_fd, path);
-            close(client_fd);
-            continue;
+    }
+    else if (path == "/api/metrics") {
+        response = render_prometheus_metrics();
+        content_type = "text/plain; version=0.0.4";
+    }
+    else if (path == "/api/trace") {
+        response = trace_dump_json();
+        content_type = "application/json";
+    }
+    else if (path == "/api/trace/start" || path == "/api/trace/stop") {
+        trace_set_enabled(path == "/api/trace/start");
+        response = string("{\"tracing\": ") + (trace_enabled() ? "true" : "false") + "}";
+        content_type = "application/json";
+    }
+    else if (path == "/api/points" && !request.param("zoom").empty()) {
+        // Кластеры видимой области: не больше PointIndex::kMaxItems элементов на любом зуме
+        ClusterQuery query;
+        long long zoom = 0;
+        string bbox = request.param("bbox");
+        content_type = "application/json";
+        if (!parse_ll(request.param("zoom"), zoom) || zoom < 0 || zoom > 24 ||
+            (!bbox.empty() && !parse_bbox(bbox, query.min_lon, query.min_lat, query.max_lon, query.max_lat))) {
+            status = 400;
+            response = "{\"error\": \"expected zoom=0..24 and bbox=min_lon,min_lat,max_lon,max_lat\"}";
+        } else if (DBClient* db = worker_db(); PointIndexPtr index = db ? point_index(*db) : nullptr) {
+            query.zoom = (int)zoom;
+            ClusterPlan plan = index->plan(query);
+            // Ключ — область, привязанная к сетке: сдвиг карты внутри ячейки попадает в кэш
+            serve_cached("/api/points?" + plan.key(), out, [index, plan](ResponseCache::Entry& e) {
+                vector<PointCluster> clusters;
+                index->collect(plan, clusters);
+                e.body = encode_clusters_json(plan, clusters);
+                e.content_type = "application/json";
+                e.generation = index->generation();
+            });
+        } else {
+            response = "{\"items\":[],\"level\":0,\"raw\":false}";
         }
-        
-        // Обработка API запросов
-        if (path == "/api/points") {
-            if (g_db_client && g_db_client->isConnected()) {
-                auto points = g_db_client->loadPoints(10000);
-                json points_json = json::array();
-                for (const auto& p : points) {
-                    points_json.push_back({
-                        {"lat", p.lat},
-                        {"lon", p.lon},
-                        {"signal", p.signal_strength},
-                        {"timestamp", p.timestamp}
-                    });
+    }
+    else if (path == "/api/points") {
+        // Двоичный вид (столбцы int32/int8) — по ?format=bin или Accept, см. point_codec.hpp
+        bool binary = wants_binary_points(request.param("format"), request.header("accept"));
+        out.headers.emplace_back("Vary", "Accept");
+        if (DBClient* db = worker_db()) {
+            serve_cached(binary ? "/api/points?format=bin" : path, out, [db, binary](ResponseCache::Entry& e) {
+                auto points = db->loadPoints(10000);
+                if (binary && encode_points_binary(points, e.body)) {
+                    e.content_type = kPointsBinaryType;
+                } else {
+                    e.body = encode_points_json(points);
+                    e.content_type = "application/json";
                 }
-                response = points_json.dump();
-                content_type = "application/json";
-            } else {
-                response = "[]";
-                content_type = "application/json";
-            }
+            }, binary ? "-bin" : "");
+        } else {
+            response = "[]";
+            content_type = "application/json";
         }
-        else if (path == "/api/stats") {
-            if (g_db_client && g_db_client->isConnected()) {
-                json stats = {
-                    {"measurements", g_db_client->getMeasurementCount()},
-                    {"cells", g_db_client->getCellCount()},
-                    {"locations", g_db_client->getLocationCount()},
-                    {"traffic", g_db_client->getTrafficCount()}
-                };
-                response = stats.dump();
-                content_type = "application/json";
-            } else {
-                response = "{}";
-                content_type = "application/json";
-            }
+    }
+    else if (path == "/api/export") {
+        // Все точки (или ?limit=N) потоком из курсора БД: память не растёт с числом строк
+        content_type = "application/json";
+        long long limit = 0;
+        string limit_param = request.param("limit");
+        if (!limit_param.empty() && (!parse_ll(limit_param, limit) || limit <= 0)) {
+            status = 400;
+            response = "{\"error\": \"bad limit\"}";
+        } else if (DBClient* db = worker_db()) {
+            out.headers.emplace_back("Cache-Control", "no-store");
+            out.stream = [db, limit](HttpChunkSink& sink) {
+                string chunk;
+                chunk.reserve(16 * 1024);
+                JsonWriter w(chunk);
+                w.beginArray();
+                bool ok = db->streamPoints(limit, [&](const MapPoint& p) {
+                    w.beginObject();
+                    w.key("lat");
+                    w.value(p.lat);
+                    w.key("lon");
+                    w.value(p.lon);
+                    w.key("signal");
+                    w.value(p.signal_strength);
+                    w.key("timestamp");
+                    w.value(p.timestamp);
+                    w.endObject();
+                    if (chunk.size() < 8 * 1024) return true;
+                    bool more = sink.write(chunk);
+                    chunk.clear();
+                    return more;
+                });
+                if (!ok) throw runtime_error("point stream failed");
+                w.endArray();
+                sink.write(chunk);
+            };
+        } else {
+            status = 503;
+            response = "{\"error\": \"DB not connected\"}";
         }
-        else if (path == "/api/import") {
-            // Импорт JSON файлов через API
-            if (g_db_client && g_db_client->isConnected()) {
-                g_db_client->importJsonDirectory("data");
-                response = "{\"status\": \"import started\"}";
-                content_type = "application/json";
-            } else {
-                response = "{\"error\": \"DB not connected\"}";
-                content_type = "application/json";
-            }
+    }
+    else if (path == "/api/stream") {
+        // Новые точки по мере сохранения (Server-Sent Events). Подписка держит только
+        // соединение на реакторе; "reset" — очередь переполнилась, перечитать /api/points
+        content_type = "text/event-stream";
+        out.headers.emplace_back("Cache-Control", "no-cache");
+        out.headers.emplace_back("X-Accel-Buffering", "no");
+        out.event_channel = "points";
+        response = "retry: 3000\n\n";
+    }
+    else if (path == "/api/range") {
+        // История построчно (NDJSON); если строк больше limit — последняя строка {"next": "<токен>"}
+        RangeQuery query;
+        string error;
+        DBClient* db = nullptr;
+        if (!parse_range_query(request, query, error)) {
+            status = 400;
+            content_type = "application/json";
+            JsonWriter w(response);
+            w.beginObject();
+            w.key("error");
+            w.value(error);
+            w.endObject();
+        } else if (!(db = worker_db())) {
+            status = 503;
+            content_type = "application/json";
+            response = "{\"error\": \"DB not connected\"}";
+        } else {
+            content_type = "application/x-ndjson";
+            out.headers.emplace_back("Cache-Control", "no-store");
+            out.stream = [db, query](HttpChunkSink& sink) mutable {
+                long long limit = query.limit;
+                query.limit = limit + 1; // лишняя строка — признак следующей страницы
+                long long rows = 0, last_timestamp = 0, last_id = 0;
+                bool more = false;
+                string chunk;
+                chunk.reserve(16 * 1024);
+                bool ok = db->streamRange(query, [&](const RangePoint& p) {
+                    if (rows == limit) {
+                        more = true;
+                        return false;
+                    }
+                    JsonWriter w(chunk);
+                    w.beginObject();
+                    w.key("id");
+                    w.value(p.id);
+                    w.key("imei");
+                    w.value(p.imei);
+                    w.key("lat");
+                    w.value(p.lat);
+                    w.key("lon");
+                    w.value(p.lon);
+                    w.key("signal");
+                    w.value(p.signal_strength);
+                    w.key("timestamp");
+                    w.value(p.timestamp);
+                    w.key("type");
+                    w.value(p.type);
+                    w.endObject();
+                    chunk += '\n';
+                    rows++;
+                    last_timestamp = p.timestamp;
+                    last_id = p.id;
+                    if (chunk.size() < 8 * 1024) return true;
+                    bool open = sink.write(chunk);
+                    chunk.clear();
+                    return open;
+                });
+                if (!ok) throw runtime_error("range stream failed");
+                if (more) {
+                    chunk += "{\"next\":\"" + to_string(last_timestamp) + "_" + to_string(last_id) + "\"}\n";
+                }
+                sink.write(chunk);
+            };
         }
-        else if (path == "/" || path == "/heatmap.html") {
-            ifstream file("heatmap.html");
-            if (file.is_open()) {
-                stringstream ss;
-                ss << file.rdbuf();
-                response = ss.str();
-                content_type = "text/html";
-            } else {
-                response = R"(
-                <!DOCTYPE html>
-                <html>
-                <head>
-                    <title>Heatmap</title>
-                    <style>
-                        #map { height: 100vh; width: 100vw; }
-                        body { margin: 0; padding: 0; }
-                    </style>
-                </head>
-                <body>
-                    <div id="map"></div>
-                    <script>
-                        var map = L.map('map').setView([55.007969, 82.944546], 13);
-                        L.tileLayer('http://localhost:8081/tile/{z}/{x}/{y}.png', {
-                            attribution: '&copy; <a href="https://www.openstreetmap.org/copyright">OSM</a>',
-                            maxZoom: 18
-                        }).addTo(map);
-                        
-                        fetch('/api/points')
+    }
+    else if (path == "/api/stats") {
+        if (DBClient* db = worker_db()) {
+            serve_cached(path, out, [db](ResponseCache::Entry& e) {
+                JsonWriter w(e.body);
+                w.beginObject();
+                w.key("cells");
+                w.value(db->getCellCount());
+                w.key("locations");
+                w.value(db->getLocationCount());
+                w.key("measurements");
+                w.value(db->getMeasurementCount());
+                w.key("traffic");
+                w.value(db->getTrafficCount());
+                w.endObject();
+                e.content_type = "application/json";
+            });
+        } else {
+            response = "{}";
+            content_type = "application/json";
+        }
+    }
+    else if (path == "/api/import") {
+        // Импорт JSON файлов через API
+        if (DBClient* db = worker_db()) {
+            db->importJsonDirectory("data");
+            point_index_invalidate();
+            bump_data_generation();
+            response = "{\"status\": \"import started\"}";
+            content_type = "application/json";
+        } else {
+            response = "{\"error\": \"DB not connected\"}";
+            content_type = "application/json";
+        }
+    }
+    else if (path == "/" || path == "/heatmap.html") {
+        if (!serve_file("heatmap.html", out)) {
+            response = R"(
+            <!DOCTYPE html>
+            <html>
+            <head>
+                <title>Heatmap</title>
+                <style>
+                    #map { height: 100vh; width: 100vw; }
+                    body { margin: 0; padding: 0; }
+                </style>
+            </head>
+            <body>
+                <div id="map"></div>
+                <script>
+                    var map = L.map('map').setView([55.007969, 82.944546], 13);
+                    L.tileLayer('http://localhost:8081/tile/{z}/{x}/{y}.png', {
+                        attribution: '&copy; <a href="https://www.openstreetmap.org/copyright">OSM</a>',
+                        maxZoom: 18
+                    }).addTo(map);
+                    
+                    // Кластеры видимой области считает сервер: маркеров не больше, чем ячеек 64 px на экране
+                    var layer = L.layerGroup().addTo(map), seq = 0;
+                    function refresh() {
+                        if (!map.hasLayer(layer)) return;
+                        var my = ++seq;
+                        fetch('/api/points?zoom=' + map.getZoom() + '&bbox=' + map.getBounds().toBBoxString())
                             .then(r => r.json())
-                            .then(points => {
-                                points.forEach(p => {
-                                    L.circleMarker([p.lat, p.lon], {
-                                        radius: 3,
-                                        color: p.signal > -80 ? '#00ff00' : p.signal > -90 ? '#64ff00' : p.signal > -100 ? '#ffff00' : '#ff0000',
+                            .then(data => {
+                                if (my !== seq) return;
+                                layer.clearLayers();
+                                data.items.forEach(c => {
+                                    var s = c.signal;
+                                    L.circleMarker([c.lat, c.lon], {
+                                        radius: c.count > 1 ? Math.min(22, 5 + 3 * Math.log2(c.count)) : 3,
+                                        color: s > -80 ? '#00ff00' : s > -90 ? '#64ff00' : s > -100 ? '#ffff00' : '#ff0000',
                                         weight: 1,
-                                        fillOpacity: 0.8
-                                    }).addTo(map).bindPopup('Signal: ' + p.signal + ' dBm');
+                                        fillOpacity: 0.7
+                                    }).addTo(layer).bindPopup((c.count > 1 ? c.count + ' points, avg ' : 'Signal: ') + s + ' dBm');
                                 });
                             });
-                    </script>
-                </body>
-                </html>
-                )";
-                content_type = "text/html";
-            }
-        }
-        else if (path == "/generate_heatmap") {
-            system("python3 generate_heatmap.py");
-            response = "{\"status\": \"generated\"}";
-            content_type = "application/json";
-        }
-        else if (path == "/data/all_data.json") {
-            ifstream file("data/all_data.json");
-            if (file.is_open()) {
-                stringstream ss;
-                ss << file.rdbuf();
-                response = ss.str();
-                content_type = "application/json";
-            } else {
-                response = "[]";
-                content_type = "application/json";
-            }
-        }
-        else if (path == "/data/location_danil.json") {
-            ifstream file("data/location_danil.json");
-            if (file.is_open()) {
-                stringstream ss;
-                ss << file.rdbuf();
-                response = ss.str();
-                content_type = "application/json";
-            } else {
-                response = "[]";
-            }
+                    }
+                    map.on('moveend overlayadd', refresh);
+                    refresh();
+
+                    // Новые измерения приходят сразу (SSE); после "reset" слой перечитывается целиком
+                    var live = new EventSource('/api/stream');
+                    live.addEventListener('points', e => {
+                        if (!map.hasLayer(layer)) return;
+                        JSON.parse(e.data).forEach(p => {
+                            var s = p.signal;
+                            L.circleMarker([p.lat, p.lon], {
+                                radius: 3,
+                                color: s > -80 ? '#00ff00' : s > -90 ? '#64ff00' : s > -100 ? '#ffff00' : '#ff0000',
+                                weight: 1,
+                                fillOpacity: 0.7
+                            }).addTo(layer).bindPopup('Signal: ' + s + ' dBm');
+                        });
+                    });
+                    live.addEventListener('reset', refresh);
+
+                    // Тепловой слой рисует сервер обычными тайлами поверх подложки
+                    var heat = L.tileLayer('/heat/{z}/{x}/{y}.png', {maxZoom: 18, opacity: 0.9}).addTo(map);
+                    L.control.layers(null, {'Heat': heat, 'Points': layer}).addTo(map);
+                </script>
+            </body>
+            </html>
+            )";
+            content_type = "text/html";
         }
-        else if (path == "/data/locations.json") {
-            ifstream file("data/locations.json");
-            if (file.is_open()) {
-                stringstream ss;
-                ss << file.rdbuf();
-                response = ss.str();
-                content_type = "application/json";
+    }
+    else if (path == "/generate_heatmap") {
+        // Сборка в фоне: сразу номер задания, дальше опрос /api/heatmap/{id}
+        HeatmapRequest heat;
+        string bbox = request.param("bbox");
+        content_type = "application/json";
+        if (!bbox.empty() && !parse_bbox(bbox, heat.min_lon, heat.min_lat, heat.max_lon, heat.max_lat)) {
+            status = 400;
+            response = "{\"error\": \"bad bbox\"}";
+        } else {
+            heat.has_bbox = !bbox.empty();
+            if (!request.param("size").empty()) heat.max_size = atoi(request.param("size").c_str());
+            string id = heatmap_jobs().submit(heat);
+            HeatmapJobStatus job;
+            if (id.empty() || !heatmap_jobs().status(id, job)) {
+                status = 503;
+                response = "{\"error\": \"too many heatmap jobs\"}";
             } else {
-                response = "[]";
+                status = 202;
+                out.headers.emplace_back("Location", "/api/heatmap/" + id);
+                response = heatmap_job_json(job);
             }
         }
-        else {
-            response = "<html><body><h1>404 Not Found</h1></body></html>";
+    }
+    else if (path.compare(0, 13, "/api/heatmap/") == 0) {
+        handle_heatmap_job_request(path, out);
+    }
+    else if (path == "/data/all_data.json" || path == "/data/location_danil.json" ||
+             path == "/data/locations.json") {
+        // all_data.json — мегабайты: отдаём с диска через sendfile, без чтения в память
+        if (!serve_file(path.substr(1), out)) {
+            response = "[]";
+            content_type = "application/json";
         }
-        
-        string http_response = "HTTP/1.1 200 OK\r\n";
-        http_response += "Content-Type: " + content_type + "\r\n";
-        http_response += "Access-Control-Allow-Origin: *\r\n";
-        http_response += "Content-Length: " + to_string(response.length()) + "\r\n";
-        http_response += "Connection: close\r\n\r\n";
-        http_response += response;
-        
-        send(client_fd, http_response.c_str(), http_response.length(), 0);
-        close(client_fd);
     }
+    else {
+        status = 404;
+        response = "<html><body><h1>404 Not Found</h1></body></html>";
+    }
+}
+
+void run_http_server(SharedData* shared) {
+    trace_set_thread_name("http");
     
-    close(server_fd);
+    HttpServer::Options options;
+    options.port = 8081;
+    options.compression_level = shared->http_compression_level;
+    
+    HttpServer server(options, handle_http_request,
+        [shared](const HttpRequest& request) -> unique_ptr<HttpBodyStream> {
+            IngestPipeline* pipeline = g_pipeline.load();
+            if (request.method != "POST" || request.path != "/api/ingest" || !pipeline) return nullptr;
+            return make_unique<IngestBodyStream>(shared, pipeline);
+        },
+        is_file_request);
+    
+    if (!server.start()) return;
+    {
+        lock_guard<mutex> lock(g_http_server_mutex);
+        g_http_server = &server;
+    }
+    
+    while (!shutdown_requested()) {
+        this_thread::sleep_for(chrono::milliseconds(200));
+    }
+    
+    // После этого слушатель конвейера сервер уже не увидит, и stop() не пересечётся с publish
+    {
+        lock_guard<mutex> lock(g_http_server_mutex);
+        g_http_server = nullptr;
+    }
+    server.stop();
+    LOG_INFO("http", "HTTP server stopped");
 }
 
 void run_server(SharedData* shared) {
+    trace_set_thread_name("ingest");
+    
     // Инициализация DBClient вместо старого db_conn
     try {
-        g_db_client = make_unique<DBClient>("dbname=cellmap user=postgres password=postgres host=localhost port=5434");
+        g_db_client = make_unique<DBClient>(kDbConnString);
         if (g_db_client->isConnected()) {
             // Инициализируем схему БД
             g_db_client->initializeSchema();
-            cout << "Connected to PostgreSQL via DBClient" << endl;
+            LOG_INFO("server", "Connected to PostgreSQL via DBClient");
             
             // Автоматически импортируем JSON файлы при старте
             if (fs::exists("data")) {
-                cout << "Importing JSON files from data/ directory..." << endl;
+                LOG_INFO("server", "Importing JSON files from data/ directory...");
                 g_db_client->importJsonDirectory("data");
             }
         } else {
-            cerr << "Failed to connect to PostgreSQL" << endl;
+            LOG_ERROR("server", "Failed to connect to PostgreSQL");
         }
     } catch (const exception& e) {
-        cerr << "DB connection error: " << e.what() << endl;
+        LOG_ERROR("server", "DB connection error: " << e.what());
         g_db_client.reset();
     }
     
     // Запускаем HTTP сервер в отдельном потоке
     thread http_thread(run_http_server, shared);
-    http_thread.detach();
     
     context_t context(1);
     socket_t socket(context, socket_type::rep);
+    socket.set(zmq::sockopt::rcvtimeo, 200);
+    socket.set(zmq::sockopt::linger, 0);
     
     int retry_count = 0;
     while (retry_count < 5) {
@@ -353,15 +910,17 @@ void run_server(SharedData* shared) {
             socket.bind("tcp://*:8080");
             break;
         } catch (const zmq::error_t& e) {
-            cerr << "Failed to bind to 8080, attempt " << retry_count + 1 << ": " << e.what() << endl;
+            LOG_WARN("server", "Failed to bind to 8080, attempt " << retry_count + 1 << ": " << e.what());
             retry_count++;
             if (retry_count >= 5) {
-                cerr << "Could not bind to port 8080 after 5 attempts. Trying port 8085..." << endl;
+                LOG_WARN("server", "Could not bind to port 8080 after 5 attempts. Trying port 8085...");
                 try {
                     socket.bind("tcp://*:8085");
-                    cout << "Using alternative port 8085" << endl;
+                    LOG_INFO("server", "Using alternative port 8085");
                 } catch (const zmq::error_t& e2) {
-                    cerr << "Failed to bind to any port: " << e2.what() << endl;
+                    LOG_ERROR("server", "Failed to bind to any port: " << e2.what());
+                    request_shutdown();
+                    http_thread.join();
                     return;
                 }
             }
@@ -369,16 +928,34 @@ void run_server(SharedData* shared) {
         }
     }
 
+    MeasurementPublisher publisher(context, "tcp://*:8082");
+    
+    auto policy = make_sampling_policy(shared->sampling_policy);
+    if (!policy) {
+        LOG_WARN("server", "Unknown sampling policy '" << shared->sampling_policy << "', using adaptive");
+        policy = make_sampling_policy("adaptive");
+    }
+    LOG_INFO("server", "Sampling policy: " << policy->name());
+    IngestPipeline pipeline(shared, g_db_client.get(), &publisher, std::move(policy));
+    pipeline.setBatchListener(publish_live_points);
+    
+    g_pipeline = &pipeline;
+    
+    RawIngestListener raw_listener(shared, &pipeline, 8083);
+    raw_listener.start();
+    
     string server_ip = get_local_ip();
     
-    cout << "=====================================" << endl;
-    cout << "ZMQ Server started on 0.0.0.0:8080" << endl;
-    cout << "HTTP Server started on 0.0.0.0:8081" << endl;
-    cout << "Server IP address: " << server_ip << endl;
-    cout << "Open browser: http://" << server_ip << ":8081/heatmap.html" << endl;
-    cout << "=====================================" << endl;
-    cout << "For phone connection use: tcp://" << server_ip << ":8080" << endl;
-    cout << "=====================================" << endl;
+    LOG_INFO("server", "=====================================");
+    LOG_INFO("server", "ZMQ Server started on 0.0.0.0:8080");
+    LOG_INFO("server", "HTTP Server started on 0.0.0.0:8081");
+    LOG_INFO("server", "Server IP address: " << server_ip);
+    LOG_INFO("server", "Open browser: http://" << server_ip << ":8081/heatmap.html");
+    LOG_INFO("server", "=====================================");
+    LOG_INFO("server", "For phone connection use: tcp://" << server_ip << ":8080");
+    LOG_INFO("server", "Live feed (ZMQ SUB): tcp://" << server_ip << ":8082");
+    LOG_INFO("server", "Raw TCP/UDP ingest: " << server_ip << ":8083");
+    LOG_INFO("server", "=====================================");
  
     bool phone_connected = false;
     
@@ -387,13 +964,18 @@ void run_server(SharedData* shared) {
     while (true) {
         message_t msg;
         auto recv_result = socket.recv(msg, recv_flags::none);
-        (void)recv_result;
+        if (!recv_result) {
+            // Таймаут приёма: при остановке выходим, только когда входящих больше нет
+            if (shutdown_requested()) break;
+            continue;
+        }
         
+        uint64_t recv_done = metrics_now_ns();
         string raw_text(static_cast<char*>(msg.data()), msg.size());
         
         if (raw_text == "ping") {
             socket.send(zmq::buffer("pong"), zmq::send_flags::none);
-            cout << "Ping received, pong sent" << endl;
+            LOG_DEBUG("server", "Ping received, pong sent");
             continue;
         }
         
@@ -411,7 +993,7 @@ void run_server(SharedData* shared) {
                     else if (filter_name == "gsm") shared->filter_gsm = value;
                     else if (filter_name == "wcdma") shared->filter_wcdma = value;
                     
-                    cout << "Filter updated: " << filter_name << " = " << value << endl;
+                    LOG_INFO("server", "Filter updated: " << filter_name << " = " << value);
                     socket.send(zmq::buffer("OK"), zmq::send_flags::none);
                     continue;
                 }
@@ -441,130 +1023,93 @@ void run_server(SharedData* shared) {
             continue;
         }
         
+        // GUI из другого процесса забирает записи, пришедшие после его счётчика
+        if (raw_text.find("\"since\"") != string::npos) {
+            try {
+                json cmd = json::parse(raw_text);
+                if (cmd.value("type", "") == "since") {
+                    int since = cmd.value("counter", 0);
+                    // Записи сразу в текст, без копии дерева каждой записи в ответ
+                    string reply;
+                    JsonWriter w(reply);
+                    w.beginObject();
+                    {
+                        lock_guard<mutex> lock(shared->data_mutex);
+                        w.key("counter");
+                        w.value(shared->counter);
+                        w.key("records");
+                        w.beginArray();
+                        int available = (int)shared->recent_records.size();
+                        int missing = min(available, max(0, shared->counter - since));
+                        for (int i = available - missing; i < available; i++) {
+                            w.raw(shared->recent_records[i].dump());
+                        }
+                        w.endArray();
+                    }
+                    w.endObject();
+                    socket.send(zmq::buffer(reply), zmq::send_flags::none);
+                    continue;
+                }
+            } catch (...) {
+                socket.send(zmq::buffer("ERROR"), zmq::send_flags::none);
+                continue;
+            }
+        }
+        
         if (!phone_connected) {
-            cout << "PHONE CONNECTED" << endl;
+            LOG_INFO("server", "PHONE CONNECTED");
             phone_connected = true;
         }
         
-        cout << "Received data, size: " << raw_text.size() << " bytes" << endl;
+        LOG_DEBUG("server", "Received data, size: " << raw_text.size() << " bytes");
+        
+        TRACE_SPAN("ingest.message", "ingest");
+        IngestMetrics& metrics = ingest_metrics();
+        metrics.messages++;
+        metrics.bytes += raw_text.size();
+        record_stage(IngestStage::Dispatch, recv_done);
         
         try {
-            json received_data = json::parse(raw_text);
-            
-            // Сохраняем в БД через DBClient
-            if (g_db_client && g_db_client->isConnected()) {
-                g_db_client->importJsonData(received_data);
-            }
-            
-            // Также сохраняем в память для GUI
+            json received_data;
+            bool has_data;
             {
-                lock_guard<mutex> lock(shared->data_mutex);
-                shared->recent_records.push_back(received_data);
-                if (shared->recent_records.size() > shared->max_history) {
-                    shared->recent_records.pop_front();
-                }
-                shared->counter++;
-            }
-
-            // Сохраняем в JSON файлы (для совместимости со старым кодом)
-            json all_data;
-            string all_data_file = "data/all_data.json";
-            ifstream all_file(all_data_file);
-            if (all_file.is_open()) {
-                try {
-                    all_data = json::parse(all_file);
-                } catch (...) {
-                    all_data = json::array();
-                }
-            } else {
-                all_data = json::array();
+                StageTimer timer(IngestStage::Parse);
+                has_data = parse_filtered(raw_text, ingest_filter_snapshot(*shared), received_data);
             }
             
-            all_data.push_back(received_data);
-            
-            ofstream all_file_out(all_data_file);
-            all_file_out << all_data.dump(4);
-            
-            if (received_data.contains("location")) {
-                json location_only;
-                location_only["timestamp"] = received_data.value("timestamp", 0LL);
-                location_only["location"] = received_data["location"];
-                
-                json all_locations;
-                string loc_file = "data/locations.json";
-                ifstream loc_file_in(loc_file);
-                if (loc_file_in.is_open()) {
-                    try {
-                        all_locations = json::parse(loc_file_in);
-                    } catch (...) {
-                        all_locations = json::array();
-                    }
-                } else {
-                    all_locations = json::array();
-                }
-                
-                all_locations.push_back(location_only);
-                
-                ofstream loc_file_out(loc_file);
-                loc_file_out << all_locations.dump(4);
+            // Фильтры отбросили всё: сохранять и рассылать нечего, устройству отвечаем как обычно,
+            // но в частоту его записей такое сообщение не идёт
+            if (!has_data) {
+                string response = advice_reply(pipeline.accepted(), pipeline.advise(record_imei(received_data), 0));
+                StageTimer timer(IngestStage::Reply);
+                socket.send(zmq::buffer(response), zmq::send_flags::none);
+                continue;
             }
             
-            if (received_data.contains("telephony")) {
-                json telephony_only;
-                telephony_only["timestamp"] = received_data.value("timestamp", 0LL);
-                telephony_only["telephony"] = received_data["telephony"];
-                
-                json all_telephony;
-                string tele_file = "data/telephony.json";
-                ifstream tele_file_in(tele_file);
-                if (tele_file_in.is_open()) {
-                    try {
-                        all_telephony = json::parse(tele_file_in);
-                    } catch (...) {
-                        all_telephony = json::array();
-                    }
-                } else {
-                    all_telephony = json::array();
-                }
-                
-                all_telephony.push_back(telephony_only);
-                
-                ofstream tele_file_out(tele_file);
-                tele_file_out << all_telephony.dump(4);
-            }
+            // Сохранение в БД, журнал и рассылка — в потоке конвейера
+            string imei = record_imei(received_data);
+            int records = received_data.is_array() ? (int)received_data.size() : 1;
+            long long accepted = pipeline.submit(std::move(received_data));
             
-            if (received_data.contains("traffic")) {
-                json traffic_only;
-                traffic_only["timestamp"] = received_data.value("timestamp", 0LL);
-                traffic_only["traffic"] = received_data["traffic"];
-                
-                json all_traffic;
-                string traffic_file = "data/traffic.json";
-                ifstream traffic_file_in(traffic_file);
-                if (traffic_file_in.is_open()) {
-                    try {
-                        all_traffic = json::parse(traffic_file_in);
-                    } catch (...) {
-                        all_traffic = json::array();
-                    }
-                } else {
-                    all_traffic = json::array();
-                }
-                
-                all_traffic.push_back(traffic_only);
-                
-                ofstream traffic_file_out(traffic_file);
-                traffic_file_out << all_traffic.dump(4);
+            string response = advice_reply(accepted, pipeline.advise(imei, records));
+            {
+                StageTimer timer(IngestStage::Reply);
+                socket.send(zmq::buffer(response), zmq::send_flags::none);
             }
-
-            string response = "OK:" + to_string(shared->counter);
-            socket.send(zmq::buffer(response), zmq::send_flags::none);
-            cout << "Data #" << shared->counter << " saved" << endl;
             
         } catch (const exception& e) {
-            cerr << "ERROR: " << e.what() << endl;
+            LOG_ERROR_RL("server", 10, "ERROR: " << e.what());
+            metrics.errors++;
             socket.send(zmq::buffer("ERROR"), zmq::send_flags::none);
         }
-        
     }
+    
+    // Все источники записей остановлены до конвейера: он дописывает очередь последним
+    raw_listener.stop();
+    http_thread.join();
+    g_pipeline = nullptr;
+    pipeline.stop();
+    LOG_INFO("server", "Shutting down: ZMQ queue drained, " << shared->counter << " records stored");
+    socket.close();
+    g_db_client.reset();
 }
\ No newline at end of file
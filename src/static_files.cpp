@@ -0,0 +1,164 @@
+#include "static_files.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+StaticFile::~StaticFile() {
+    if (data) munmap((void*)data, size);
+    if (fd >= 0) close(fd);
+}
+
+// FNV-1a по содержимому: файл читается целиком один раз на версию
+const std::string& StaticFile::etag() const {
+    std::call_once(m_etag_once, [this] {
+        uint64_t hash = 14695981039346656037ULL;
+        auto mix = [&hash](const char* p, size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                hash ^= (unsigned char)p[i];
+                hash *= 1099511628211ULL;
+            }
+        };
+
+        if (data) {
+            mix(data, size);
+        } else {
+            char buf[65536];
+            size_t pos = 0;
+            while (pos < size) {
+                ssize_t n = pread(fd, buf, std::min(sizeof(buf), size - pos), (off_t)pos);
+                if (n <= 0) break;
+                mix(buf, n);
+                pos += n;
+            }
+        }
+
+        char text[48];
+        snprintf(text, sizeof(text), "\"%016llx-%zx\"", (unsigned long long)hash, size);
+        m_etag = text;
+    });
+    return m_etag;
+}
+
+static int64_t mtime_ns(const struct stat& st) {
+    return (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+const char* mime_type(const std::string& path) {
+    size_t dot = path.rfind('.');
+    std::string ext = dot == std::string::npos ? "" : path.substr(dot + 1);
+    if (ext == "png") return "image/png";
+    if (ext == "json") return "application/json";
+    if (ext == "html" || ext == "htm") return "text/html";
+    if (ext == "js") return "application/javascript";
+    if (ext == "css") return "text/css";
+    if (ext == "txt") return "text/plain";
+    return "application/octet-stream";
+}
+
+StaticFilePtr StaticFileCache::get(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(path);
+        if (it != m_entries.end()) drop(it);
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(path);
+        if (it != m_entries.end()) {
+            Entry& e = it->second;
+            if (e.dev == (uint64_t)st.st_dev && e.ino == (uint64_t)st.st_ino && e.mtime_ns == mtime_ns(st) &&
+                e.file->size == (size_t)st.st_size) {
+                e.last_used = ++m_clock;
+                http_metrics().file_cache_hits++;
+                return e.file;
+            }
+            drop(it);
+        }
+    }
+
+    // Открываем без блокировки: два потока могут открыть один файл, победит последний
+    http_metrics().file_cache_misses++;
+    return load(path);
+}
+
+StaticFilePtr StaticFileCache::load(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return nullptr;
+    }
+
+    auto file = std::make_shared<StaticFile>();
+    file->fd = fd;
+    file->size = (size_t)st.st_size;
+    file->mtime = st.st_mtim.tv_sec;
+    file->content_type = mime_type(path);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Мелкие горячие файлы (тайлы, страница) — из памяти, без sendfile на каждый запрос
+    if (file->size > 0 && file->size <= m_options.mmap_max_file &&
+        m_mapped + file->size <= m_options.mmap_budget) {
+        void* data = mmap(nullptr, file->size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if (data != MAP_FAILED) {
+            file->data = (const char*)data;
+            m_mapped += file->size;
+            http_metrics().file_mapped_bytes = (int64_t)m_mapped;
+        }
+    }
+
+    auto it = m_entries.find(path);
+    if (it != m_entries.end()) drop(it);
+    if (m_entries.size() >= m_options.max_files) evict();
+
+    Entry& e = m_entries[path];
+    e.file = file;
+    e.dev = (uint64_t)st.st_dev;
+    e.ino = (uint64_t)st.st_ino;
+    e.mtime_ns = mtime_ns(st);
+    e.last_used = ++m_clock;
+    return file;
+}
+
+void StaticFileCache::drop(std::unordered_map<std::string, Entry>::iterator it) {
+    if (it->second.file->data) {
+        m_mapped -= it->second.file->size;
+        http_metrics().file_mapped_bytes = (int64_t)m_mapped;
+    }
+    m_entries.erase(it);
+}
+
+// Выкидываем четверть давно не использованных, чтобы не искать на каждом промахе
+void StaticFileCache::evict() {
+    std::vector<std::pair<uint64_t, std::string>> order;
+    order.reserve(m_entries.size());
+    for (const auto& [path, e] : m_entries) order.emplace_back(e.last_used, path);
+
+    size_t count = std::max<size_t>(1, order.size() / 4);
+    std::nth_element(order.begin(), order.begin() + (count - 1), order.end());
+    for (size_t i = 0; i < count; i++) {
+        auto it = m_entries.find(order[i].second);
+        if (it != m_entries.end()) drop(it);
+    }
+}
+
+size_t StaticFileCache::mappedBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_mapped;
+}
+
+StaticFileCache& static_files() {
+    static StaticFileCache cache;
+    return cache;
+}
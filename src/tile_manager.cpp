@@ -1,4 +1,5 @@
 #include "tile_manager.hpp"
+#include "trace.hpp"
 #include <stb_image.h>
 #include <curl/curl.h>
 #include <iostream>
@@ -68,6 +69,7 @@ void TileManager::request(int z, int x, int y) {
 }
 
 void TileManager::worker() {
+    trace_set_thread_name("tiles");
     CURL* curl = curl_easy_init();
 
     while (running) {
@@ -85,17 +87,24 @@ void TileManager::worker() {
 
         std::vector<unsigned char> data;
 
-        curl_easy_reset(curl);
-        curl_easy_setopt(curl, CURLOPT_URL, url(j.z, j.x, j.y).c_str());
-        curl_easy_setopt(curl, CURLOPT_USERAGENT, "MyGpsMonitorApp/1.0 (kutenand2@gmail.com)");
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &data);
-        curl_easy_perform(curl);
+        {
+            TRACE_SPAN("tile.fetch", "tiles");
+            curl_easy_reset(curl);
+            curl_easy_setopt(curl, CURLOPT_URL, url(j.z, j.x, j.y).c_str());
+            curl_easy_setopt(curl, CURLOPT_USERAGENT, "MyGpsMonitorApp/1.0 (kutenand2@gmail.com)");
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &data);
+            curl_easy_perform(curl);
+        }
 
         int w, h, c;
-        unsigned char* img = stbi_load_from_memory(
-            data.data(), data.size(), &w, &h, &c, 4
-        );
+        unsigned char* img;
+        {
+            TRACE_SPAN("tile.decode", "tiles");
+            img = stbi_load_from_memory(
+                data.data(), data.size(), &w, &h, &c, 4
+            );
+        }
 
         if (!img) continue;
 
@@ -117,6 +126,7 @@ void TileManager::worker() {
 }
 
 void TileManager::updateGL() {
+    TRACE_SPAN("tile.updateGL", "gui");
     std::lock_guard<std::mutex> lock(mtx);
 
     for (auto& [k, t] : tiles) {
@@ -0,0 +1,206 @@
+#include "trace.hpp"
+#include "logger.hpp"
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+std::atomic<bool> g_trace_enabled{false};
+
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    uint64_t start_ns;
+    uint64_t dur_ns;
+};
+
+// Ячейка кольца: дамп читает её, пока владелец может писать, поэтому поля атомарны (relaxed)
+struct TraceSlot {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<const char*> category{nullptr};
+    std::atomic<uint64_t> start_ns{0};
+    std::atomic<uint64_t> dur_ns{0};
+};
+
+// Кольцо одного потока: пишет только владелец, читает только дамп. Как в seqlock:
+// begun растёт до записи ячейки, head — после; ячейки, которые дамп мог застать
+// посреди перезаписи, определяются по begun после копирования
+struct TraceBuffer {
+    static constexpr uint64_t kCapacity = 1 << 14;
+
+    int tid = 0;
+    std::string thread_name;
+    bool in_use = true;                 // поток жив; свободное кольцо отдаётся новому потоку
+    std::atomic<uint64_t> begun{0};
+    std::atomic<uint64_t> head{0};
+    TraceSlot slots[kCapacity];
+};
+
+// Больше колец не заводим (по 512 КБ): потоки сверх предела не трассируются
+static const size_t kMaxTraceThreads = 128;
+
+static std::mutex g_registry_mutex;
+static std::vector<std::shared_ptr<TraceBuffer>> g_registry;
+static int g_next_tid = 1;
+
+static thread_local TraceBuffer* t_buffer = nullptr;
+static thread_local bool t_untraced = false;
+static thread_local const char* t_thread_name = nullptr;
+
+static volatile sig_atomic_t g_dump_requested = 0;
+
+// По выходу потока кольцо освобождается; его события остаются в дампе, пока кольцо
+// не займёт другой поток
+struct TraceThreadOwner {
+    ~TraceThreadOwner() {
+        if (!t_buffer) return;
+        std::lock_guard<std::mutex> lock(g_registry_mutex);
+        t_buffer->in_use = false;
+        t_buffer = nullptr;
+    }
+};
+
+static TraceBuffer* register_thread() {
+    static thread_local TraceThreadOwner owner;
+    (void)owner;
+
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    std::shared_ptr<TraceBuffer> buffer;
+    for (auto& b : g_registry) {
+        if (!b->in_use) {
+            // Прежний владелец вышел, дамп идёт под этим же мьютексом — кольцо никто не трогает
+            buffer = b;
+            buffer->begun.store(0, std::memory_order_relaxed);
+            buffer->head.store(0, std::memory_order_relaxed);
+            break;
+        }
+    }
+    if (!buffer) {
+        if (g_registry.size() >= kMaxTraceThreads) {
+            t_untraced = true;
+            return nullptr;
+        }
+        buffer = std::make_shared<TraceBuffer>();
+        g_registry.push_back(buffer);
+    }
+    buffer->in_use = true;
+    buffer->tid = g_next_tid++;
+    buffer->thread_name = t_thread_name ? t_thread_name : "thread-" + std::to_string(buffer->tid);
+    t_buffer = buffer.get();
+    return t_buffer;
+}
+
+void trace_set_enabled(bool enabled) {
+    g_trace_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void trace_set_thread_name(const char* name) {
+    t_thread_name = name;
+    if (t_buffer) {
+        std::lock_guard<std::mutex> lock(g_registry_mutex);
+        t_buffer->thread_name = name;
+    }
+}
+
+void trace_complete(const char* name, const char* category, uint64_t start_ns, uint64_t dur_ns) {
+    TraceBuffer* buffer = t_buffer;
+    if (!buffer) {
+        if (t_untraced) return;
+        buffer = register_thread();
+        if (!buffer) return;
+    }
+
+    uint64_t h = buffer->head.load(std::memory_order_relaxed);
+    buffer->begun.store(h + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    TraceSlot& slot = buffer->slots[h & (TraceBuffer::kCapacity - 1)];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.category.store(category, std::memory_order_relaxed);
+    slot.start_ns.store(start_ns, std::memory_order_relaxed);
+    slot.dur_ns.store(dur_ns, std::memory_order_relaxed);
+    buffer->head.store(h + 1, std::memory_order_release);
+}
+
+std::string trace_dump_json() {
+    // Весь дамп под мьютексом реестра: кольцо не сменит владельца посреди копирования
+    // (ждут только потоки, пишущие свой первый спан)
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    const std::vector<std::shared_ptr<TraceBuffer>>& buffers = g_registry;
+
+    int pid = (int)getpid();
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    char line[512];
+
+    for (size_t i = 0; i < buffers.size(); i++) {
+        TraceBuffer& b = *buffers[i];
+
+        snprintf(line, sizeof(line),
+                 "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                 first ? "" : ",", pid, b.tid, b.thread_name.c_str());
+        out += line;
+        first = false;
+
+        uint64_t end = b.head.load(std::memory_order_acquire);
+        uint64_t begin = end > TraceBuffer::kCapacity ? end - TraceBuffer::kCapacity : 0;
+
+        std::vector<TraceEvent> copy;
+        copy.reserve(end - begin);
+        for (uint64_t k = begin; k < end; k++) {
+            const TraceSlot& slot = b.slots[k & (TraceBuffer::kCapacity - 1)];
+            copy.push_back({slot.name.load(std::memory_order_relaxed), slot.category.load(std::memory_order_relaxed),
+                            slot.start_ns.load(std::memory_order_relaxed), slot.dur_ns.load(std::memory_order_relaxed)});
+        }
+
+        // Всё, что владелец начал перезаписывать до конца копирования, отбрасываем
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t now_begun = b.begun.load(std::memory_order_relaxed);
+        uint64_t safe_from = now_begun > TraceBuffer::kCapacity ? now_begun - TraceBuffer::kCapacity : 0;
+
+        for (uint64_t k = begin; k < end; k++) {
+            if (k < safe_from) continue;
+            const TraceEvent& e = copy[k - begin];
+            snprintf(line, sizeof(line),
+                     ",{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                     e.name, e.category, e.start_ns / 1000.0, e.dur_ns / 1000.0, pid, b.tid);
+            out += line;
+        }
+    }
+
+    out += "]}";
+    return out;
+}
+
+bool trace_dump_to_file(const std::string& path) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        LOG_ERROR("trace", "Cannot write trace file: " << path);
+        return false;
+    }
+    file << trace_dump_json();
+    LOG_INFO("trace", "Trace written to " << path);
+    return true;
+}
+
+static void on_dump_signal(int) {
+    g_dump_requested = 1;
+}
+
+void trace_install_signal_handler() {
+    signal(SIGUSR1, on_dump_signal);
+
+    // Обработчик сигнала только ставит флаг, запись файла — в обычном потоке
+    std::thread([] {
+        int n = 0;
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            if (!g_dump_requested) continue;
+            g_dump_requested = 0;
+            trace_dump_to_file("trace_" + std::to_string(getpid()) + "_" + std::to_string(n++) + ".json");
+        }
+    }).detach();
+}
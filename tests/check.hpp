@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdio>
+
+// Проверки для tests/ без фреймворка: провал печатается и считается,
+// код возврата программы — check_report()
+
+inline int g_check_failures = 0;
+
+#define CHECK(cond)                                                                     \
+    do {                                                                                \
+        if (!(cond)) {                                                                  \
+            g_check_failures++;                                                         \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);    \
+        }                                                                               \
+    } while (0)
+
+inline int check_report(const char* name) {
+    if (g_check_failures) {
+        fprintf(stderr, "%s: %d checks failed\n", name, g_check_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "batch_ingest.hpp"
+#include "ingest_pipeline.hpp"
+#include "logger.hpp"
+#include "check.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <unistd.h>
+
+// Тело с записями вперемешку: NDJSON и массив, скобки и кавычки внутри строк,
+// вложенность, мусор между записями, незакрытый хвост, запись только с traffic
+// (её отбросит фильтр) и запись без секций измерения (её фильтр пропускает)
+static const std::string kBody =
+    "{\"imei\":\"860000000000001\",\"timestamp\":1,\"location\":{\"latitude\":55.03,\"longitude\":82.92}}\n"
+    "{\"imei\":\"860000000000001\",\"timestamp\":2,\"note\":\"}{ ] [ \\\" \\\\\",\"location\":{\"latitude\":55.04,\"longitude\":82.93}}\r\n"
+    "[ {\"imei\":\"860000000000002\",\"timestamp\":3,\"telephony\":{\"cells\":[{\"pci\":1,\"rsrp\":-95},{\"pci\":2}]}},\n"
+    "  {\"timestamp\":4,\"traffic\":{\"rx\":10,\"tx\":20}} ]\n"
+    "garbage\n"
+    "{\"imei\":\"860000000000003\",\"timestamp\":5}\n"
+    "{\"imei\":\"860000000000001\",\"timestamp\":6,\"location\":{\"latitude\":55.05,\"longitude\":82.94}}\n"
+    "{\"broken\":[1,2";
+
+static const size_t kAccepted = 5;
+static const size_t kFiltered = 1;
+static const size_t kRejected = 2;   // мусор и незакрытая запись
+
+struct Result {
+    size_t accepted, rejected, filtered;
+    long long last;
+    std::map<std::string, int> devices;
+};
+
+static Result run(IngestPipeline& pipeline, SharedData& shared, const std::vector<std::string>& parts) {
+    BatchIngest batch(&shared, &pipeline);
+    for (const auto& part : parts) batch.feed(part.data(), part.size());
+    batch.finish();
+    return {batch.accepted(), batch.rejected(), batch.filtered(), batch.lastSeq(), batch.devices()};
+}
+
+static void check_result(const Result& r, long long& last) {
+    CHECK(r.accepted == kAccepted);
+    CHECK(r.filtered == kFiltered);
+    CHECK(r.rejected == kRejected);
+    CHECK(r.last == last + (long long)kAccepted);
+    CHECK((r.devices == std::map<std::string, int>{
+        {"860000000000001", 3}, {"860000000000002", 1}, {"860000000000003", 1}}));
+    last = r.last;
+}
+
+int main() {
+    // Конвейер пишет журнал в data/ текущего каталога — работаем во временном
+    char dir[] = "/tmp/heapmap_test_XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) != 0) return 1;
+
+    SharedData shared;
+    shared.max_history = 10;
+    shared.filter_traffic = false;
+    IngestPipeline pipeline(&shared, nullptr, nullptr, nullptr, 4096);
+    long long last = 0;
+
+    // Тело целиком, затем разрез в каждой позиции: результат от границ чтений не зависит
+    check_result(run(pipeline, shared, {kBody}), last);
+    for (size_t i = 0; i <= kBody.size(); i++) {
+        check_result(run(pipeline, shared, {kBody.substr(0, i), kBody.substr(i)}), last);
+    }
+
+    // По байту: записи приходят в конвейер целыми и в порядке тела
+    pipeline.stop();
+    std::vector<std::string> bytes;
+    for (char c : kBody) bytes.push_back(std::string(1, c));
+    std::mutex mutex;
+    std::vector<std::string> stored;
+    IngestPipeline ordered(&shared, nullptr, nullptr, nullptr, 4096);
+    ordered.setBatchListener([&](const std::vector<const json*>& records, long long) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const json* r : records) stored.push_back(r->dump());
+    });
+    long long ordered_last = ordered.accepted();
+    check_result(run(ordered, shared, bytes), ordered_last);
+    ordered.stop();
+    CHECK(stored.size() == kAccepted);
+    if (stored.size() == kAccepted) {
+        CHECK(json::parse(stored[0])["timestamp"] == 1);
+        CHECK(json::parse(stored[1])["note"] == "}{ ] [ \" \\");
+        CHECK(json::parse(stored[2])["telephony"]["cells"].size() == 2);
+        CHECK(json::parse(stored[3])["timestamp"] == 5);
+        CHECK(json::parse(stored[4])["timestamp"] == 6);
+    }
+
+    // Очередь конвейера на одну запись: feed не ждёт, записи откладываются,
+    // finish досылает их — ничего не теряется и порядок тот же
+    IngestPipeline tiny(&shared, nullptr, nullptr, nullptr, 1);
+    long long tiny_last = tiny.accepted();
+    for (int round = 0; round < 20; round++) check_result(run(tiny, shared, {kBody}), tiny_last);
+    tiny.stop();
+
+    // Запись больше kMaxRecord отклоняется, следующая за ней принимается (без IMEI — "unknown")
+    IngestPipeline big(&shared, nullptr, nullptr, nullptr, 16);
+    std::string huge = "{\"imei\":\"1\",\"pad\":\"" + std::string(BatchIngest::kMaxRecord, 'x') + "\"}";
+    BatchIngest batch(&shared, &big);
+    batch.feed(huge.data(), huge.size());
+    std::string next = "{\"timestamp\":7,\"location\":{\"latitude\":1,\"longitude\":2}}";
+    batch.feed(next.data(), next.size());
+    batch.finish();
+    CHECK(batch.rejected() == 1);
+    CHECK(batch.accepted() == 1);
+    CHECK((batch.devices() == std::map<std::string, int>{{"unknown", 1}}));
+    big.stop();
+
+    if (chdir("/") == 0) rmdir(dir);
+    log_shutdown();
+    return check_report("batch_ingest");
+}
@@ -0,0 +1,203 @@
+#include "http.hpp"
+#include "check.hpp"
+#include <string>
+#include <vector>
+
+// Поток из нескольких запросов подряд (keep-alive, конвейер): запрос с query,
+// тело по Content-Length, chunked с расширениями и трейлерами, HTTP/1.0
+static const std::string kStream =
+    "GET /api/points?bbox=82.9,55.0,83.0,55.1&limit=10 HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "X-Empty:\r\n"
+    "Accept-Encoding:  gzip, deflate  \r\n"
+    "\r\n"
+    "POST /api/data HTTP/1.1\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 27\r\n"
+    "\r\n"
+    "{\"imei\":\"1\",\"timestamp\":1}\n"
+    "POST /api/ingest HTTP/1.1\r\n"
+    "transfer-encoding: chunked\r\n"
+    "\r\n"
+    "5;ext=1\r\n"
+    "{\"a\":\r\n"
+    "B\r\n"
+    "1}\n{\"b\":2}\n\r\n"
+    "0\r\n"
+    "X-Trailer: 1\r\n"
+    "\r\n"
+    "HEAD /heatmap.html HTTP/1.0\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+struct Parsed {
+    std::string method, path, query, version, body;
+    std::vector<std::pair<std::string, std::string>> headers;
+    bool keep_alive = false;
+    int error = 0;
+};
+
+static bool operator==(const Parsed& a, const Parsed& b) {
+    return a.method == b.method && a.path == b.path && a.query == b.query && a.version == b.version &&
+           a.body == b.body && a.headers == b.headers && a.keep_alive == b.keep_alive && a.error == b.error;
+}
+
+// Как реактор: после заголовков тела может подхватить обработчик, лишние байты
+// после Done — начало следующего запроса
+static std::vector<Parsed> parse(const std::vector<std::string>& parts, bool streamed) {
+    std::vector<Parsed> out;
+    HttpParser parser;
+    std::string body;
+    std::string pending;
+    for (const auto& part : parts) {
+        pending += part;
+        size_t pos = 0;
+        while (pos < pending.size() || parser.done()) {
+            if (parser.done() || parser.failed()) {
+                Parsed p;
+                const HttpRequest& r = parser.request();
+                p.method = r.method;
+                p.path = r.path;
+                p.query = r.query;
+                p.version = r.version;
+                p.headers = r.headers;
+                p.body = streamed ? body : r.body;
+                p.keep_alive = r.keepAlive();
+                p.error = parser.errorStatus();
+                out.push_back(p);
+                if (parser.failed()) return out;
+                parser.reset();
+                body.clear();
+                continue;
+            }
+            HttpParser::State before = parser.state();
+            size_t used = parser.feed(pending.data() + pos, pending.size() - pos);
+            pos += used;
+            if (streamed && before == HttpParser::State::Headers && parser.state() == HttpParser::State::Body) {
+                parser.setBodyHandler([&](const char* data, size_t size) { body.append(data, size); });
+            }
+            if (used == 0 && !parser.done() && !parser.failed()) break;
+        }
+        pending.erase(0, pos);
+    }
+    // Ошибка на последней части или незаконченный запрос в конце потока
+    if (parser.failed() || !parser.idle()) {
+        Parsed p;
+        p.method = parser.failed() ? "<failed>" : "<partial>";
+        p.error = parser.errorStatus();
+        out.push_back(p);
+    }
+    return out;
+}
+
+static void check_expected(const std::vector<Parsed>& got) {
+    CHECK(got.size() == 4);
+    if (got.size() != 4) return;
+
+    CHECK(got[0].method == "GET");
+    CHECK(got[0].path == "/api/points");
+    CHECK(got[0].query == "bbox=82.9,55.0,83.0,55.1&limit=10");
+    CHECK(got[0].version == "HTTP/1.1");
+    CHECK((got[0].headers == std::vector<std::pair<std::string, std::string>>{
+        {"host", "localhost"}, {"x-empty", ""}, {"accept-encoding", "gzip, deflate"}}));
+    CHECK(got[0].body.empty());
+    CHECK(got[0].keep_alive);
+
+    CHECK(got[1].method == "POST");
+    CHECK(got[1].path == "/api/data");
+    CHECK(got[1].body == "{\"imei\":\"1\",\"timestamp\":1}\n");
+
+    CHECK(got[2].path == "/api/ingest");
+    CHECK(got[2].body == "{\"a\":1}\n{\"b\":2}\n");
+
+    CHECK(got[3].method == "HEAD");
+    CHECK(got[3].version == "HTTP/1.0");
+    CHECK(got[3].keep_alive);
+    CHECK(got[3].body.empty());
+
+    for (const auto& p : got) CHECK(p.error == 0);
+}
+
+int main() {
+    // Целиком, разрез в каждой позиции, по байту — и с буфером тела, и с обработчиком
+    for (bool streamed : {false, true}) {
+        std::vector<Parsed> whole = parse({kStream}, streamed);
+        check_expected(whole);
+        for (size_t i = 0; i <= kStream.size(); i++) {
+            CHECK(parse({kStream.substr(0, i), kStream.substr(i)}, streamed) == whole);
+        }
+        std::vector<std::string> bytes;
+        for (char c : kStream) bytes.push_back(std::string(1, c));
+        CHECK(parse(bytes, streamed) == whole);
+    }
+
+    // Обрыв в любом месте: готовы только запросы, пришедшие целиком, остальное — незаконченный
+    const size_t ends[] = {kStream.find("POST /api/data"), kStream.find("POST /api/ingest"),
+                           kStream.find("HEAD /"), kStream.size()};
+    for (size_t i = 1; i < kStream.size(); i++) {
+        size_t complete = 0;
+        while (complete < 4 && ends[complete] <= i) complete++;
+        bool boundary = complete > 0 && ends[complete - 1] == i;
+        std::vector<Parsed> got = parse({kStream.substr(0, i)}, false);
+        CHECK(got.size() == complete + (boundary ? 0 : 1));
+        if (!boundary && !got.empty()) CHECK(got.back().method == "<partial>");
+        for (const auto& p : got) CHECK(p.error == 0);
+    }
+
+    // Ошибки: кривая строка запроса, чужая версия, неизвестное кодирование,
+    // плохие Content-Length и размер чанка — при любом разрезе
+    const std::pair<std::string, int> errors[] = {
+        {"GARBAGE\r\n\r\n", 400},
+        {"GET / SPDY/3\r\n\r\n", 400},
+        {"GET / HTTP/1.1\r\nNoColon\r\n\r\n", 400},
+        {"POST / HTTP/1.1\r\nContent-Length: 12x\r\n\r\n", 400},
+        {"POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n", 501},
+        {"POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", 400},
+        {"POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nabX\r\n", 400},
+        {"POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n-1\r\n", 400},
+        // Границы тела, о которых прокси и сервер могли бы договориться по-разному
+        {"POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n", 400},
+        {"POST / HTTP/1.1\r\nContent-Length: +5\r\n\r\n", 400},
+        {"POST / HTTP/1.1\r\nContent-Length: 99999999999999999999\r\n\r\n", 400},
+        {"POST / HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 6\r\n\r\n", 400},
+        {"POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 5\r\n\r\n", 400},
+        {"POST / HTTP/1.1\r\nContent-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n", 400},
+        {"POST / HTTP/1.1\r\nTransfer-Encoding: chunked, gzip\r\n\r\n", 400},
+        {"POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nTransfer-Encoding: gzip\r\n\r\n", 400},
+        {"POST / HTTP/1.1\r\nTransfer-Encoding: gzip, chunked\r\n\r\n", 501},
+    };
+    for (const auto& [data, status] : errors) {
+        for (size_t i = 0; i <= data.size(); i++) {
+            std::vector<Parsed> got = parse({data.substr(0, i), data.substr(i)}, false);
+            CHECK(got.size() == 1 && got[0].error == status);
+        }
+    }
+
+    // Одинаковые Content-Length и регистр в Transfer-Encoding допустимы
+    {
+        std::vector<Parsed> got = parse({"POST / HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 3\r\n\r\nabc"}, false);
+        CHECK(got.size() == 1 && got[0].error == 0 && got[0].body == "abc");
+        got = parse({"POST / HTTP/1.1\r\nTransfer-Encoding:  Chunked \r\n\r\n3\r\nabc\r\n0\r\n\r\n"}, false);
+        CHECK(got.size() == 1 && got[0].error == 0 && got[0].body == "abc");
+    }
+
+    // Заголовки сверх предела — 431, даже если конец так и не пришёл
+    {
+        std::string big = "GET / HTTP/1.1\r\nX-Big: " + std::string(HttpParser::kMaxHeaderBytes, 'a');
+        std::vector<Parsed> got = parse({big.substr(0, 1000), big.substr(1000)}, false);
+        CHECK(got.size() == 1 && got[0].error == 431);
+    }
+
+    // Буферизованное тело сверх предела — 413; с обработчиком тот же объём проходит
+    {
+        size_t size = HttpParser::kMaxBufferedBody + 1;
+        std::string data = "POST / HTTP/1.1\r\nContent-Length: " + std::to_string(size) + "\r\n\r\n" +
+                           std::string(size, 'x');
+        std::vector<Parsed> got = parse({data}, false);
+        CHECK(got.size() == 1 && got[0].error == 413);
+        got = parse({data}, true);
+        CHECK(got.size() == 1 && got[0].error == 0 && got[0].body.size() == size);
+    }
+
+    return check_report("test_http_parser");
+}
@@ -0,0 +1,123 @@
+#include "json_writer.hpp"
+#include "check.hpp"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+static std::string write_double(double v) {
+    std::string out;
+    json_append_double(out, v);
+    return out;
+}
+
+static std::string write_string(const std::string& s) {
+    std::string out;
+    json_append_string(out, s);
+    return out;
+}
+
+// Числа с плавающей точкой — теми же цифрами, что json::dump(); не конечные — null
+static void test_doubles() {
+    const double fixed[] = {0.0, -0.0, 1.0, -1.0, 55.0, 0.1, 1e-05, 1e-07, 123456789012345680.0, 1e300, -1e-300,
+                            5e-324, std::numeric_limits<double>::max(), std::numeric_limits<double>::min(),
+                            146.87604853162549, 55.0301234, 82.9204567, 0.5, 1.5e21, 1e22};
+    for (double v : fixed) CHECK(write_double(v) == json(v).dump());
+    CHECK(write_double(std::nan("")) == json(std::nan("")).dump());
+    CHECK(write_double(std::numeric_limits<double>::infinity()) == "null");
+    CHECK(write_double(-std::numeric_limits<double>::infinity()) == "null");
+
+    // Произвольные битовые образы и типичные координаты
+    std::mt19937_64 rng(7);
+    for (int i = 0; i < 200000; i++) {
+        uint64_t bits = rng();
+        double v;
+        memcpy(&v, &bits, sizeof(v));
+        if (!std::isfinite(v)) continue;
+        if (write_double(v) != json(v).dump()) {
+            CHECK(write_double(v) == json(v).dump());
+            break;
+        }
+    }
+    std::uniform_real_distribution<double> coord(-180, 180);
+    for (int i = 0; i < 200000; i++) {
+        double v = coord(rng);
+        if (write_double(v) != json(v).dump()) {
+            CHECK(write_double(v) == json(v).dump());
+            break;
+        }
+    }
+}
+
+// Экранирование: кавычки, обратная косая, управляющие символы; UTF-8 и DEL — как есть
+static void test_strings() {
+    std::string all_bytes;
+    for (int c = 1; c < 0x80; c++) all_bytes += (char)c;
+    const std::string fixed[] = {"", "plain", "quote\"back\\slash", "\b\f\n\r\t", std::string("nul\0byte", 8),
+                                 "\x01\x1f\x7f", "Новосибирск", "emoji \xF0\x9F\x93\xA1", all_bytes};
+    for (const auto& s : fixed) CHECK(write_string(s) == json(s).dump());
+}
+
+// Целые по краям диапазонов и документ со вложенностью — против того же дерева
+static void test_document() {
+    std::string out;
+    JsonWriter w(out);
+    w.beginObject();
+    w.key("array");
+    w.beginArray();
+    w.value(std::numeric_limits<long long>::min());
+    w.value(std::numeric_limits<long long>::max());
+    w.value(std::numeric_limits<unsigned long long>::max());
+    w.value(0);
+    w.value(-1);
+    w.value(true);
+    w.value(false);
+    w.null();
+    w.beginArray();
+    w.endArray();
+    w.beginObject();
+    w.endObject();
+    w.endArray();
+    // Литерал пишется как есть, ключ с экранированием — через string_view
+    w.key(std::string_view("escaped \"key\"\n"));
+    w.value("value\t");
+    w.key("nested");
+    w.beginObject();
+    w.key("lat");
+    w.value(55.0);
+    w.key("raw");
+    w.raw("{\"a\":[1,2]}");
+    w.endObject();
+    w.key("unsigned");
+    w.value(42u);
+    w.endObject();
+
+    json expected = {
+        {"array", {std::numeric_limits<long long>::min(), std::numeric_limits<long long>::max(),
+                   std::numeric_limits<unsigned long long>::max(), 0, -1, true, false, nullptr, json::array(),
+                   json::object()}},
+        {"escaped \"key\"\n", "value\t"},
+        {"nested", {{"lat", 55.0}, {"raw", {{"a", {1, 2}}}}}},
+        {"unsigned", 42u},
+    };
+    CHECK(out == expected.dump());
+
+    // Пустые контейнеры верхнего уровня
+    std::string empty;
+    JsonWriter e(empty);
+    e.beginArray();
+    e.beginObject();
+    e.endObject();
+    e.endArray();
+    CHECK(empty == "[{}]");
+}
+
+int main() {
+    test_doubles();
+    test_strings();
+    test_document();
+    return check_report("json_writer");
+}
@@ -0,0 +1,264 @@
+#include "mvt_tiles.hpp"
+#include "check.hpp"
+#include <cmath>
+#include <random>
+#include <set>
+
+// Разбор тайла своим кодом, по vector_tile.proto 2.1, — не тем же ProtoWriter, которым кодировали
+
+struct Reader {
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok = true;
+
+    explicit Reader(const std::string& s) : p((const uint8_t*)s.data()), end(p + s.size()) {}
+    bool more() const { return ok && p < end; }
+
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p >= end) break;
+            uint8_t b = *p++;
+            v |= (uint64_t)(b & 0x7f) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        ok = false;
+        return 0;
+    }
+    std::string bytes() {
+        uint64_t n = varint();
+        if (n > (uint64_t)(end - p)) {
+            ok = false;
+            return "";
+        }
+        std::string s((const char*)p, n);
+        p += n;
+        return s;
+    }
+    std::vector<uint64_t> packed() {
+        std::string data = bytes();
+        Reader r(data);
+        std::vector<uint64_t> values;
+        while (r.more()) values.push_back(r.varint());
+        ok = ok && r.ok;
+        return values;
+    }
+    void skip(int wire) {
+        if (wire == 0) varint();
+        else if (wire == 2) bytes();
+        else ok = false;
+    }
+};
+
+struct DecodedValue {
+    int field = 0;        // 5 — uint, 6 — sint
+    uint64_t raw = 0;
+};
+
+struct DecodedLayer {
+    uint64_t version = 0;
+    std::string name;
+    uint64_t extent = 0;
+    std::vector<std::string> keys;
+    std::vector<DecodedValue> values;
+    std::vector<std::vector<uint64_t>> tags;
+    std::vector<uint64_t> types;
+    std::vector<std::vector<uint64_t>> geometry;
+};
+
+static int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static bool decode_tile(const std::string& tile, std::vector<DecodedLayer>& layers) {
+    Reader t(tile);
+    while (t.more()) {
+        uint64_t tag = t.varint();
+        if (tag != (3 << 3 | 2)) {
+            t.skip(tag & 7);
+            continue;
+        }
+        std::string data = t.bytes();
+        Reader l(data);
+        DecodedLayer layer;
+        while (l.more()) {
+            uint64_t key = l.varint();
+            switch (key >> 3) {
+            case 15: layer.version = l.varint(); break;
+            case 1: layer.name = l.bytes(); break;
+            case 5: layer.extent = l.varint(); break;
+            case 3: layer.keys.push_back(l.bytes()); break;
+            case 4: {
+                std::string value = l.bytes();
+                Reader v(value);
+                DecodedValue dv;
+                uint64_t vkey = v.varint();
+                dv.field = (int)(vkey >> 3);
+                dv.raw = v.varint();
+                if (v.more() || !v.ok) return false;   // ровно одно поле
+                layer.values.push_back(dv);
+                break;
+            }
+            case 2: {
+                std::string feature = l.bytes();
+                Reader f(feature);
+                std::vector<uint64_t> tags, geometry;
+                uint64_t type = 0;
+                while (f.more()) {
+                    uint64_t fkey = f.varint();
+                    if (fkey == (2 << 3 | 2)) tags = f.packed();
+                    else if (fkey == (3 << 3 | 0)) type = f.varint();
+                    else if (fkey == (4 << 3 | 2)) geometry = f.packed();
+                    else f.skip(fkey & 7);
+                }
+                if (!f.ok) return false;
+                layer.tags.push_back(tags);
+                layer.types.push_back(type);
+                layer.geometry.push_back(geometry);
+                break;
+            }
+            default: l.skip(key & 7);
+            }
+        }
+        if (!l.ok) return false;
+        layers.push_back(layer);
+    }
+    return t.ok;
+}
+
+// Точки слоя обратно: MoveTo(1) с zigzag-смещениями, атрибуты по таблицам ключей и значений
+static bool layer_points(const DecodedLayer& layer, std::vector<MvtPoint>& out) {
+    for (size_t i = 0; i < layer.geometry.size(); i++) {
+        const auto& g = layer.geometry[i];
+        const auto& tags = layer.tags[i];
+        if (layer.types[i] != 1 || g.size() != 3 || g[0] != (1 << 3 | 1) || tags.size() % 2) return false;
+        MvtPoint p{(int32_t)unzigzag(g[1]), (int32_t)unzigzag(g[2]), 0, 0};
+        for (size_t k = 0; k < tags.size(); k += 2) {
+            if (tags[k] >= layer.keys.size() || tags[k + 1] >= layer.values.size()) return false;
+            const DecodedValue& v = layer.values[tags[k + 1]];
+            if (layer.keys[tags[k]] == "count" && v.field == 5) p.count = (uint32_t)v.raw;
+            else if (layer.keys[tags[k]] == "signal" && v.field == 6) p.signal = (int32_t)unzigzag(v.raw);
+            else return false;
+        }
+        out.push_back(p);
+    }
+    return true;
+}
+
+static void test_points_round_trip() {
+    std::vector<MvtPoint> points = {
+        {0, 0, 1, -90}, {4095, 4095, 1, -90}, {-64, -64, 7, -120}, {4159, 100, 100000, 0},
+        {2048, 2048, 1, 5}, {123, 456, 4294967295u, -2147483647 - 1},
+    };
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> coord(-64, 4159), signal(-140, -40), count(1, 50);
+    for (int i = 0; i < 1000; i++) points.push_back({coord(rng), coord(rng), (uint32_t)count(rng), signal(rng)});
+
+    std::vector<DecodedLayer> layers;
+    CHECK(decode_tile(encode_mvt_points("measurements", points), layers));
+    CHECK(layers.size() == 1);
+    if (layers.size() != 1) return;
+    const DecodedLayer& layer = layers[0];
+    CHECK(layer.version == 2);
+    CHECK(layer.name == "measurements");
+    CHECK(layer.extent == kMvtExtent);
+    CHECK((layer.keys == std::vector<std::string>{"count", "signal"}));
+
+    // Значения в таблице не повторяются
+    std::set<std::pair<int, uint64_t>> unique;
+    for (const auto& v : layer.values) unique.insert({v.field, v.raw});
+    CHECK(unique.size() == layer.values.size());
+
+    std::vector<MvtPoint> decoded;
+    CHECK(layer_points(layer, decoded));
+    CHECK(decoded.size() == points.size());
+    for (size_t i = 0; i < decoded.size() && i < points.size(); i++) {
+        CHECK(decoded[i].x == points[i].x);
+        CHECK(decoded[i].y == points[i].y);
+        CHECK(decoded[i].count == points[i].count);
+        CHECK(decoded[i].signal == points[i].signal);
+    }
+
+    // Пустой слой — валидный тайл без точек
+    layers.clear();
+    CHECK(decode_tile(encode_mvt_points("measurements", {}), layers));
+    CHECK(layers.size() == 1 && layers[0].geometry.empty());
+}
+
+// Тайл по индексу: все точки области в нём (кластерами — суммарно), координаты в пределах
+static void test_index_tile() {
+    // Облако точек в середине тайла z=10 (он примерно 0,35° × 0,2°)
+    const int z = 10;
+    const int tx = (int)(mercator_x(82.92) >> (32 - z)), ty = (int)(mercator_y(55.03) >> (32 - z));
+    const double lon0 = mercator_lon(((double)tx + 0.5) * (1u << (32 - z)));
+    const double lat0 = mercator_lat(((double)ty + 0.5) * (1u << (32 - z)));
+
+    PointIndex index(1);
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> d(-0.05, 0.05);
+    const int n = 20000;
+    long long signal_sum = 0;
+    for (int i = 0; i < n; i++) {
+        int signal = -70 - i % 40;
+        signal_sum += signal;
+        index.add(lat0 + d(rng), lon0 + d(rng), signal);
+    }
+    index.finish();
+
+    std::string tile;
+    CHECK(encode_mvt_tile(index, z, tx, ty, tile));
+    std::vector<DecodedLayer> layers;
+    CHECK(decode_tile(tile, layers));
+    std::vector<MvtPoint> points;
+    CHECK(layers.size() == 1 && layer_points(layers[0], points));
+    CHECK(!points.empty() && points.size() <= 256);
+
+    uint64_t total = 0;
+    double weighted = 0;
+    for (const MvtPoint& p : points) {
+        total += p.count;
+        weighted += (double)p.signal * p.count;
+        CHECK(p.x >= -64 && p.x < (int)kMvtExtent + 64);
+        CHECK(p.y >= -64 && p.y < (int)kMvtExtent + 64);
+    }
+    CHECK(total == (uint64_t)n);
+    // Средний сигнал кластера округлён до целого — суммарно расходится не больше чем на 0,5 дБм
+    CHECK(std::fabs(weighted / n - (double)signal_sum / n) <= 0.5);
+
+    // Соседний тайл пуст, несуществующий — отказ
+    std::string other;
+    CHECK(encode_mvt_tile(index, z, (tx + 3) % (1 << z), ty, other));
+    layers.clear();
+    points.clear();
+    CHECK(decode_tile(other, layers) && layers.size() == 1 && layer_points(layers[0], points) && points.empty());
+    CHECK(!encode_mvt_tile(index, z, 1 << z, ty, other));
+    CHECK(!encode_mvt_tile(index, kMvtMaxZoom + 1, 0, 0, other));
+
+    // Крупный зум: отдельные точки с count = 1 и своим сигналом (тайл z=18 — около 0,0014°)
+    const int zz = 18;
+    const int sx = (int)(mercator_x(lon0) >> (32 - zz)), sy = (int)(mercator_y(lat0) >> (32 - zz));
+    const double slon = mercator_lon(((double)sx + 0.5) * (1u << (32 - zz)));
+    const double slat = mercator_lat(((double)sy + 0.5) * (1u << (32 - zz)));
+    PointIndex sparse(1);
+    sparse.add(slat, slon, -81);
+    sparse.add(slat + 0.0002, slon + 0.0002, -99);
+    sparse.finish();
+    std::string close;
+    CHECK(encode_mvt_tile(sparse, zz, sx, sy, close));
+    layers.clear();
+    points.clear();
+    CHECK(decode_tile(close, layers) && layers.size() == 1 && layer_points(layers[0], points));
+    CHECK(points.size() == 2);
+    std::set<int> signals;
+    for (const MvtPoint& p : points) {
+        CHECK(p.count == 1);
+        signals.insert(p.signal);
+    }
+    CHECK((signals == std::set<int>{-99, -81}));
+}
+
+int main() {
+    test_points_round_trip();
+    test_index_tile();
+    return check_report("mvt_tiles");
+}
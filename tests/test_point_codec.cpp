@@ -0,0 +1,86 @@
+#include "point_codec.hpp"
+#include "check.hpp"
+#include <cmath>
+#include <random>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// JSON-вид — прежний json::dump() массива объектов байт в байт
+static void test_json_matches_dump(const std::vector<MapPoint>& points) {
+    json expected = json::array();
+    for (const auto& p : points) {
+        expected.push_back({{"lat", p.lat}, {"lon", p.lon}, {"signal", p.signal_strength}, {"timestamp", p.timestamp}});
+    }
+    CHECK(encode_points_json(points) == expected.dump());
+}
+
+// Двоичный вид: координаты с точностью до шага 1e-7, время точно, сигнал обрезан до int8
+static void test_binary_round_trip(const std::vector<MapPoint>& points) {
+    std::string data;
+    CHECK(encode_points_binary(points, data));
+    CHECK(data.size() == kPointsHeaderSize + points.size() * 13);
+
+    std::vector<MapPoint> decoded;
+    CHECK(decode_points_binary(data, decoded));
+    CHECK(decoded.size() == points.size());
+    for (size_t i = 0; i < decoded.size() && i < points.size(); i++) {
+        CHECK(std::fabs(decoded[i].lat - points[i].lat) <= 0.5 / kPointsCoordScale + 1e-12);
+        CHECK(std::fabs(decoded[i].lon - points[i].lon) <= 0.5 / kPointsCoordScale + 1e-12);
+        CHECK(decoded[i].timestamp == points[i].timestamp);
+        CHECK(decoded[i].signal_strength == std::max(-128, std::min(127, points[i].signal_strength)));
+    }
+
+    // Повторное кодирование декодированного даёт те же байты
+    std::string again;
+    CHECK(encode_points_binary(decoded, again));
+    CHECK(again == data);
+}
+
+int main() {
+    std::vector<MapPoint> fixed = {
+        {55.0301234, 82.9204567, 1700000000000LL, -95, "GPS"},
+        {-33.8688, 151.2093, 1700000000500LL, -140, "GPS"},   // сигнал ниже int8
+        {90.0, 180.0, 1699999999000LL, 200, "GPS"},            // время назад, сигнал выше int8
+        {-90.0, -180.0, 1699999999000LL, 0, "GPS"},
+        {0.00000005, -0.00000005, 1700000001000LL, -1, "GPS"}, // половина шага квантования
+        {55.0, 1e-05, 1700000002000LL, -128, "GPS"},
+    };
+    test_json_matches_dump(fixed);
+    test_binary_round_trip(fixed);
+    test_json_matches_dump({});
+    test_binary_round_trip({});
+
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> lat(-85, 85), lon(-180, 180);
+    std::uniform_int_distribution<int> signal(-150, 10), step(-60000, 60000);
+    std::vector<MapPoint> random;
+    long long t = 1700000000000LL;
+    for (int i = 0; i < 5000; i++) {
+        t += step(rng);
+        random.push_back({lat(rng), lon(rng), t, signal(rng), "GPS"});
+    }
+    test_json_matches_dump(random);
+    test_binary_round_trip(random);
+
+    // Разница времени не влезает в int32 — двоичный вид не строится
+    std::vector<MapPoint> gap = {{55, 83, 0, -90, "GPS"}, {55, 83, 1LL << 32, -90, "GPS"}};
+    std::string data;
+    CHECK(!encode_points_binary(gap, data));
+
+    // Обрезанный или чужой буфер не принимается
+    CHECK(encode_points_binary(fixed, data));
+    std::vector<MapPoint> decoded;
+    CHECK(!decode_points_binary(data.substr(0, data.size() - 1), decoded));
+    CHECK(!decode_points_binary(data.substr(0, kPointsHeaderSize - 1), decoded));
+    std::string wrong = data;
+    wrong[3] = '2';
+    CHECK(!decode_points_binary(wrong, decoded));
+
+    CHECK(wants_binary_points("bin", ""));
+    CHECK(!wants_binary_points("json", kPointsBinaryType));
+    CHECK(wants_binary_points("", std::string("application/json, ") + kPointsBinaryType));
+    CHECK(!wants_binary_points("", "application/json"));
+
+    return check_report("point_codec");
+}
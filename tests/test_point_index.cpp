@@ -0,0 +1,73 @@
+#include "point_index.hpp"
+#include "check.hpp"
+#include <random>
+
+struct Sample {
+    double lat, lon;
+    int signal;
+};
+
+static bool same(const std::vector<PointCluster>& a, const std::vector<PointCluster>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].count != b[i].count || std::abs(a[i].lat - b[i].lat) > 1e-9 ||
+            std::abs(a[i].lon - b[i].lon) > 1e-9 || std::abs(a[i].signal - b[i].signal) > 1e-9) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Индекс, дополненный по частям, отвечает так же, как собранный сразу из всех точек
+int main() {
+    std::mt19937 rng(7);
+    std::normal_distribution<double> lat(55.03, 0.05), lon(82.92, 0.08);
+    std::uniform_int_distribution<int> signal(-130, -60);
+    std::vector<Sample> samples(20000);
+    for (auto& s : samples) s = {lat(rng), lon(rng), signal(rng)};
+
+    PointIndex whole(1);
+    for (const auto& s : samples) whole.add(s.lat, s.lon, s.signal);
+    whole.finish();
+
+    // Первая часть — как из БД, остальные — пачками разного размера, как от конвейера
+    auto index = std::make_shared<PointIndex>(1);
+    size_t pos = 0;
+    for (; pos < 5000; pos++) index->add(samples[pos].lat, samples[pos].lon, samples[pos].signal);
+    index->finish();
+    uint64_t generation = 2;
+    for (size_t step : {1, 7, 64, 1000, 13928}) {
+        auto next = std::make_shared<PointIndex>(*index, generation++);
+        for (size_t end = pos + step; pos < end; pos++) next->add(samples[pos].lat, samples[pos].lon, samples[pos].signal);
+        next->finish();
+        CHECK(index->size() == next->size() - step);   // прежний снимок не меняется
+        index = next;
+    }
+    CHECK(pos == samples.size());
+    CHECK(index->size() == whole.size());
+    CHECK(index->generation() == 6);
+
+    uint32_t a0, a1, a2, a3, b0, b1, b2, b3;
+    CHECK(index->extent(a0, a1, a2, a3) && whole.extent(b0, b1, b2, b3));
+    CHECK(a0 == b0 && a1 == b1 && a2 == b2 && a3 == b3);
+
+    for (int zoom : {0, 5, 10, 13, 16, 18}) {
+        ClusterQuery q;
+        q.min_lat = 54.95;
+        q.max_lat = 55.1;
+        q.min_lon = 82.8;
+        q.max_lon = 83.0;
+        q.zoom = zoom;
+        ClusterPlan plan = whole.plan(q);
+        CHECK(index->plan(q).key() == plan.key());
+        CHECK(index->countPoints(plan) == whole.countPoints(plan));
+
+        std::vector<PointCluster> got, expected;
+        index->collect(plan, got);
+        whole.collect(plan, expected);
+        if (!plan.raw) CHECK(same(got, expected));
+        else CHECK(got.size() == expected.size());
+    }
+
+    return check_report("test_point_index");
+}
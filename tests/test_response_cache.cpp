@@ -0,0 +1,262 @@
+#include "response_cache.hpp"
+#include "http_server.hpp"
+#include "metrics.hpp"
+#include "check.hpp"
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+static const int kThreads = 8;
+
+// Ждать, пока остальные потоки не встанут в очередь за построением (или не выйдет время)
+static void wait_coalesced(uint64_t from, uint64_t count) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (http_metrics().response_cache_coalesced.load() - from < count &&
+           std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// Одинаковые запросы во время построения ждут одного построения
+static void test_single_flight() {
+    ResponseCache cache;
+    std::atomic<int> builds{0};
+    uint64_t coalesced = http_metrics().response_cache_coalesced.load();
+
+    std::vector<ResponseCache::EntryPtr> got(kThreads);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; i++) {
+        threads.emplace_back([&, i] {
+            got[i] = cache.get("/api/stats", [&](ResponseCache::Entry& e) {
+                builds++;
+                wait_coalesced(coalesced, kThreads - 1);
+                e.body = "{}";
+                e.content_type = "application/json";
+            });
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    CHECK(builds == 1);
+    CHECK(http_metrics().response_cache_coalesced.load() - coalesced == kThreads - 1);
+    for (const auto& entry : got) CHECK(entry && entry == got[0] && entry->body == "{}");
+
+    // Готовый ответ — из памяти
+    auto again = cache.get("/api/stats", [&](ResponseCache::Entry&) { builds++; });
+    CHECK(builds == 1 && again == got[0]);
+}
+
+// Упавшее построение: исключение — только вызвавшему, ждавшие строят заново (один из них)
+static void test_builder_throws() {
+    ResponseCache cache;
+    std::atomic<int> builds{0};
+    std::atomic<int> failures{0};
+    uint64_t coalesced = http_metrics().response_cache_coalesced.load();
+
+    std::vector<ResponseCache::EntryPtr> got(kThreads);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; i++) {
+        threads.emplace_back([&, i] {
+            try {
+                got[i] = cache.get("/api/points", [&](ResponseCache::Entry& e) {
+                    if (builds++ == 0) {
+                        wait_coalesced(coalesced, kThreads - 1);
+                        throw std::runtime_error("DB error");
+                    }
+                    e.body = "[]";
+                });
+            } catch (const std::runtime_error&) {
+                failures++;
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    CHECK(failures == 1);
+    CHECK(builds == 2);
+    int ok = 0;
+    ResponseCache::EntryPtr first;
+    for (const auto& entry : got) {
+        if (!entry) continue;
+        ok++;
+        if (!first) first = entry;
+        CHECK(entry == first && entry->body == "[]");
+    }
+    CHECK(ok == kThreads - 1);
+
+    // Без ждущих: после исключения ключ строится заново
+    bool thrown = false;
+    try {
+        cache.get("/api/range", [](ResponseCache::Entry&) { throw std::runtime_error("DB error"); });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    auto entry = cache.get("/api/range", [](ResponseCache::Entry& e) { e.body = "ok"; });
+    CHECK(entry && entry->body == "ok");
+}
+
+// Ответ прошлого поколения годен max_stale_ms, потом строится заново
+static void test_freshness() {
+    ResponseCache::Options options;
+    options.max_stale_ms = 100;
+    ResponseCache cache(options);
+    int builds = 0;
+    auto build = [&](ResponseCache::Entry& e) { e.body = std::to_string(++builds); };
+
+    auto first = cache.get("k", build);
+    CHECK(first->generation == data_generation());
+
+    // Новые данные: ещё max_stale_ms от построения отдаётся прежний ответ
+    bump_data_generation();
+    CHECK(cache.get("k", build) == first && builds == 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    auto second = cache.get("k", build);
+    CHECK(builds == 2 && second->body == "2" && second->generation == data_generation());
+
+    // Своё поколение — сколько угодно долго
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    CHECK(cache.get("k", build) == second && builds == 2);
+
+    // Построивший из старых данных может сам указать поколение меньше текущего
+    bump_data_generation();
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    uint64_t old = second->generation;
+    auto third = cache.get("k", [&](ResponseCache::Entry& e) {
+        e.body = "3";
+        e.generation = old;
+    });
+    CHECK(third->generation == old);
+}
+
+// Сверх пределов вытесняются давно не запрошенные, по одной записи
+static void test_lru() {
+    ResponseCache::Options options;
+    options.max_entries = 3;
+    options.max_bytes = 1000;
+    ResponseCache cache(options);
+    int builds = 0;
+    auto build = [&](ResponseCache::Entry& e) {
+        builds++;
+        e.body = std::string(100, 'x');
+    };
+
+    cache.get("a", build);
+    cache.get("b", build);
+    cache.get("c", build);
+    cache.get("a", build);     // "a" снова свежий, старейший теперь "b"
+    CHECK(builds == 3);
+    cache.get("d", build);     // вытесняет "b"
+    CHECK(builds == 4);
+    cache.get("a", build);
+    cache.get("c", build);
+    cache.get("d", build);
+    CHECK(builds == 4);
+    cache.get("b", build);     // построен заново, вытеснил "a"
+    CHECK(builds == 5);
+    cache.get("a", build);
+    CHECK(builds == 6);
+
+    // Предел по байтам: большая запись вытесняет столько старых, сколько нужно
+    ResponseCache::Options small;
+    small.max_entries = 100;
+    small.max_bytes = 250;
+    ResponseCache bytes(small);
+    builds = 0;
+    bytes.get("a", build);
+    bytes.get("b", build);
+    bytes.get("c", build);     // 300 байт > 250 — уходит "a"
+    CHECK(builds == 3);
+    bytes.get("b", build);
+    bytes.get("c", build);
+    CHECK(builds == 3);
+    bytes.get("a", build);
+    CHECK(builds == 4);
+
+    cache.clear();
+    cache.get("a", build);
+    CHECK(builds == 5);
+}
+
+static HttpResponse etag_response(const std::string& etag) {
+    HttpResponse r;
+    r.content_type = "application/json";
+    r.body = "{}";
+    r.etag = etag;
+    return r;
+}
+
+static HttpRequest conditional(const std::string& name, const std::string& value) {
+    HttpRequest r;
+    r.method = "GET";
+    r.path = "/api/stats";
+    r.headers.emplace_back(name, value);
+    return r;
+}
+
+static void test_conditional() {
+    const std::string etag = "\"0123456789abcdef-2a\"";
+    std::string matched;
+    CHECK(etag_matches(etag, etag, matched) && matched == etag);
+    CHECK(etag_matches("W/" + etag, etag, matched) && matched == etag);
+    CHECK(etag_matches("\"0123456789abcdef-2a-gzip\"", etag, matched) && matched == "\"0123456789abcdef-2a-gzip\"");
+    CHECK(etag_matches("\"0123456789abcdef-2a-deflate\"", etag, matched));
+    CHECK(etag_matches("\"other\", " + etag, etag, matched) && matched == etag);
+    CHECK(etag_matches(" * ", etag, matched) && matched == etag);
+    CHECK(!etag_matches("\"0123456789abcdef-2b\"", etag, matched));
+    CHECK(!etag_matches("\"0123456789abcdef-2a-br\"", etag, matched));
+    CHECK(!etag_matches("", etag, matched));
+
+    // Совпало — 304 без тела, с тегом клиента и Vary для сжимаемого типа
+    HttpResponse r = etag_response(etag);
+    apply_conditional(conditional("if-none-match", "\"0123456789abcdef-2a-gzip\""), r);
+    CHECK(r.status == 304);
+    CHECK(r.body.empty());
+    CHECK(r.etag == "\"0123456789abcdef-2a-gzip\"");
+    CHECK(r.headers.size() == 1 && r.headers[0].first == "Vary");
+
+    r = etag_response(etag);
+    apply_conditional(conditional("if-none-match", "\"stale\""), r);
+    CHECK(r.status == 200 && r.body == "{}");
+
+    // Только GET/HEAD и только успешные ответы
+    HttpRequest post = conditional("if-none-match", etag);
+    post.method = "POST";
+    r = etag_response(etag);
+    apply_conditional(post, r);
+    CHECK(r.status == 200);
+    r = etag_response(etag);
+    r.status = 404;
+    apply_conditional(conditional("if-none-match", "*"), r);
+    CHECK(r.status == 404);
+
+    // If-Modified-Since: не новее даты клиента — 304
+    time_t t = 1700000000;
+    r = etag_response("");
+    r.last_modified = t;
+    apply_conditional(conditional("if-modified-since", http_date(t)), r);
+    CHECK(r.status == 304);
+    r = etag_response("");
+    r.last_modified = t;
+    apply_conditional(conditional("if-modified-since", http_date(t - 10)), r);
+    CHECK(r.status == 200);
+
+    // If-None-Match важнее: не совпал тег — 200, даже если дата подходит
+    HttpRequest both = conditional("if-none-match", "\"stale\"");
+    both.headers.emplace_back("if-modified-since", http_date(t));
+    r = etag_response(etag);
+    r.last_modified = t;
+    apply_conditional(both, r);
+    CHECK(r.status == 200);
+}
+
+int main() {
+    test_single_flight();
+    test_builder_throws();
+    test_freshness();
+    test_lru();
+    test_conditional();
+    return check_report("test_response_cache");
+}
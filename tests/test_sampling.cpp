@@ -0,0 +1,122 @@
+#include "sampling.hpp"
+#include "check.hpp"
+#include <cmath>
+
+static const uint64_t kSecond = 1000000000ULL;
+
+// Нагрузка: БД сохраняет запись за 1 мс, при загрузке 0.7 — 700 записей/с;
+// 1400 устройств по записи в секунду требуют интервал 2000 мс и давят вдвое
+static SamplingSignals loaded() {
+    SamplingSignals s;
+    s.queue_capacity = 4096;
+    s.db_latency_ns = 1000000;
+    s.active_devices = 1400;
+    s.total_rate = 1400;
+    return s;
+}
+
+static SamplingSignals idle() {
+    SamplingSignals s;
+    s.queue_capacity = 4096;
+    s.db_latency_ns = 1000000;
+    s.active_devices = 1;
+    s.total_rate = 1;
+    return s;
+}
+
+static void test_tracker() {
+    DeviceRateTracker t;
+
+    // 10 записей в секунду от одного устройства
+    uint64_t now = 100 * kSecond;
+    for (int i = 0; i < 50; i++) t.observe("a", now += kSecond / 10);
+    CHECK(std::fabs(t.rate("a") - 10) < 0.5);
+    CHECK(std::fabs(t.totalRate(now) - 10) < 0.5);
+    CHECK(t.activeDevices(now) == 1);
+
+    // Пачка из 5 записей раз в секунду — тоже 5 записей/с
+    for (int i = 0; i < 50; i++) t.observe("b", now + i * kSecond, 5);
+    now += 49 * kSecond;
+    CHECK(std::fabs(t.rate("b") - 5) < 0.5);
+    CHECK(t.rate("unknown") == 0);
+    CHECK(t.activeDevices(now) == 1);   // "a" молчит 49 с
+
+    // Момент раньше уже виденного (потоки дошли до трекера не по порядку) никого не вытесняет
+    t.observe("c", now + 2 * kSecond);
+    CHECK(t.activeDevices(now + kSecond) == 2);
+    CHECK(t.activeDevices(now) == 2);
+    t.observe("b", now - kSecond);
+    CHECK(t.activeDevices(now + 2 * kSecond) == 2);
+
+    // Молчащие дольше 30 с уходят вместе со своей частотой
+    CHECK(t.activeDevices(now + 32 * kSecond) == 1);
+    CHECK(t.totalRate(now + 32 * kSecond) == 0);
+    CHECK(t.activeDevices(now + 40 * kSecond) == 0);
+}
+
+static void test_adaptive() {
+    AdaptiveSamplingPolicy policy;
+    AdaptiveSamplingPolicy::Config c;
+
+    // Без нагрузки — базовый интервал, по одной записи
+    SamplingAdvice a = policy.advise(idle());
+    CHECK(a.interval_ms == c.base_interval_ms);
+    CHECK(a.batch == 1);
+
+    // Назад быстро: половина разницы за шаг, пачки растут
+    a = policy.advise(loaded());
+    CHECK(a.interval_ms == 1500);
+    CHECK(a.batch > 1 && a.batch <= c.max_batch);
+    for (int i = 0; i < 20; i++) a = policy.advise(loaded());
+    CHECK(a.interval_ms == 2000);
+
+    // Заполненная очередь добавляет штраф сверх доли устройства
+    SamplingSignals full = loaded();
+    full.queue_depth = full.queue_capacity / 2;
+    int before = a.interval_ms;
+    SamplingAdvice f = policy.advise(full);
+    CHECK(f.interval_ms > before);
+    CHECK(f.batch >= a.batch);
+
+    // Обратно медленно: после одного спокойного ответа ещё далеко от базового
+    int loaded_interval = f.interval_ms;
+    a = policy.advise(idle());
+    CHECK(a.interval_ms < loaded_interval);
+    CHECK(a.interval_ms > loaded_interval - (loaded_interval - c.base_interval_ms) / 5);
+    CHECK(a.batch == 1);
+    for (int i = 0; i < 200; i++) a = policy.advise(idle());
+    CHECK(a.interval_ms == c.base_interval_ms);
+
+    // Интервал не выходит за пределы, пачка — за max_batch
+    SamplingSignals overload = loaded();
+    overload.active_devices = 1000000;
+    overload.total_rate = 1000000;
+    for (int i = 0; i < 50; i++) a = policy.advise(overload);
+    CHECK(a.interval_ms == c.max_interval_ms);
+    CHECK(a.batch == c.max_batch);
+
+    // Без оценки БД и очереди — только базовый интервал
+    AdaptiveSamplingPolicy fresh;
+    SamplingSignals unknown;
+    a = fresh.advise(unknown);
+    CHECK(a.interval_ms == c.base_interval_ms);
+    CHECK(a.batch == 1);
+}
+
+static void test_factory() {
+    SamplingAdvice fixed{5000, 3};
+    FixedSamplingPolicy policy(fixed);
+    SamplingAdvice a = policy.advise(loaded());
+    CHECK(a.interval_ms == 5000 && a.batch == 3);
+
+    CHECK(std::string(make_sampling_policy("fixed")->name()) == "fixed");
+    CHECK(std::string(make_sampling_policy("adaptive")->name()) == "adaptive");
+    CHECK(make_sampling_policy("other") == nullptr);
+}
+
+int main() {
+    test_tracker();
+    test_adaptive();
+    test_factory();
+    return check_report("test_sampling");
+}